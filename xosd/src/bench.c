@@ -0,0 +1,516 @@
+/* bench -- micro benchmarks of libxosd
+ *
+ * Measures xosd_create()/xosd_destroy() latency, xosd_display() rates and
+ * how the cost of a redraw grows with the outline, the shadow, the number
+ * of lines and the screen width, and writes the results as JSON so they can
+ * be compared between releases. Meant to be run on a private X server:
+ *
+ *   xvfb-run -s "-screen 0 1280x1024x24" ./bench -o bench.json
+ *
+ * With -X, the screen width sweep starts one Xvfb per screen size itself.
+ * With -H, everything is drawn into memory by xosd_create_headless(), which
+ * needs no X server and leaves only the layout and raster cost:
+ *
+ *   ./bench -H 1280x1024 -X -o bench-headless.json
+ *
+ * An xosd call only hands its change to the event thread, which draws
+ * whatever piled up since its last redraw. So display_per_second is the
+ * rate of calls, of which many share a redraw. The sweeps and the scroll
+ * wait after every call until the event thread has flushed a redraw
+ * (xosd_stats.flushes), so their time per call is the time per redraw on
+ * the client side, plus one handoff of the lock. The X server may lag
+ * behind by what fits into its request queue, which is small compared to
+ * the measured period.
+ *
+ * Last, it counts the allocations of line storage while texts of all
+ * lengths are displayed, scrolled and posted, and fails if updates still
+ * allocate once every length was seen.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+
+#include "xosd.h"
+
+#ifndef XOSD_VERSION
+#define XOSD_VERSION "unknown"
+#endif
+
+#define TIMEOUT 600             /* never hide during a measurement */
+
+static double seconds = 1;
+static int iterations = 20;
+static int headless_width, headless_height;    /* 0 = X server */
+static FILE *out;
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+static xosd *
+new_osd(int lines)
+{
+  xosd *osd;
+
+  if (headless_width)
+    osd = xosd_create_headless(lines, headless_width, headless_height);
+  else
+    osd = xosd_create(lines);
+
+  if (osd == NULL) {
+    fprintf(stderr, "xosd_create: %s\n", xosd_error);
+    exit(EXIT_FAILURE);
+  }
+  xosd_set_timeout(osd, TIMEOUT);
+  return osd;
+}
+
+/* Number of redraws the event thread has flushed. */
+static unsigned long
+redraws(xosd * osd)
+{
+  xosd_stats stats;
+
+  xosd_get_stats(osd, &stats);
+  return stats.flushes;
+}
+
+/* Wait until the event thread has flushed a redraw after "drawn" ones,
+ * return the new count. */
+static unsigned long
+wait_redraw(xosd * osd, unsigned long drawn)
+{
+  unsigned long n;
+
+  while ((n = redraws(osd)) == drawn)
+    ;
+  return n;
+}
+
+/* Update "line" for the configured time, return microseconds per call.
+ * With "each", every call waits for its redraw, which makes it the time
+ * per redraw. */
+static double
+time_updates(xosd * osd, int line, xosd_command command, int each)
+{
+  unsigned long drawn = redraws(osd);
+  double start;
+  long n = 0;
+
+  /* Map the window and settle the font outside of the measurement. */
+  xosd_display(osd, line, XOSD_string, "bench");
+  drawn = wait_redraw(osd, drawn);
+
+  start = now();
+  do {
+    if (command == XOSD_string)
+      xosd_display(osd, line, XOSD_printf, "bench %ld", n);
+    else
+      xosd_display(osd, line, command, (int) (n % 101));
+    if (each)
+      drawn = wait_redraw(osd, drawn);
+    n++;
+  } while (now() - start < seconds);
+
+  return (now() - start) * 1e6 / n;
+}
+
+/* Create/destroy {{{ */
+static void
+print_stats(const char *name, double *v, int n, const char *sep)
+{
+  double sum = 0;
+  int i;
+
+  qsort(v, n, sizeof(double), compare_double);
+  for (i = 0; i < n; i++)
+    sum += v[i];
+  fprintf(out,
+          "    \"%s\": {\"min\": %.1f, \"median\": %.1f, \"mean\": %.1f, "
+          "\"max\": %.1f}%s\n", name, v[0], v[n / 2], sum / n, v[n - 1], sep);
+}
+
+static void
+bench_create(void)
+{
+  double *create = calloc(iterations, sizeof(double));
+  double *destroy = calloc(iterations, sizeof(double));
+  double t;
+  int i;
+
+  for (i = 0; i < iterations; i++) {
+    xosd *osd;
+
+    t = now();
+    osd = new_osd(1);
+    create[i] = (now() - t) * 1e6;
+    t = now();
+    xosd_destroy(osd);
+    destroy[i] = (now() - t) * 1e6;
+  }
+  fprintf(out, "  \"create_destroy\": {\n    \"iterations\": %d,\n",
+          iterations);
+  print_stats("create_us", create, iterations, ",");
+  print_stats("destroy_us", destroy, iterations, "");
+  fprintf(out, "  },\n");
+  free(create);
+  free(destroy);
+}
+
+/* }}} */
+
+/* Display rates {{{ */
+static void
+bench_display(void)
+{
+  static const struct
+  {
+    const char *name;
+    xosd_command command;
+  } kinds[] = {
+    {"text", XOSD_string},
+    {"percentage", XOSD_percentage},
+    {"slider", XOSD_slider},
+  };
+  int i;
+
+  fprintf(out, "  \"display_per_second\": {\n");
+  for (i = 0; i < 3; i++) {
+    xosd *osd = new_osd(1);
+    double us = time_updates(osd, 0, kinds[i].command, 0);
+    fprintf(out, "    \"%s\": %.0f%s\n", kinds[i].name, 1e6 / us,
+            i < 2 ? "," : "");
+    xosd_destroy(osd);
+  }
+  fprintf(out, "  },\n");
+}
+
+/* }}} */
+
+/* Redraw cost sweeps {{{ */
+static void
+sweep_offset(const char *name, int (*set) (xosd *, int), const char *sep)
+{
+  static const int values[] = { 0, 1, 2, 4, 8 };
+  xosd *osd = new_osd(1);
+  int i;
+
+  fprintf(out, "    \"%s\": {", name);
+  for (i = 0; i < 5; i++) {
+    set(osd, values[i]);
+    fprintf(out, "%s\"%d\": %.1f", i ? ", " : "", values[i],
+            time_updates(osd, 0, XOSD_string, 1));
+  }
+  fprintf(out, "}%s\n", sep);
+  xosd_destroy(osd);
+}
+
+/* One line changes, the others stay filled. */
+static void
+sweep_lines(const char *sep)
+{
+  static const int values[] = { 1, 2, 4, 8, 16 };
+  int i, line;
+
+  fprintf(out, "    \"number_lines\": {");
+  for (i = 0; i < 5; i++) {
+    xosd *osd = new_osd(values[i]);
+    for (line = 1; line < values[i]; line++)
+      xosd_display(osd, line, XOSD_printf, "filler line %d", line);
+    fprintf(out, "%s\"%d\": %.1f", i ? ", " : "", values[i],
+            time_updates(osd, 0, XOSD_string, 1));
+    xosd_destroy(osd);
+  }
+  fprintf(out, "}%s\n", sep);
+}
+
+/* Start Xvfb with the given screen, return its display number or -1. */
+static int
+start_xvfb(const char *screen, pid_t * pid)
+{
+  char fd[16], buf[16];
+  int fds[2], n;
+
+  if (pipe(fds) == -1)
+    return -1;
+  if ((*pid = fork()) == 0) {
+    close(fds[0]);
+    snprintf(fd, sizeof(fd), "%d", fds[1]);
+    if ((n = open("/dev/null", O_WRONLY)) != -1)
+      dup2(n, 2);
+    execlp("Xvfb", "Xvfb", "-displayfd", fd, "-screen", "0", screen,
+           "-nolisten", "tcp", NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+  /* Xvfb writes the display number once it accepts connections. */
+  n = *pid == -1 ? -1 : read(fds[0], buf, sizeof(buf) - 1);
+  close(fds[0]);
+  if (n <= 0) {
+    if (*pid > 0)
+      waitpid(*pid, NULL, 0);
+    return -1;
+  }
+  buf[n] = '\0';
+  return atoi(buf);
+}
+
+static void
+sweep_width(const char *sep)
+{
+  static const char *screens[] = {
+    "640x480x24", "1280x1024x24", "1920x1080x24", "3840x2160x24"
+  };
+  char *display = getenv("DISPLAY"), name[16];
+  int i, first = 1;
+
+  display = display ? strdup(display) : NULL;
+  fprintf(out, "    \"screen_width\": {");
+  for (i = 0; i < 4; i++) {
+    pid_t pid;
+    int number, width = headless_width, height = headless_height;
+    xosd *osd;
+
+    if (headless_width) {
+      sscanf(screens[i], "%dx%d", &headless_width, &headless_height);
+      osd = new_osd(1);
+      fprintf(out, "%s\"%d\": %.1f", first ? "" : ", ", headless_width,
+              time_updates(osd, 0, XOSD_string, 1));
+      first = 0;
+      xosd_destroy(osd);
+      headless_width = width;
+      headless_height = height;
+      continue;
+    }
+    if ((number = start_xvfb(screens[i], &pid)) == -1) {
+      fprintf(stderr, "bench: could not start Xvfb %s\n", screens[i]);
+      continue;
+    }
+    snprintf(name, sizeof(name), ":%d", number);
+    setenv("DISPLAY", name, 1);
+    osd = new_osd(1);
+    fprintf(out, "%s\"%d\": %.1f", first ? "" : ", ", atoi(screens[i]),
+            time_updates(osd, 0, XOSD_string, 1));
+    first = 0;
+    xosd_destroy(osd);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+  fprintf(out, "}%s\n", sep);
+
+  if (display) {
+    setenv("DISPLAY", display, 1);
+    free(display);
+  }
+}
+
+/* }}} */
+
+/* Scroll {{{
+ * What osd_cat does with a full display: scroll by one and fill the new
+ * last line. */
+static void
+bench_scroll(void)
+{
+  const int lines = 8;
+  xosd *osd = new_osd(lines);
+  unsigned long drawn = redraws(osd);
+  double start;
+  long n = 0;
+  int line;
+
+  for (line = 0; line < lines; line++)
+    xosd_display(osd, line, XOSD_printf, "scroll line %d", line);
+  drawn = wait_redraw(osd, drawn);
+
+  start = now();
+  do {
+    xosd_scroll(osd, 1);
+    xosd_display(osd, lines - 1, XOSD_printf, "scroll line %ld", n++);
+    drawn = wait_redraw(osd, drawn);
+  } while (now() - start < seconds);
+
+  fprintf(out, "  \"scroll_us\": {\"lines\": %d, \"scroll_and_fill\": %.1f},\n",
+          lines, (now() - start) * 1e6 / n);
+  xosd_destroy(osd);
+}
+
+/* }}} */
+
+/* Allocations {{{
+ * Line storage comes from the allocator set with xosd_set_allocator(),
+ * which here only counts. Once every text length had its turn, updates
+ * must not allocate any more. */
+static unsigned long allocator_calls;
+
+static void *
+counting_alloc(size_t size, void *data)
+{
+  (*(unsigned long *) data)++;
+  return malloc(size);
+}
+
+static void
+counting_release(void *ptr, void *data)
+{
+  (void) data;
+  free(ptr);
+}
+
+/* One round of displays, scrolls and posts, of texts of n % 300 bytes. */
+static void
+allocation_round(xosd * osd, int lines, long n)
+{
+  static char text[300];
+  int len = n % (int) sizeof(text);
+
+  memset(text, 'x', len);
+  text[len] = '\0';
+  xosd_display(osd, n % lines, XOSD_string, text);
+  xosd_display(osd, (n + 1) % lines, XOSD_printf, "%ld %s", n, text);
+  xosd_display(osd, (n + 2) % lines, XOSD_percentage, (int) (n % 101));
+  xosd_scroll(osd, 1);
+  xosd_post(osd, (xosd_priority) (n % 3), n % 2 ? "key" : NULL,
+            XOSD_string, text, XOSD_end);
+}
+
+static int
+bench_allocations(void)
+{
+  const int lines = 4, rounds = 10000;
+  xosd_stats before, after;
+  long n;
+  /* Threadless, so every round ends with the same messages queued. */
+  xosd *osd = xosd_create_threadless(lines, headless_width, headless_height);
+
+  if (osd == NULL) {
+    fprintf(stderr, "xosd_create_threadless: %s\n", xosd_error);
+    exit(EXIT_FAILURE);
+  }
+  xosd_set_timeout(osd, TIMEOUT);
+  /* Warm up until all lengths went by without an allocation. */
+  xosd_set_min_time(osd, 0);
+  xosd_get_stats(osd, &after);
+  do {
+    before = after;
+    for (n = 0; n < 300; n++)
+      allocation_round(osd, lines, n);
+    xosd_get_stats(osd, &after);
+  } while (after.allocations != before.allocations);
+  for (n = 0; n < rounds; n++)
+    allocation_round(osd, lines, n);
+  xosd_get_stats(osd, &after);
+
+  fprintf(out, "  \"allocations\": {\"rounds\": %d, \"warm_up\": %lu, "
+          "\"steady_state\": %lu, \"allocator_calls\": %lu}\n", rounds,
+          before.allocations, after.allocations - before.allocations,
+          allocator_calls);
+  xosd_destroy(osd);
+  return after.allocations == before.allocations ? 0 : -1;
+}
+
+/* }}} */
+
+int
+main(int argc, char *argv[])
+{
+  Display *dpy;
+  int c, sweep = 0, steady;
+
+  out = stdout;
+  xosd_set_allocator(counting_alloc, counting_release, &allocator_calls);
+  while ((c = getopt(argc, argv, "s:n:o:XH:h")) != -1) {
+    switch (c) {
+    case 's':
+      seconds = atof(optarg);
+      break;
+    case 'n':
+      iterations = atoi(optarg) > 0 ? atoi(optarg) : 1;
+      break;
+    case 'o':
+      if ((out = fopen(optarg, "w")) == NULL) {
+        perror(optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'X':
+      sweep = 1;
+      break;
+    case 'H':
+      if (sscanf(optarg, "%dx%d", &headless_width, &headless_height) != 2
+          || headless_width <= 0 || headless_height <= 0) {
+        fprintf(stderr, "bench: -H WIDTHxHEIGHT\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-s SECONDS] [-n ITERATIONS] [-o FILE] [-X] "
+              "[-H WIDTHxHEIGHT]\n"
+              "  -s  Duration of every rate measurement (default 1)\n"
+              "  -n  Number of xosd_create()/xosd_destroy() pairs (default 20)\n"
+              "  -o  Write the JSON results to FILE instead of stdout\n"
+              "  -X  Measure the screen width dependency with private Xvfbs\n"
+              "  -H  Draw into memory with a screen of that size, no X server\n",
+              argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  fprintf(out, "{\n  \"version\": \"%s\",\n  \"seconds\": %g,\n", XOSD_VERSION,
+          seconds);
+  if (headless_width) {
+    fprintf(out, "  \"backend\": \"headless\",\n");
+    fprintf(out, "  \"screen\": {\"width\": %d, \"height\": %d},\n",
+            headless_width, headless_height);
+  } else {
+    if ((dpy = XOpenDisplay(NULL)) == NULL) {
+      fprintf(stderr, "bench: cannot open display\n");
+      return EXIT_FAILURE;
+    }
+    fprintf(out, "  \"backend\": \"x11\",\n");
+    fprintf(out, "  \"screen\": {\"width\": %d, \"height\": %d},\n",
+            DisplayWidth(dpy, DefaultScreen(dpy)),
+            DisplayHeight(dpy, DefaultScreen(dpy)));
+    XCloseDisplay(dpy);
+  }
+
+  bench_create();
+  bench_display();
+  fprintf(out, "  \"redraw_us\": {\n");
+  sweep_offset("outline_offset", xosd_set_outline_offset, ",");
+  sweep_offset("shadow_offset", xosd_set_shadow_offset, ",");
+  sweep_lines(sweep ? "," : "");
+  if (sweep)
+    sweep_width("");
+  fprintf(out, "  },\n");
+  bench_scroll();
+  steady = bench_allocations();
+  fprintf(out, "}\n");
+
+  if (steady == -1)
+    fprintf(stderr, "bench: updates still allocate after warming up\n");
+  return (out == stdout || fclose(out) == 0) && steady == 0 ?
+    EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
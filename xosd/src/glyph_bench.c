@@ -0,0 +1,202 @@
+/* glyph_bench -- glyphs per second of the client side text path
+ *
+ * Draws a line of text again and again into an RGBA image with the glyph
+ * atlas and the coverage blending kernels the headless backend uses, once
+ * plain and once with shadow and a two pixel outline, for every kernel this
+ * CPU runs. Writes glyphs per second, the cost of rasterising a glyph into
+ * the atlas and the memory the atlas holds as JSON:
+ *
+ *   ./glyph_bench -f /usr/share/fonts/truetype/dejavu/DejaVuSans.ttf
+ *
+ * Without -f, the built-in font is used. Every kernel must produce the
+ * same image; "identical" says whether they did.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "xosd.h"
+#include "libxosd/glyph.h"
+
+#define WIDTH 1600
+#define HEIGHT 160
+
+static const char text[] =
+  "The quick brown fox jumps over the lazy dog 0123456789";
+static const char *kernel_names[] = { "scalar", "sse2", "avx2" };
+static const unsigned char white[4] = { 255, 255, 255, 255 };
+
+static double seconds = 1;
+static FILE *out;
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+canvas_init(struct xosd_canvas *c)
+{
+  memset(c, 0, sizeof(*c));
+  c->width = WIDTH;
+  c->height = HEIGHT;
+  c->clip_x1 = WIDTH;
+  c->clip_y1 = HEIGHT;
+  if ((c->rgba = calloc(WIDTH * HEIGHT, 4)) == NULL) {
+    perror("glyph_bench");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void
+canvas_free(struct xosd_canvas *c)
+{
+  free(c->rgba);
+  free(c->coverage);
+}
+
+/* Glyphs per second drawing text, with layers if not NULL. */
+static double
+rate(struct xosd_face *face, int size, const struct xosd_layers *layers)
+{
+  struct xosd_canvas c;
+  double start = now(), elapsed;
+  long n = 0, i;
+
+  canvas_init(&c);
+  do {
+    for (i = 0; i < 100; i++)
+      _xosd_draw_line(&c, face, size, text, 8, HEIGHT / 2, white, layers);
+    n += 100;
+  } while ((elapsed = now() - start) < seconds);
+  canvas_free(&c);
+  return n * (sizeof(text) - 1) / elapsed;
+}
+
+/* The image of text with layers, to compare the kernels. */
+static unsigned char *
+image(struct xosd_face *face, int size, const struct xosd_layers *layers)
+{
+  struct xosd_canvas c;
+
+  canvas_init(&c);
+  _xosd_draw_line(&c, face, size, text, 8, HEIGHT / 2, white, layers);
+  free(c.coverage);
+  return c.rgba;
+}
+
+static void
+bench_size(struct xosd_face *face, int size, const char *sep)
+{
+  struct xosd_layers layers = { 1, 2, 2, 2, {0, 0, 0, 255}, {0, 0, 0, 255} };
+  struct xosd_atlas_stats before, after;
+  unsigned char *reference = NULL;
+  char ascii[96];
+  double start;
+  int i, identical = 1, first = 1;
+
+  /* Rasterise all of printable ASCII into the atlas. */
+  for (i = 0; i < 95; i++)
+    ascii[i] = ' ' + i;
+  ascii[95] = '\0';
+  _xosd_atlas_stats(&before);
+  start = now();
+  _xosd_text_width(face, size, ascii);
+  _xosd_atlas_stats(&after);
+
+  fprintf(out, "    {\"size\": %d, \"rasterise_us_per_glyph\": %.2f,\n",
+          size, (now() - start) * 1e6 /
+          (after.misses - before.misses ? after.misses - before.misses : 1));
+  fprintf(out, "     \"glyphs_per_second\": {");
+  for (i = 0; i < 3; i++) {
+    unsigned char *img;
+
+    if (_xosd_blend_select(kernel_names[i]) == -1)
+      continue;
+    img = image(face, size, &layers);
+    if (reference == NULL)
+      reference = img;
+    else {
+      identical &= memcmp(reference, img, WIDTH * HEIGHT * 4) == 0;
+      free(img);
+    }
+    fprintf(out, "%s\n       \"%s\": {\"text\": %.0f, "
+            "\"shadow_outline\": %.0f}", first ? "" : ",", kernel_names[i],
+            rate(face, size, NULL), rate(face, size, &layers));
+    first = 0;
+  }
+  free(reference);
+  fprintf(out, "\n     },\n     \"identical\": %s}%s\n",
+          identical ? "true" : "false", sep);
+  fflush(out);
+}
+
+int
+main(int argc, char *argv[])
+{
+  static const int builtin_sizes[] = { 16, 32, 48 };
+  static const int font_sizes[] = { 12, 16, 24, 32, 48 };
+  const int *sizes = builtin_sizes;
+  int nsizes = 3, c, i;
+  struct xosd_face *face = NULL;
+  struct xosd_atlas_stats stats;
+  const char *font = NULL;
+
+  out = stdout;
+  while ((c = getopt(argc, argv, "f:s:o:h")) != -1) {
+    switch (c) {
+    case 'f':
+      font = optarg;
+      break;
+    case 's':
+      seconds = atof(optarg);
+      break;
+    case 'o':
+      if ((out = fopen(optarg, "w")) == NULL) {
+        perror(optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-f FONTFILE] [-s SECONDS] [-o FILE]\n"
+              "  -f  Font file to draw with (default: the built-in font)\n"
+              "  -s  Duration of every measurement (default 1)\n"
+              "  -o  Write the JSON results to FILE instead of stdout\n",
+              argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  _xosd_atlas_ref();
+  if (font != NULL) {
+    if ((face = _xosd_face_open(font)) == NULL) {
+      fprintf(stderr, "glyph_bench: %s: %s\n", font, xosd_error);
+      return EXIT_FAILURE;
+    }
+    sizes = font_sizes;
+    nsizes = 5;
+  }
+
+  fprintf(out, "{\n  \"font\": \"%s\",\n  \"seconds\": %g,\n"
+          "  \"glyphs_per_line\": %d,\n  \"default_kernels\": \"%s\",\n"
+          "  \"sizes\": [\n", font ? font : "built-in", seconds,
+          (int) sizeof(text) - 1, _xosd_blend()->name);
+  for (i = 0; i < nsizes; i++)
+    bench_size(face, sizes[i], i < nsizes - 1 ? "," : "");
+  _xosd_atlas_stats(&stats);
+  fprintf(out, "  ],\n  \"atlas\": {\"faces\": %lu, \"glyphs\": %lu, "
+          "\"pages\": %lu, \"bytes\": %lu, \"hits\": %lu, \"misses\": %lu}\n"
+          "}\n", stats.faces, stats.glyphs, stats.pages, stats.bytes,
+          stats.hits, stats.misses);
+  _xosd_atlas_unref();
+  return out == stdout || fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
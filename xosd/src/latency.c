@@ -0,0 +1,375 @@
+/* latency -- time from an xosd call until its pixels reach the window
+ *
+ * A timer inside the library stops once the requests are written to the X
+ * connection, which says nothing about when the server has drawn them. This
+ * probe asks the server instead: it watches the OSD window with the DAMAGE
+ * extension on a connection of its own and measures the time from
+ * xosd_display() or xosd_show() to the first damage event, alone and while
+ * other xosd objects load the server. Only the public xosd.h API is used, so
+ * the numbers hold for whatever draws the window. Meant to be run on a
+ * private X server:
+ *
+ *   xvfb-run -s "-screen 0 1280x1024x24" ./latency -o latency.json
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+
+#include "xosd.h"
+
+#ifndef XOSD_VERSION
+#define XOSD_VERSION "unknown"
+#endif
+
+#define TIMEOUT 600             /* never hide during a measurement */
+#define SETTLE 0.005            /* quiet period before every sample */
+#define LOST 1.0                /* give up waiting for damage after this */
+#define MAX_WINDOWS 1024
+
+static int samples = 200;
+static int ninstances = 16;
+static int nproducers = 4;
+static int outline = 8;
+static FILE *out;
+
+static Display *dpy;
+static Damage damage;
+static int damage_event;
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+static xosd *
+new_osd(int lines)
+{
+  xosd *osd = xosd_create(lines);
+
+  if (osd == NULL) {
+    fprintf(stderr, "xosd_create: %s\n", xosd_error);
+    exit(EXIT_FAILURE);
+  }
+  xosd_set_timeout(osd, TIMEOUT);
+  return osd;
+}
+
+/* Finding the OSD window {{{
+ * xosd names its windows "XOSD", the probe is the one which was not there
+ * before it was created. */
+static int
+list_windows(Window * list, int max)
+{
+  Window root, parent, *children;
+  unsigned int n, i;
+  int found = 0;
+
+  if (!XQueryTree(dpy, DefaultRootWindow(dpy), &root, &parent, &children,
+                  &n))
+    return 0;
+  for (i = 0; i < n && found < max; i++) {
+    char *name;
+    if (XFetchName(dpy, children[i], &name) && name) {
+      if (strcmp(name, "XOSD") == 0)
+        list[found++] = children[i];
+      XFree(name);
+    }
+  }
+  if (children)
+    XFree(children);
+  return found;
+}
+
+static Window
+find_new_window(Window * before, int nbefore)
+{
+  Window after[MAX_WINDOWS];
+  int tries, n, i, j;
+
+  /* The window is created by another connection, give the server time. */
+  for (tries = 0; tries < 100; tries++) {
+    n = list_windows(after, MAX_WINDOWS);
+    for (i = 0; i < n; i++) {
+      for (j = 0; j < nbefore && before[j] != after[i]; j++);
+      if (j == nbefore)
+        return after[i];
+    }
+    usleep(10000);
+  }
+  return None;
+}
+
+/* }}} */
+
+/* Damage events {{{ */
+/* Wait for damage on the probe window, return the time it arrived or -1. */
+static double
+wait_damage(double timeout)
+{
+  double end = now() + timeout;
+  XEvent ev;
+
+  for (;;) {
+    fd_set fds;
+    struct timeval tv;
+    double left;
+
+    while (XPending(dpy)) {
+      XNextEvent(dpy, &ev);
+      if (ev.type == damage_event + XDamageNotify) {
+        double t = now();
+        XDamageSubtract(dpy, damage, None, None);
+        XFlush(dpy);
+        return t;
+      }
+    }
+    if ((left = end - now()) <= 0)
+      return -1;
+    tv.tv_sec = (long) left;
+    tv.tv_usec = (long) ((left - tv.tv_sec) * 1e6);
+    FD_ZERO(&fds);
+    FD_SET(ConnectionNumber(dpy), &fds);
+    select(ConnectionNumber(dpy) + 1, &fds, NULL, NULL, &tv);
+  }
+}
+
+/* Let the previous call reach the screen, so its damage is not counted for
+ * the next one. Any setter waits for the event thread to finish drawing. */
+static void
+settle(xosd * osd)
+{
+  xosd_set_timeout(osd, TIMEOUT);
+  XSync(dpy, False);
+  while (wait_damage(SETTLE) >= 0);
+}
+
+/* }}} */
+
+/* Background load {{{ */
+struct load
+{
+  const char *name;
+  int instances;                /* idle instances showing text */
+  int producers;                /* instances updated by a thread each */
+  int outline;                  /* outline offset of the producers */
+};
+
+static xosd *load_osd[MAX_WINDOWS];
+static pthread_t load_thread[MAX_WINDOWS];
+static volatile int stop;
+
+/* Update a private instance as fast as xosd accepts it. */
+static void *
+producer(void *arg)
+{
+  xosd *osd = arg;
+  long n = 0;
+
+  while (!stop)
+    xosd_display(osd, 0, XOSD_printf, "producer %ld", n++);
+  return NULL;
+}
+
+/* The load stays at the top of the screen, the probe at the bottom, so it
+ * never hides the probe window and swallows its damage. */
+static void
+start_load(const struct load *load)
+{
+  int i;
+
+  stop = 0;
+  for (i = 0; i < load->instances + load->producers; i++) {
+    xosd *osd = load_osd[i] = new_osd(1);
+    xosd_set_pos(osd, XOSD_top);
+    xosd_set_vertical_offset(osd, (i * 20) % 400);
+    xosd_set_horizontal_offset(osd, (i * 40) % 400);
+    if (i < load->instances) {
+      xosd_display(osd, 0, XOSD_printf, "instance %d", i);
+      continue;
+    }
+    xosd_set_outline_offset(osd, load->outline);
+    xosd_set_shadow_offset(osd, load->outline);
+    if (pthread_create(&load_thread[i], NULL, producer, osd) != 0) {
+      perror("latency: pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void
+stop_load(const struct load *load)
+{
+  int i;
+
+  stop = 1;
+  for (i = load->instances; i < load->instances + load->producers; i++)
+    pthread_join(load_thread[i], NULL);
+  for (i = 0; i < load->instances + load->producers; i++)
+    xosd_destroy(load_osd[i]);
+}
+
+/* }}} */
+
+/* Measurement {{{ */
+static void
+print_distribution(const char *name, double *v, int n, int lost,
+                   const char *sep)
+{
+  qsort(v, n, sizeof(double), compare_double);
+  if (n == 0)
+    fprintf(out, "      \"%s\": {\"lost\": %d}%s\n", name, lost, sep);
+  else
+    fprintf(out,
+            "      \"%s\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f, "
+            "\"lost\": %d}%s\n", name, v[n / 2], v[n * 99 / 100], v[n - 1],
+            lost, sep);
+}
+
+/* Time xosd_display() or, with show set, xosd_show() until damage. */
+static void
+measure(xosd * osd, int show, double *v, const char *sep)
+{
+  int i, n = 0, lost = 0;
+
+  xosd_display(osd, 0, XOSD_string, "latency");
+  for (i = 0; i < samples; i++) {
+    double start, end;
+
+    if (show)
+      xosd_hide(osd);
+    settle(osd);
+    start = now();
+    if (show)
+      xosd_show(osd);
+    else
+      xosd_display(osd, 0, XOSD_printf, "latency %d", i);
+    if ((end = wait_damage(LOST)) < 0)
+      lost++;
+    else
+      v[n++] = (end - start) * 1e6;
+  }
+  print_distribution(show ? "show" : "display", v, n, lost, sep);
+}
+
+/* }}} */
+
+int
+main(int argc, char *argv[])
+{
+  struct load loads[] = {
+    {"idle", 0, 0, 0},
+    {"instances", 0, 0, 0},
+    {"producers", 0, 0, 0},
+    {"outline", 0, 0, 0},
+  };
+  const int nloads = sizeof(loads) / sizeof(loads[0]);
+  Window before[MAX_WINDOWS], window;
+  int c, i, error_base, nbefore;
+  double *v;
+  xosd *osd;
+
+  out = stdout;
+  while ((c = getopt(argc, argv, "n:i:p:O:o:h")) != -1) {
+    switch (c) {
+    case 'n':
+      samples = atoi(optarg) > 0 ? atoi(optarg) : 1;
+      break;
+    case 'i':
+      ninstances = atoi(optarg);
+      break;
+    case 'p':
+      nproducers = atoi(optarg);
+      break;
+    case 'O':
+      outline = atoi(optarg);
+      break;
+    case 'o':
+      if ((out = fopen(optarg, "w")) == NULL) {
+        perror(optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-n SAMPLES] [-i INSTANCES] [-p PRODUCERS] "
+              "[-O OFFSET] [-o FILE]\n"
+              "  -n  Samples per measurement (default 200)\n"
+              "  -i  Idle instances of the \"instances\" load (default 16)\n"
+              "  -p  Busy instances of the \"producers\" and \"outline\" "
+              "loads (default 4)\n"
+              "  -O  Outline and shadow offset of the \"outline\" load "
+              "(default 8)\n"
+              "  -o  Write the JSON results to FILE instead of stdout\n",
+              argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if (ninstances < 0 || nproducers < 0
+      || ninstances + nproducers > MAX_WINDOWS) {
+    fprintf(stderr, "latency: at most %d instances\n", MAX_WINDOWS);
+    return EXIT_FAILURE;
+  }
+  loads[1].instances = ninstances;
+  loads[2].producers = loads[3].producers = nproducers;
+  loads[3].outline = outline;
+
+  if ((dpy = XOpenDisplay(NULL)) == NULL) {
+    fprintf(stderr, "latency: cannot open display\n");
+    return EXIT_FAILURE;
+  }
+  if (!XDamageQueryExtension(dpy, &damage_event, &error_base)) {
+    fprintf(stderr, "latency: X server without DAMAGE extension\n");
+    return EXIT_FAILURE;
+  }
+
+  nbefore = list_windows(before, MAX_WINDOWS);
+  osd = new_osd(1);
+  xosd_set_pos(osd, XOSD_bottom);
+  xosd_display(osd, 0, XOSD_string, "latency");
+  if ((window = find_new_window(before, nbefore)) == None) {
+    fprintf(stderr, "latency: cannot find the OSD window\n");
+    return EXIT_FAILURE;
+  }
+  damage = XDamageCreate(dpy, window, XDamageReportNonEmpty);
+
+  v = calloc(samples, sizeof(double));
+  fprintf(out, "{\n  \"version\": \"%s\",\n  \"samples\": %d,\n",
+          XOSD_VERSION, samples);
+  fprintf(out, "  \"instances\": %d,\n  \"producers\": %d,\n"
+          "  \"outline_offset\": %d,\n  \"latency_us\": {\n", ninstances,
+          nproducers, outline);
+  for (i = 0; i < nloads; i++) {
+    start_load(&loads[i]);
+    fprintf(out, "    \"%s\": {\n", loads[i].name);
+    measure(osd, 0, v, ",");
+    measure(osd, 1, v, "");
+    fprintf(out, "    }%s\n", i < nloads - 1 ? "," : "");
+    stop_load(&loads[i]);
+  }
+  fprintf(out, "  }\n}\n");
+
+  free(v);
+  XDamageDestroy(dpy, damage);
+  xosd_destroy(osd);
+  XCloseDisplay(dpy);
+  return out == stdout || fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
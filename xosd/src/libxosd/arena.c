@@ -0,0 +1,171 @@
+/*
+ * XOSD
+ *
+ * Copyright (c) 2000 Andre Renaud (andre@ignavus.net)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include "intern.h"
+
+/* The line storage of an object.
+ * Texts too long to be kept inside union xosd_line live in buffers of 64
+ * to ARENA_MAX bytes, in powers of two. They are cut from chunks of
+ * ARENA_CHUNK bytes and, once released, kept on a free list per size for
+ * the next text of that size or smaller, so an object which keeps changing
+ * its lines stops calling the allocator after the first few updates. Longer buffers
+ * come from the allocator directly. The chunks go back to it when the
+ * object is destroyed. */
+
+#define ARENA_MIN 64
+#define ARENA_CHUNK 4096
+#define ARENA_ALIGN 16
+
+/* Chunk header, padded to keep the buffers aligned. */
+union xosd_chunk
+{
+  union xosd_chunk *next;
+  char align[ARENA_ALIGN];
+};
+
+static void *
+_default_alloc(size_t size, void *data)
+{
+  (void) data;
+  return malloc(size);
+}
+
+static void
+_default_release(void *ptr, void *data)
+{
+  (void) data;
+  free(ptr);
+}
+
+/* The allocator of objects to come, see xosd_set_allocator(). */
+static void *(*_alloc) (size_t size, void *data) = _default_alloc;
+static void (*_release) (void *ptr, void *data) = _default_release;
+static void *_alloc_data;
+
+/* xosd_set_allocator -- Set where line storage comes from {{{ */
+int
+xosd_set_allocator(void *(*alloc) (size_t size, void *data),
+                   void (*release) (void *ptr, void *data), void *data)
+{
+  if ((alloc == NULL) != (release == NULL))
+    return -1;
+  _alloc = alloc ? alloc : _default_alloc;
+  _release = release ? release : _default_release;
+  _alloc_data = data;
+  return 0;
+}
+
+/* }}} */
+
+void
+_xosd_arena_init(struct xosd_arena *arena)
+{
+  memset(arena, 0, sizeof(*arena));
+  pthread_mutex_init(&arena->mutex, NULL);
+  arena->alloc = _alloc;
+  arena->release = _release;
+  arena->data = _alloc_data;
+}
+
+void
+_xosd_arena_destroy(struct xosd_arena *arena)
+{
+  union xosd_chunk *chunk, *next;
+
+  for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+    next = chunk->next;
+    arena->release(chunk, arena->data);
+  }
+  arena->chunks = NULL;
+  pthread_mutex_destroy(&arena->mutex);
+}
+
+/* Index of the free list for buffers of size, which is rounded up. */
+static int
+_arena_class(size_t *size)
+{
+  size_t s = ARENA_MIN;
+  int class = 0;
+
+  while (s < *size) {
+    s <<= 1;
+    class++;
+  }
+  *size = s;
+  return class;
+}
+
+/* A buffer of at least *size bytes, *size is set to what it holds. Returns
+ * NULL when out of memory. */
+void *
+_xosd_arena_get(struct xosd_arena *arena, size_t * size)
+{
+  union xosd_chunk *chunk;
+  void *p = NULL;
+  int class;
+
+  pthread_mutex_lock(&arena->mutex);
+  if (*size > ARENA_MAX) {
+    arena->allocations++;
+    p = arena->alloc(*size, arena->data);
+    goto out;
+  }
+  /* A larger buffer will do before a new one is cut. */
+  for (class = _arena_class(size); class < ARENA_CLASSES; class++)
+    if ((p = arena->free[class]) != NULL) {
+      arena->free[class] = *(void **) p;
+      *size = (size_t) ARENA_MIN << class;
+      goto out;
+    }
+  if (arena->left < *size) {
+    arena->allocations++;
+    if ((chunk = arena->alloc(ARENA_CHUNK, arena->data)) == NULL)
+      goto out;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->next = (char *) (chunk + 1);
+    arena->left = ARENA_CHUNK - sizeof(*chunk);
+  }
+  p = arena->next;
+  arena->next += *size;
+  arena->left -= *size;
+out:
+  pthread_mutex_unlock(&arena->mutex);
+  return p;
+}
+
+/* Give back a buffer of _xosd_arena_get(), with the size it set. */
+void
+_xosd_arena_put(struct xosd_arena *arena, void *p, size_t size)
+{
+  int class;
+
+  pthread_mutex_lock(&arena->mutex);
+  if (size > ARENA_MAX)
+    arena->release(p, arena->data);
+  else {
+    class = _arena_class(&size);
+    *(void **) p = arena->free[class];
+    arena->free[class] = p;
+  }
+  pthread_mutex_unlock(&arena->mutex);
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -0,0 +1,276 @@
+/*
+ * XOSD
+ *
+ * Copyright (c) 2000 Andre Renaud (andre@ignavus.net)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/* Kernels blending glyph coverage into RGBA images.
+ *
+ * All kernels compute the same bytes: every channel becomes
+ * (rgba * c + dst * (255 - c)) / 255, rounded, for a coverage c. The
+ * division is done as (t + 128 + ((t + 128) >> 8)) >> 8, which is exact
+ * for all t up to 255 * 255 and fits 16 bit lanes. So c = 0 keeps a pixel
+ * and c = 255 paints it, as the bitmap drawing always did.
+ *
+ * The SSE2 and AVX2 versions are compiled with target attributes and
+ * picked at run time, libxosd itself is built for the plain target.
+ * XOSD_BLEND=scalar, sse2 or avx2 in the environment forces a version. */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "glyph.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || \
+    __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  define BLEND_X86
+#  include <immintrin.h>
+#endif
+
+/* Scalar. {{{ */
+static inline unsigned char
+div255(unsigned int t)
+{
+  t += 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+static void
+span_scalar(unsigned char *dst, const unsigned char *coverage, int n,
+            const unsigned char rgba[4])
+{
+  int i, j;
+
+  for (i = 0; i < n; i++, dst += 4) {
+    unsigned int c = coverage[i];
+
+    if (c == 0)
+      continue;
+    for (j = 0; j < 4; j++)
+      dst[j] = div255(rgba[j] * c + dst[j] * (255 - c));
+  }
+}
+
+static void
+max_scalar(unsigned char *dst, const unsigned char *src, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (src[i] > dst[i])
+      dst[i] = src[i];
+}
+
+/* }}} */
+
+#ifdef BLEND_X86
+/* SSE2, four pixels at a time. {{{ */
+/* Two pixels of 16 bit channels. */
+static inline __attribute__ ((target("sse2"))) __m128i
+blend_sse2(__m128i dst, __m128i c, __m128i rgba)
+{
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(rgba, c),
+                            _mm_mullo_epi16(dst, _mm_sub_epi16
+                                            (_mm_set1_epi16(255), c)));
+
+  t = _mm_add_epi16(t, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static __attribute__ ((target("sse2"))) void
+span_sse2(unsigned char *dst, const unsigned char *coverage, int n,
+          const unsigned char rgba[4])
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i colour;
+  uint32_t v;
+  int i;
+
+  memcpy(&v, rgba, 4);
+  colour = _mm_unpacklo_epi8(_mm_set1_epi32(v), zero);
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128i c, d;
+
+    memcpy(&v, coverage + i, 4);
+    if (v == 0)
+      continue;
+    /* c0 c1 c2 c3 -> c0 c0 c0 c0 c1 c1 c1 c1 ... */
+    c = _mm_cvtsi32_si128(v);
+    c = _mm_unpacklo_epi8(c, c);
+    c = _mm_unpacklo_epi16(c, c);
+    d = _mm_loadu_si128((__m128i *) (dst + i * 4));
+    d = _mm_packus_epi16(blend_sse2(_mm_unpacklo_epi8(d, zero),
+                                    _mm_unpacklo_epi8(c, zero), colour),
+                         blend_sse2(_mm_unpackhi_epi8(d, zero),
+                                    _mm_unpackhi_epi8(c, zero), colour));
+    _mm_storeu_si128((__m128i *) (dst + i * 4), d);
+  }
+  span_scalar(dst + i * 4, coverage + i, n - i, rgba);
+}
+
+static __attribute__ ((target("sse2"))) void
+max_sse2(unsigned char *dst, const unsigned char *src, int n)
+{
+  int i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    _mm_storeu_si128((__m128i *) (dst + i),
+                     _mm_max_epu8(_mm_loadu_si128((__m128i *) (dst + i)),
+                                  _mm_loadu_si128((__m128i *) (src + i))));
+  max_scalar(dst + i, src + i, n - i);
+}
+
+/* }}} */
+
+/* AVX2, eight pixels at a time. {{{ */
+/* The unpacks and the pack work within 128 bit lanes, so the pixels come
+ * out in the order they went in. The upper halves are cleared before the
+ * SSE2 code does the rest, which is slow on dirty registers. */
+static inline __attribute__ ((target("avx2"))) __m256i
+blend_avx2(__m256i dst, __m256i c, __m256i rgba)
+{
+  __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(rgba, c),
+                               _mm256_mullo_epi16(dst, _mm256_sub_epi16
+                                                  (_mm256_set1_epi16(255),
+                                                   c)));
+
+  t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+static __attribute__ ((target("avx2"))) void
+span_avx2(unsigned char *dst, const unsigned char *coverage, int n,
+          const unsigned char rgba[4])
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i expand = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1,
+                                          2, 2, 2, 2, 3, 3, 3, 3,
+                                          4, 4, 4, 4, 5, 5, 5, 5,
+                                          6, 6, 6, 6, 7, 7, 7, 7);
+  __m256i colour;
+  uint32_t v;
+  uint64_t v8;
+  int i;
+
+  memcpy(&v, rgba, 4);
+  colour = _mm256_unpacklo_epi8(_mm256_set1_epi32(v), zero);
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256i c, d;
+
+    memcpy(&v8, coverage + i, 8);
+    if (v8 == 0)
+      continue;
+    c = _mm256_shuffle_epi8(_mm256_set1_epi64x(v8), expand);
+    d = _mm256_loadu_si256((__m256i *) (dst + i * 4));
+    d = _mm256_packus_epi16(blend_avx2(_mm256_unpacklo_epi8(d, zero),
+                                       _mm256_unpacklo_epi8(c, zero),
+                                       colour),
+                            blend_avx2(_mm256_unpackhi_epi8(d, zero),
+                                       _mm256_unpackhi_epi8(c, zero),
+                                       colour));
+    _mm256_storeu_si256((__m256i *) (dst + i * 4), d);
+  }
+  _mm256_zeroupper();
+  span_sse2(dst + i * 4, coverage + i, n - i, rgba);
+}
+
+static __attribute__ ((target("avx2"))) void
+max_avx2(unsigned char *dst, const unsigned char *src, int n)
+{
+  int i;
+
+  for (i = 0; i + 32 <= n; i += 32)
+    _mm256_storeu_si256((__m256i *) (dst + i),
+                        _mm256_max_epu8(_mm256_loadu_si256
+                                        ((__m256i *) (dst + i)),
+                                        _mm256_loadu_si256((__m256i *) (src +
+                                                                        i))));
+  _mm256_zeroupper();
+  max_sse2(dst + i, src + i, n - i);
+}
+
+/* }}} */
+#endif
+
+/* Choosing. {{{ */
+static const struct xosd_blend kernels[] = {
+#ifdef BLEND_X86
+  {"avx2", span_avx2, max_avx2},
+  {"sse2", span_sse2, max_sse2},
+#endif
+  {"scalar", span_scalar, max_scalar},
+};
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static pthread_once_t blend_once = PTHREAD_ONCE_INIT;
+static const struct xosd_blend *blend_kernels;
+
+static int
+supported(const struct xosd_blend *k)
+{
+#ifdef BLEND_X86
+  __builtin_cpu_init();
+  if (strcmp(k->name, "avx2") == 0)
+    return __builtin_cpu_supports("avx2");
+  if (strcmp(k->name, "sse2") == 0)
+    return __builtin_cpu_supports("sse2");
+#endif
+  return 1;
+}
+
+/* Use the first supported kernels named name, any if NULL. */
+static int
+use(const char *name)
+{
+  unsigned int i;
+
+  for (i = 0; i < NKERNELS; i++)
+    if ((name == NULL || strcmp(kernels[i].name, name) == 0)
+        && supported(&kernels[i])) {
+      __atomic_store_n(&blend_kernels, &kernels[i], __ATOMIC_RELEASE);
+      return 0;
+    }
+  return -1;
+}
+
+static void
+blend_init(void)
+{
+  const char *env = getenv("XOSD_BLEND");
+
+  if (env == NULL || use(env) == -1)
+    use(NULL);
+}
+
+const struct xosd_blend *
+_xosd_blend(void)
+{
+  pthread_once(&blend_once, blend_init);
+  return __atomic_load_n(&blend_kernels, __ATOMIC_ACQUIRE);
+}
+
+int
+_xosd_blend_select(const char *name)
+{
+  pthread_once(&blend_once, blend_init);
+  return use(name);
+}
+
+/* }}} */
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
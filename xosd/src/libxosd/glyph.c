@@ -0,0 +1,569 @@
+/*
+ * XOSD
+ *
+ * Copyright (c) 2000 Andre Renaud (andre@ignavus.net)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include "intern.h"
+#ifdef HAVE_FREETYPE
+#  include <ft2build.h>
+#  include FT_FREETYPE_H
+#endif
+
+#include <limits.h>
+
+#include "font8x16.h"
+
+#ifndef MIN
+#  define MIN(a, b) ((a) < (b) ? (a) : (b))
+#  define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+/* The glyph atlas.
+ * Every glyph is rasterised once per process, face and pixel size, and its
+ * coverage kept in pages packed shelf by shelf. A hash table on (face,
+ * size, glyph) finds it again. Pages are never moved or freed while the
+ * atlas has users, so struct xosd_glyph pointers stay valid without the
+ * lock; only looking glyphs up, and rasterising them, takes it.
+ */
+
+#define ATLAS_PAGE 256          /* pixels square, larger glyphs get their own */
+
+struct page
+{
+  struct page *next;
+  int width, height;
+  int x;                        /* of the next glyph on the shelf */
+  int shelf_y, shelf_height;
+  unsigned char pixels[1];
+};
+
+struct entry
+{
+  struct entry *next;           /* in the hash chain */
+  struct xosd_face *face;
+  int size;
+  unsigned int index;           /* glyph index, or character of the built-in font */
+  struct xosd_glyph glyph;
+};
+
+struct xosd_face
+{
+  struct xosd_face *next;
+  char *path;
+#ifdef HAVE_FREETYPE
+  FT_Face ft;
+  int size;                     /* the pixel size ft is set to */
+#endif
+};
+
+static struct
+{
+  pthread_mutex_t lock;
+  int users;
+#ifdef HAVE_FREETYPE
+  FT_Library library;
+#endif
+  struct xosd_face *faces;
+  struct page *pages;           /* the first is filled */
+  struct entry **table;
+  unsigned int table_size;      /* power of two */
+  struct xosd_atlas_stats stats;
+} atlas = {
+.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* Users. {{{ */
+void
+_xosd_atlas_ref(void)
+{
+  pthread_mutex_lock(&atlas.lock);
+  atlas.users++;
+  pthread_mutex_unlock(&atlas.lock);
+}
+
+void
+_xosd_atlas_unref(void)
+{
+  pthread_mutex_lock(&atlas.lock);
+  if (--atlas.users == 0) {
+    unsigned int i;
+
+    while (atlas.pages != NULL) {
+      struct page *p = atlas.pages;
+      atlas.pages = p->next;
+      free(p);
+    }
+    for (i = 0; i < atlas.table_size; i++)
+      while (atlas.table[i] != NULL) {
+        struct entry *e = atlas.table[i];
+        atlas.table[i] = e->next;
+        free(e);
+      }
+    free(atlas.table);
+    atlas.table = NULL;
+    atlas.table_size = 0;
+    while (atlas.faces != NULL) {
+      struct xosd_face *f = atlas.faces;
+      atlas.faces = f->next;
+#ifdef HAVE_FREETYPE
+      FT_Done_Face(f->ft);
+#endif
+      free(f->path);
+      free(f);
+    }
+#ifdef HAVE_FREETYPE
+    if (atlas.library != NULL)
+      FT_Done_FreeType(atlas.library);
+    atlas.library = NULL;
+#endif
+    memset(&atlas.stats, 0, sizeof(atlas.stats));
+  }
+  pthread_mutex_unlock(&atlas.lock);
+}
+
+void
+_xosd_atlas_stats(struct xosd_atlas_stats *stats)
+{
+  pthread_mutex_lock(&atlas.lock);
+  *stats = atlas.stats;
+  pthread_mutex_unlock(&atlas.lock);
+}
+
+/* }}} */
+
+/* Faces. {{{ */
+struct xosd_face *
+_xosd_face_open(const char *path)
+{
+#ifdef HAVE_FREETYPE
+  struct xosd_face *f;
+
+  pthread_mutex_lock(&atlas.lock);
+  for (f = atlas.faces; f != NULL; f = f->next)
+    if (strcmp(f->path, path) == 0)
+      goto out;
+
+  if (atlas.library == NULL && FT_Init_FreeType(&atlas.library) != 0) {
+    atlas.library = NULL;
+    xosd_error = "Cannot initialise FreeType";
+    goto out;
+  }
+  if ((f = calloc(1, sizeof(struct xosd_face))) == NULL ||
+      (f->path = strdup(path)) == NULL) {
+    free(f);
+    f = NULL;
+    xosd_error = "Out of memory";
+    goto out;
+  }
+  if (FT_New_Face(atlas.library, path, 0, &f->ft) != 0) {
+    free(f->path);
+    free(f);
+    f = NULL;
+    xosd_error = "Cannot open font file";
+    goto out;
+  }
+  f->next = atlas.faces;
+  atlas.faces = f;
+  atlas.stats.faces++;
+out:
+  pthread_mutex_unlock(&atlas.lock);
+  return f;
+#else
+  xosd_error = "libxosd was built without FreeType";
+  return NULL;
+#endif
+}
+
+#ifdef HAVE_FREETYPE
+/* Called with the lock held. */
+static void
+face_size(struct xosd_face *face, int size)
+{
+  if (face->size != size) {
+    FT_Set_Pixel_Sizes(face->ft, 0, size);
+    face->size = size;
+  }
+}
+#endif
+
+void
+_xosd_face_metrics(struct xosd_face *face, int size, int *ascent,
+                   int *descent)
+{
+#ifdef HAVE_FREETYPE
+  if (face != NULL) {
+    pthread_mutex_lock(&atlas.lock);
+    face_size(face, size);
+    *ascent = (face->ft->size->metrics.ascender + 63) >> 6;
+    *descent = (-face->ft->size->metrics.descender + 63) >> 6;
+    pthread_mutex_unlock(&atlas.lock);
+    return;
+  }
+#endif
+  *ascent = FONT_ASCENT * (size / FONT_HEIGHT);
+  *descent = (FONT_HEIGHT - FONT_ASCENT) * (size / FONT_HEIGHT);
+}
+
+/* }}} */
+
+/* Atlas. {{{ */
+static unsigned int
+hash(struct xosd_face *face, int size, unsigned int index)
+{
+  return ((unsigned int) ((size_t) face >> 4) * 31u + size * 131u +
+          index) * 2654435761u;
+}
+
+/* Room for width x height pixels of coverage. */
+static unsigned char *
+atlas_alloc(int width, int height, int *stride)
+{
+  struct page *p = atlas.pages;
+
+  if (p != NULL && p->x + width > p->width) {
+    p->shelf_y += p->shelf_height;
+    p->shelf_height = 0;
+    p->x = 0;
+  }
+  if (p == NULL || p->x + width > p->width ||
+      p->shelf_y + height > p->height) {
+    int w = width > ATLAS_PAGE ? width : ATLAS_PAGE;
+    int h = height > ATLAS_PAGE ? height : ATLAS_PAGE;
+
+    if ((p = calloc(1, sizeof(struct page) + (size_t) w * h)) == NULL)
+      return NULL;
+    p->width = w;
+    p->height = h;
+    p->next = atlas.pages;
+    atlas.pages = p;
+    atlas.stats.pages++;
+    atlas.stats.bytes += sizeof(struct page) + (size_t) w * h;
+  }
+  *stride = p->width;
+  p->x += width;
+  if (height > p->shelf_height)
+    p->shelf_height = height;
+  return p->pixels + (size_t) p->shelf_y * p->width + p->x - width;
+}
+
+static int
+atlas_grow(void)
+{
+  unsigned int size = atlas.table_size ? 2 * atlas.table_size : 256, i;
+  struct entry **table = calloc(size, sizeof(struct entry *));
+
+  if (table == NULL)
+    return -1;
+  for (i = 0; i < atlas.table_size; i++)
+    while (atlas.table[i] != NULL) {
+      struct entry *e = atlas.table[i];
+      unsigned int h = hash(e->face, e->size, e->index) & (size - 1);
+      atlas.table[i] = e->next;
+      e->next = table[h];
+      table[h] = e;
+    }
+  atlas.stats.bytes += (size - atlas.table_size) * sizeof(struct entry *);
+  free(atlas.table);
+  atlas.table = table;
+  atlas.table_size = size;
+  return 0;
+}
+
+/* Rasterise a glyph into the atlas. */
+static int
+rasterise(struct entry *e)
+{
+  struct xosd_glyph *g = &e->glyph;
+  unsigned char *pixels;
+  int row, col;
+
+#ifdef HAVE_FREETYPE
+  if (e->face != NULL) {
+    FT_GlyphSlot slot = e->face->ft->glyph;
+    FT_Bitmap *b = &slot->bitmap;
+
+    face_size(e->face, e->size);
+    if (FT_Load_Glyph(e->face->ft, e->index, FT_LOAD_RENDER) != 0)
+      return -1;
+    g->left = slot->bitmap_left;
+    g->top = slot->bitmap_top;
+    g->width = b->width;
+    g->height = b->rows;
+    g->advance = (slot->advance.x + 32) >> 6;
+    if (g->width == 0 || g->height == 0)
+      return 0;
+    if ((pixels = atlas_alloc(g->width, g->height, &g->stride)) == NULL)
+      return -1;
+    for (row = 0; row < g->height; row++) {
+      const unsigned char *src = b->buffer + (b->pitch >= 0 ? row :
+                                              g->height - 1 - row) *
+        abs(b->pitch);
+      unsigned char *dst = pixels + row * g->stride;
+
+      if (b->pixel_mode == FT_PIXEL_MODE_MONO)
+        for (col = 0; col < g->width; col++)
+          dst[col] = (src[col / 8] & (0x80 >> (col % 8))) ? 255 : 0;
+      else if (b->num_grays == 256)
+        memcpy(dst, src, g->width);
+      else
+        for (col = 0; col < g->width; col++)
+          dst[col] = src[col] * 255 / (b->num_grays - 1);
+    }
+    g->coverage = pixels;
+    return 0;
+  }
+#endif
+  {
+    const unsigned char *bits = font8x16[e->index - FONT_FIRST];
+    int s = e->size / FONT_HEIGHT;
+
+    g->left = 0;
+    g->top = FONT_ASCENT * s;
+    g->width = FONT_WIDTH * s;
+    g->height = FONT_HEIGHT * s;
+    g->advance = FONT_WIDTH * s;
+    if ((pixels = atlas_alloc(g->width, g->height, &g->stride)) == NULL)
+      return -1;
+    for (row = 0; row < g->height; row++)
+      for (col = 0; col < g->width; col++)
+        if (bits[row / s] & (0x80 >> (col / s)))
+          pixels[row * g->stride + col] = 255;
+    g->coverage = pixels;
+  }
+  return 0;
+}
+
+/* Find or make a glyph. Called with the lock held. */
+static const struct xosd_glyph *
+lookup(struct xosd_face *face, int size, unsigned int index)
+{
+  unsigned int h = hash(face, size, index);
+  struct entry *e;
+
+  if (atlas.table != NULL)
+    for (e = atlas.table[h & (atlas.table_size - 1)]; e; e = e->next)
+      if (e->index == index && e->size == size && e->face == face) {
+        atlas.stats.hits++;
+        return &e->glyph;
+      }
+
+  atlas.stats.misses++;
+  if (atlas.stats.glyphs >= atlas.table_size && atlas_grow() == -1)
+    return NULL;
+  if ((e = calloc(1, sizeof(struct entry))) == NULL)
+    return NULL;
+  e->face = face;
+  e->size = size;
+  e->index = index;
+  if (rasterise(e) == -1) {
+    free(e);
+    return NULL;
+  }
+  h &= atlas.table_size - 1;
+  e->next = atlas.table[h];
+  atlas.table[h] = e;
+  atlas.stats.glyphs++;
+  atlas.stats.bytes += sizeof(struct entry);
+  return &e->glyph;
+}
+
+/* The glyph of the character at *s, moving *s past it. NULL if the
+ * bytes have none. Called with the lock held. */
+static const struct xosd_glyph *
+next_glyph(struct xosd_face *face, int size, const char **s)
+{
+  const unsigned char *p = (const unsigned char *) *s;
+  unsigned int c = *p++;
+
+#ifdef HAVE_FREETYPE
+  if (face != NULL) {
+    int n = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0, i;
+    unsigned int u = n ? c & (0x3f >> n) : c;
+
+    /* Malformed UTF-8 is taken as Latin-1, byte by byte. */
+    for (i = 0; i < n && (p[i] & 0xc0) == 0x80; i++)
+      u = (u << 6) | (p[i] & 0x3f);
+    if (i == n)
+      p += n;
+    else
+      u = c;
+    *s = (const char *) p;
+    return lookup(face, size, FT_Get_Char_Index(face->ft, u));
+  }
+#endif
+  *s = (const char *) p;
+  if (c >= 0x80 && c < 0xc0)
+    return NULL;
+  if (c < FONT_FIRST || c > FONT_LAST)
+    c = '?';
+  return lookup(face, size, c);
+}
+
+int
+_xosd_text_width(struct xosd_face *face, int size, const char *string)
+{
+  const struct xosd_glyph *g;
+  int width = 0;
+
+  pthread_mutex_lock(&atlas.lock);
+  while (*string)
+    if ((g = next_glyph(face, size, &string)) != NULL)
+      width += g->advance;
+  pthread_mutex_unlock(&atlas.lock);
+  return width;
+}
+
+/* Bytes without a glyph of their own belong to the character before. */
+int
+_xosd_text_extents(struct xosd_face *face, int size, const char *string,
+                   struct xosd_extent *ext)
+{
+  const struct xosd_glyph *g;
+  const char *s = string;
+  int n = 0;
+
+  ext[0].offset = ext[0].x = 0;
+  pthread_mutex_lock(&atlas.lock);
+  while (*s) {
+    int x = ext[n].x;
+    if ((g = next_glyph(face, size, &s)) != NULL || n == 0)
+      n++;
+    ext[n].offset = s - string;
+    ext[n].x = x + (g ? g->advance : 0);
+  }
+  pthread_mutex_unlock(&atlas.lock);
+  return n;
+}
+
+/* }}} */
+
+/* Drawing. {{{ */
+/* Blend width x height coverage, placed at x,y, into the canvas. */
+static void
+composite(struct xosd_canvas *canvas, const unsigned char *coverage,
+          int width, int height, int x, int y, const unsigned char rgba[4])
+{
+  const struct xosd_blend *blend = _xosd_blend();
+  int x0 = x, y0 = y, x1 = x + width, y1 = y + height;
+
+  x0 = MAX(MAX(x0, canvas->clip_x0), 0);
+  y0 = MAX(MAX(y0, canvas->clip_y0), 0);
+  x1 = MIN(MIN(x1, canvas->clip_x1), canvas->width);
+  y1 = MIN(MIN(y1, canvas->clip_y1), canvas->height);
+  for (; y0 < y1 && x0 < x1; y0++)
+    blend->span(canvas->rgba + ((size_t) y0 * canvas->width + x0) * 4,
+                coverage + (size_t) (y0 - y) * width + x0 - x, x1 - x0,
+                rgba);
+}
+
+/* The outline drawn before was the text shifted by i pixels in the eight
+ * directions, for every i up to its width. Its coverage is the maximum of
+ * the same shifts of the text coverage. */
+static void
+dilate(unsigned char *outline, const unsigned char *coverage, int width,
+       int height, int size)
+{
+  const struct xosd_blend *blend = _xosd_blend();
+  int i, j, y;
+
+  memset(outline, 0, (size_t) width * height);
+  for (i = 1; i <= size; i++)
+    for (j = 0; j < 9; j++) {
+      int dx = (j / 3 - 1) * i, dy = (j % 3 - 1) * i;
+
+      if (j == 4)
+        continue;
+      for (y = MAX(dy, 0); y < height + MIN(dy, 0); y++)
+        blend->maximum(outline + (size_t) y * width + MAX(dx, 0),
+                   coverage + (size_t) (y - dy) * width + MAX(-dx, 0),
+                   width - abs(dx));
+    }
+}
+
+void
+_xosd_draw_line(struct xosd_canvas *canvas, struct xosd_face *face,
+                int size, const char *string, int x, int y,
+                const unsigned char rgba[4], const struct xosd_layers *layers)
+{
+  const struct xosd_blend *blend = _xosd_blend();
+  const struct xosd_glyph *g;
+  const char *s;
+  int pad = layers ? layers->outline : 0;
+  int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN, pen, width,
+    height, row;
+  size_t need;
+  unsigned char *coverage;
+
+  /* The ink box of the line, from the pen. */
+  pthread_mutex_lock(&atlas.lock);
+  for (s = string, pen = 0; *s;)
+    if ((g = next_glyph(face, size, &s)) != NULL) {
+      if (g->width && g->height) {
+        x0 = MIN(x0, pen + g->left);
+        x1 = MAX(x1, pen + g->left + g->width);
+        y0 = MIN(y0, -g->top);
+        y1 = MAX(y1, -g->top + g->height);
+      }
+      pen += g->advance;
+    }
+  if (x0 >= x1) {
+    pthread_mutex_unlock(&atlas.lock);
+    return;
+  }
+
+  width = x1 - x0 + 2 * pad;
+  height = y1 - y0 + 2 * pad;
+  need = (size_t) width * height * (pad ? 2 : 1);
+  if (need > canvas->coverage_size) {
+    if ((coverage = realloc(canvas->coverage, need)) == NULL) {
+      pthread_mutex_unlock(&atlas.lock);
+      return;
+    }
+    canvas->coverage = coverage;
+    canvas->coverage_size = need;
+  }
+  coverage = canvas->coverage;
+  memset(coverage, 0, (size_t) width * height);
+
+  /* Glyphs may overlap, keep the larger coverage. */
+  for (s = string, pen = 0; *s;)
+    if ((g = next_glyph(face, size, &s)) != NULL) {
+      for (row = 0; g->width && row < g->height; row++)
+        blend->maximum(coverage + (size_t) (row - g->top - y0 + pad) * width +
+                   pen + g->left - x0 + pad,
+                   g->coverage + row * g->stride, g->width);
+      pen += g->advance;
+    }
+  pthread_mutex_unlock(&atlas.lock);
+
+  x += x0 - pad;
+  y += y0 - pad;
+  if (layers != NULL && layers->shadow)
+    composite(canvas, coverage, width, height, x + layers->shadow_x,
+              y + layers->shadow_y, layers->shadow_rgba);
+  if (pad) {
+    unsigned char *outline = coverage + (size_t) width * height;
+
+    dilate(outline, coverage, width, height, pad);
+    composite(canvas, outline, width, height, x, y, layers->outline_rgba);
+  }
+  composite(canvas, coverage, width, height, x, y, rgba);
+}
+
+/* }}} */
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
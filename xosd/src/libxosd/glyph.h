@@ -0,0 +1,100 @@
+/* Client side text: a glyph atlas shared by all objects of the process and
+ * the kernels blending glyph coverage into RGBA images, see glyph.c and
+ * blend.c. The headless backend draws all its text with these.
+ *
+ * Coverage is 8 bit, 0 leaves a pixel alone and 255 paints it. A line of
+ * text is first collected into one coverage buffer; its shadow, outline
+ * and text layers are all blended from that buffer. */
+#ifndef XOSD_GLYPH_H
+#define XOSD_GLYPH_H
+
+#include <stddef.h>
+
+/* A font file opened with FreeType. NULL is the built-in 8x16 font, whose
+ * sizes are multiples of 16 pixels. */
+struct xosd_face;
+struct xosd_extent;
+
+struct xosd_glyph
+{
+  const unsigned char *coverage;        /* rows of stride bytes */
+  int stride;
+  short left;                   /* of the coverage, from the pen */
+  short top;                    /* of the coverage, up from the baseline */
+  unsigned short width;
+  unsigned short height;
+  short advance;
+};
+
+/* An RGBA image to draw into, rows of width * 4 bytes. */
+struct xosd_canvas
+{
+  unsigned char *rgba;
+  int width;
+  int height;
+  int clip_x0, clip_y0, clip_x1, clip_y1;       /* drawing is limited to */
+  unsigned char *coverage;      /* scratch of _xosd_draw_line() */
+  size_t coverage_size;
+};
+
+/* What _xosd_draw_line() draws below the text. */
+struct xosd_layers
+{
+  int shadow;                   /* draw the shadow */
+  int shadow_x, shadow_y;       /* offset of the shadow */
+  int outline;                  /* width of the outline, 0 for none */
+  unsigned char shadow_rgba[4];
+  unsigned char outline_rgba[4];
+};
+
+struct xosd_atlas_stats
+{
+  unsigned long faces;
+  unsigned long glyphs;
+  unsigned long pages;
+  unsigned long bytes;          /* pages, glyph entries and hash table */
+  unsigned long hits;
+  unsigned long misses;
+};
+
+/* The atlas lives while it has users; the last one frees it. */
+void _xosd_atlas_ref(void);
+void _xosd_atlas_unref(void);
+void _xosd_atlas_stats(struct xosd_atlas_stats *stats);
+
+/* Open a font file, or find it opened already. NULL with xosd_error set
+ * on failure, also when libxosd was built without FreeType. */
+struct xosd_face *_xosd_face_open(const char *path);
+/* Pixels above and below the baseline of a face at a pixel size. */
+void _xosd_face_metrics(struct xosd_face *face, int size, int *ascent,
+                        int *descent);
+
+int _xosd_text_width(struct xosd_face *face, int size, const char *string);
+/* Prefix widths as the text_extents() of a backend. */
+int _xosd_text_extents(struct xosd_face *face, int size, const char *string,
+                       struct xosd_extent *ext);
+/* Draw a line of text with the pen at x on the baseline y, and its shadow
+ * and outline if layers is not NULL. */
+void _xosd_draw_line(struct xosd_canvas *canvas, struct xosd_face *face,
+                     int size, const char *string, int x, int y,
+                     const unsigned char rgba[4],
+                     const struct xosd_layers *layers);
+
+/* Blending kernels. */
+struct xosd_blend
+{
+  const char *name;
+  /* dst = (rgba * c + dst * (255 - c)) / 255 for n pixels */
+  void (*span) (unsigned char *dst, const unsigned char *coverage, int n,
+                const unsigned char rgba[4]);
+  /* dst = max(dst, src) for n bytes */
+  void (*maximum) (unsigned char *dst, const unsigned char *src, int n);
+};
+
+/* The fastest kernels this CPU runs, or those named by XOSD_BLEND. */
+const struct xosd_blend *_xosd_blend(void);
+/* Use the named kernels: "scalar", "sse2" or "avx2". -1 if unknown or not
+ * supported by this CPU or build. */
+int _xosd_blend_select(const char *name);
+
+#endif
@@ -0,0 +1,687 @@
+/*
+ * XOSD
+ *
+ * Copyright (c) 2000 Andre Renaud (andre@ignavus.net)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+/* The headless backend: the window is an RGBA image in memory whose alpha
+ * channel is its shape, and showing it copies it onto an RGBA image of the
+ * screen. Text is drawn from the glyph atlas, see glyph.c: by default with
+ * the built-in bitmap font, so neither an X server nor fonts are needed,
+ * or from a font file with FreeType. */
+#include "intern.h"
+#ifdef HAVE_LIBPNG
+#  include <png.h>
+#endif
+
+struct xosd_image
+{
+  int width;                    /* CONST screen */
+  int height;                   /* CONST screen */
+  unsigned char *screen;        /* CONST RGBA of what is shown */
+  struct xosd_canvas window;    /* CACHE (font) RGBA, alpha is the shape */
+  int x, y;                     /* DYN window position on the screen */
+  int visible;                  /* DYN */
+  unsigned char colour[4];      /* DYN of drawing, opaque */
+  struct xosd_face *face;       /* CONF (font) NULL for the built-in font */
+  int size;                     /* CONF (font) in pixels */
+  XRectangle extent;            /* CACHE (font) */
+};
+
+/* Colours. {{{ */
+static const struct
+{
+  const char *name;
+  unsigned char rgb[3];
+} colour_names[] = {
+  {"black", {0, 0, 0}},
+  {"white", {255, 255, 255}},
+  {"red", {255, 0, 0}},
+  {"green", {0, 255, 0}},
+  {"blue", {0, 0, 255}},
+  {"yellow", {255, 255, 0}},
+  {"cyan", {0, 255, 255}},
+  {"magenta", {255, 0, 255}},
+  {"gray", {190, 190, 190}},
+  {"grey", {190, 190, 190}},
+  {"orange", {255, 165, 0}},
+  {"purple", {160, 32, 240}},
+  {"violet", {238, 130, 238}},
+  {"brown", {165, 42, 42}},
+  {"pink", {255, 192, 203}},
+  {"navy", {0, 0, 128}},
+  {"darkgreen", {0, 100, 0}},
+  {"lightblue", {173, 216, 230}},
+};
+
+/* "#rgb" up to "#rrrrggggbbbb", as XParseColor() reads them. */
+static int
+parse_hex(const char *hex, unsigned char rgb[3])
+{
+  int len = strlen(hex), n = len / 3, i;
+
+  if (len == 0 || len % 3 || n > 4 || strspn(hex, "0123456789abcdefABCDEF")
+      != (size_t) len)
+    return -1;
+  for (i = 0; i < 3; i++) {
+    char digits[5];
+    unsigned long v;
+
+    memcpy(digits, hex + i * n, n);
+    digits[n] = '\0';
+    v = strtoul(digits, NULL, 16) << (16 - 4 * n);
+    rgb[i] = v >> 8;
+  }
+  return 0;
+}
+
+static int
+headless_parse_colour(xosd * osd, XColor * col, unsigned long *pixel,
+                      const char *colour)
+{
+  unsigned char rgb[3];
+  size_t i;
+  int found = -1;
+
+  (void) osd;
+  FUNCTION_START(Dfunction);
+  if (colour != NULL && colour[0] == '#')
+    found = parse_hex(colour + 1, rgb);
+  else if (colour != NULL)
+    for (i = 0; i < sizeof(colour_names) / sizeof(colour_names[0]); i++)
+      if (strcasecmp(colour, colour_names[i].name) == 0) {
+        memcpy(rgb, colour_names[i].rgb, 3);
+        found = 0;
+        break;
+      }
+  if (found == -1) {
+    DEBUG(Dtrace, "could not parse colour. defaulting to white");
+    rgb[0] = rgb[1] = rgb[2] = 255;
+  }
+
+  col->red = rgb[0] * 257;
+  col->green = rgb[1] * 257;
+  col->blue = rgb[2] * 257;
+  col->flags = DoRed | DoGreen | DoBlue;
+  col->pixel = *pixel = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+  return found;
+}
+
+static void
+headless_set_colour(xosd * osd, unsigned long pixel)
+{
+  osd->image->colour[0] = pixel >> 16;
+  osd->image->colour[1] = pixel >> 8;
+  osd->image->colour[2] = pixel;
+  osd->image->colour[3] = 255;
+}
+
+/* }}} */
+
+/* Font. {{{ */
+/* A name starting with a slash is a font file, which may be followed by a
+ * colon and the size in pixels, 16 by default:
+ * "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf:32". Of any other name
+ * only the pixel size of an XLFD name is used, to scale the built-in font:
+ * sizes from 24 are rounded to a multiple of 16. */
+static int
+headless_set_font(xosd * osd, const char *font)
+{
+  struct xosd_image *img = osd->image;
+  struct xosd_face *face = NULL;
+  int dashes = 0, size = 0, ascent, descent;
+
+  if (font[0] == '/') {
+    const char *colon = strrchr(font, ':');
+    char *path = strdup(font);
+
+    if (path == NULL) {
+      xosd_error = "Out of memory";
+      return -1;
+    }
+    size = 16;
+    if (colon != NULL && colon[1] != '\0' &&
+        strspn(colon + 1, "0123456789") == strlen(colon + 1)) {
+      path[colon - font] = '\0';
+      size = atoi(colon + 1);
+    }
+    face = _xosd_face_open(path);
+    free(path);
+    if (face == NULL || size < 1 || size > 1024) {
+      if (face != NULL)
+        xosd_error = "Font size out of range";
+      return -1;
+    }
+  } else {
+    for (; *font && dashes < 7; font++)
+      if (*font == '-')
+        dashes++;
+    if (dashes == 7)
+      size = atoi(font);
+    size = (size >= 24) ? (size + 8) / 16 * 16 : 16;
+  }
+  img->face = face;
+  img->size = size;
+
+  _xosd_face_metrics(face, size, &ascent, &descent);
+  img->extent.x = 0;
+  img->extent.y = -ascent;
+  img->extent.width = _xosd_text_width(face, size, "M");
+  img->extent.height = ascent + descent;
+  return 0;
+}
+
+static XRectangle *
+headless_font_extent(xosd * osd)
+{
+  return &osd->image->extent;
+}
+
+static int
+headless_text_width(xosd * osd, const char *string)
+{
+  return _xosd_text_width(osd->image->face, osd->image->size, string);
+}
+
+static int
+headless_text_extents(xosd * osd, const char *string, struct xosd_extent *ext)
+{
+  return _xosd_text_extents(osd->image->face, osd->image->size, string, ext);
+}
+
+/* }}} */
+
+/* Drawing. {{{ */
+/* Intersect x0,y0 x1,y1 (exclusive) with a rectangle. */
+static void
+intersect(int *x0, int *y0, int *x1, int *y1, int x, int y, int w, int h)
+{
+  if (*x0 < x)
+    *x0 = x;
+  if (*y0 < y)
+    *y0 = y;
+  if (*x1 > x + w)
+    *x1 = x + w;
+  if (*y1 > y + h)
+    *y1 = y + h;
+}
+
+/* Set the pixels of a rectangle of the window to the drawing colour. */
+static void
+paint(struct xosd_image *img, int x0, int y0, int x1, int y1)
+{
+  int x, y;
+
+  intersect(&x0, &y0, &x1, &y1, img->window.clip_x0, img->window.clip_y0,
+            img->window.clip_x1 - img->window.clip_x0,
+            img->window.clip_y1 - img->window.clip_y0);
+  intersect(&x0, &y0, &x1, &y1, 0, 0, img->window.width, img->window.height);
+  for (y = y0; y < y1; y++) {
+    unsigned char *p = img->window.rgba + ((size_t) y * img->window.width +
+                                           x0) * 4;
+    for (x = x0; x < x1; x++, p += 4)
+      memcpy(p, img->colour, 4);
+  }
+}
+
+static void
+headless_set_clip(xosd * osd, XRectangle * clip)
+{
+  struct xosd_image *img = osd->image;
+
+  if (clip != NULL) {
+    img->window.clip_x0 = clip->x;
+    img->window.clip_y0 = clip->y;
+    img->window.clip_x1 = clip->x + clip->width;
+    img->window.clip_y1 = clip->y + clip->height;
+  } else {
+    img->window.clip_x0 = img->window.clip_y0 = 0;
+    img->window.clip_x1 = img->window.width;
+    img->window.clip_y1 = img->window.height;
+  }
+}
+
+static void
+headless_clear(xosd * osd, XRectangle * area)
+{
+  struct xosd_image *img = osd->image;
+  int x0 = area->x, y0 = area->y, x1 = x0 + area->width;
+  int y1 = y0 + area->height, y;
+
+  intersect(&x0, &y0, &x1, &y1, 0, 0, img->window.width, img->window.height);
+  for (y = y0; y < y1 && x0 < x1; y++)
+    memset(img->window.rgba + ((size_t) y * img->window.width + x0) * 4, 0,
+           (x1 - x0) * 4);
+  osd->stats.fill_rectangles++;
+}
+
+static void
+headless_fill_rects(xosd * osd, XRectangle * rects, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    paint(osd->image, rects[i].x, rects[i].y, rects[i].x + rects[i].width,
+          rects[i].y + rects[i].height);
+  osd->stats.fill_rectangles += n;
+}
+
+static void
+headless_draw_text(xosd * osd, const char *string, int x, int y)
+{
+  struct xosd_image *img = osd->image;
+
+  _xosd_draw_line(&img->window, img->face, img->size, string, x, y,
+                  img->colour, NULL);
+  osd->stats.draw_strings++;
+}
+
+static void
+rgba(unsigned char rgba[4], unsigned long pixel)
+{
+  rgba[0] = pixel >> 16;
+  rgba[1] = pixel >> 8;
+  rgba[2] = pixel;
+  rgba[3] = 255;
+}
+
+/* Shadow, outline and text are blended from one coverage of the line,
+ * instead of drawing the text once for every pixel of outline. */
+static void
+headless_draw_line(xosd * osd, const char *string, int x, int y,
+                   int shadow_x, int shadow_y)
+{
+  struct xosd_image *img = osd->image;
+  struct xosd_layers layers;
+  unsigned char colour[4];
+
+  layers.shadow = osd->shadow_offset != 0 && (shadow_x || shadow_y);
+  layers.shadow_x = shadow_x;
+  layers.shadow_y = shadow_y;
+  layers.outline = osd->outline_offset;
+  rgba(layers.shadow_rgba, osd->shadow_pixel);
+  rgba(layers.outline_rgba, osd->outline_pixel);
+  rgba(colour, osd->pixel);
+  _xosd_draw_line(&img->window, img->face, img->size, string, x, y, colour,
+                  &layers);
+  osd->stats.draw_strings++;
+}
+
+/* A strip is a canvas like the window, drawn into by swapping it in. */
+struct headless_strip
+{
+  struct xosd_canvas canvas;
+  struct xosd_canvas window;    /* while drawing into the strip */
+};
+
+static void *
+headless_strip_begin(xosd * osd, int width)
+{
+  struct xosd_image *img = osd->image;
+  struct headless_strip *s;
+
+  if ((s = calloc(1, sizeof(struct headless_strip))) == NULL ||
+      (s->canvas.rgba = calloc((size_t) width * osd->line_height, 4)) ==
+      NULL) {
+    free(s);
+    return NULL;
+  }
+  s->canvas.width = width;
+  s->canvas.height = osd->line_height;
+  /* The scratch of the window serves the strip too. */
+  s->canvas.coverage = img->window.coverage;
+  s->canvas.coverage_size = img->window.coverage_size;
+  s->window = img->window;
+  img->window = s->canvas;
+  headless_set_clip(osd, NULL);
+  return s;
+}
+
+static void
+headless_strip_end(xosd * osd, void *strip)
+{
+  struct xosd_image *img = osd->image;
+  struct headless_strip *s = strip;
+
+  s->window.coverage = img->window.coverage;
+  s->window.coverage_size = img->window.coverage_size;
+  img->window.coverage = NULL;
+  img->window.coverage_size = 0;
+  s->canvas = img->window;
+  img->window = s->window;
+}
+
+static void
+headless_strip_copy(xosd * osd, void *strip, int src_x, XRectangle * dst)
+{
+  struct xosd_image *img = osd->image;
+  struct headless_strip *s = strip;
+  int x0 = dst->x, y0 = dst->y, x1 = x0 + dst->width;
+  int y1 = y0 + dst->height, y;
+
+  intersect(&x0, &y0, &x1, &y1, dst->x, dst->y, s->canvas.width - src_x,
+            s->canvas.height);
+  intersect(&x0, &y0, &x1, &y1, 0, 0, img->window.width, img->window.height);
+  for (y = y0; y < y1 && x0 < x1; y++)
+    memcpy(img->window.rgba + ((size_t) y * img->window.width + x0) * 4,
+           s->canvas.rgba + ((size_t) (y - dst->y) * s->canvas.width +
+                             src_x + x0 - dst->x) * 4, (x1 - x0) * 4);
+}
+
+static void
+headless_strip_free(xosd * osd, void *strip)
+{
+  struct headless_strip *s = strip;
+
+  (void) osd;
+  free(s->canvas.rgba);
+  free(s);
+}
+
+/* }}} */
+
+/* Showing. {{{ */
+static void
+headless_resize(xosd * osd)
+{
+  struct xosd_image *img = osd->image;
+  unsigned char *window;
+
+  /* Out of memory keeps the old size, drawing is clipped to it. */
+  window = calloc((size_t) osd->screen_width * osd->height, 4);
+  if (window == NULL)
+    return;
+  free(img->window.rgba);
+  img->window.rgba = window;
+  img->window.width = osd->screen_width;
+  img->window.height = osd->height;
+  headless_set_clip(osd, NULL);
+}
+
+static void
+headless_move(xosd * osd, int x, int y)
+{
+  osd->image->x = x;
+  osd->image->y = y;
+}
+
+static void
+headless_show(xosd * osd, int visible)
+{
+  struct xosd_image *img = osd->image;
+
+  img->visible = visible;
+  if (!visible)
+    memset(img->screen, 0, (size_t) img->width * img->height * 4);
+}
+
+/* Copy an area of the window onto the screen. The whole window is only
+ * presented after it moved or changed size, so the screen is cleared. */
+static void
+headless_present(xosd * osd, XRectangle * area)
+{
+  struct xosd_image *img = osd->image;
+  int x0 = area->x, y0 = area->y, x1 = x0 + area->width;
+  int y1 = y0 + area->height, y;
+
+  if (!img->visible)
+    return;
+  if (x0 <= 0 && y0 <= 0 && x1 >= img->window.width &&
+      y1 >= img->window.height)
+    memset(img->screen, 0, (size_t) img->width * img->height * 4);
+
+  intersect(&x0, &y0, &x1, &y1, 0, 0, img->window.width, img->window.height);
+  intersect(&x0, &y0, &x1, &y1, -img->x, -img->y, img->width, img->height);
+  for (y = y0; y < y1 && x0 < x1; y++)
+    memcpy(img->screen + ((size_t) (y + img->y) * img->width + x0 +
+                          img->x) * 4,
+           img->window.rgba + ((size_t) y * img->window.width + x0) * 4,
+           (x1 - x0) * 4);
+}
+
+static void
+headless_shape(xosd * osd, XRectangle * area)
+{
+  /* The alpha channel of the window is its shape. */
+  (void) osd;
+  (void) area;
+}
+
+static void
+headless_flush(xosd * osd)
+{
+  (void) osd;
+}
+
+/* }}} */
+
+/* Setup. {{{ */
+static int
+headless_open(xosd * osd)
+{
+  struct xosd_image *img;
+
+  FUNCTION_START(Dfunction);
+  if ((img = calloc(1, sizeof(struct xosd_image))) == NULL ||
+      (img->screen = calloc((size_t) osd->screen_width * osd->screen_height,
+                            4)) == NULL) {
+    free(img);
+    xosd_error = "Out of memory";
+    return -1;
+  }
+  img->width = osd->screen_width;
+  img->height = osd->screen_height;
+  img->size = 16;
+  osd->image = img;
+  osd->screen_xpos = osd->screen_ypos = 0;
+  osd->nscreens = 1;
+
+  headless_resize(osd);
+  if (img->window.rgba == NULL) {
+    free(img->screen);
+    free(img);
+    osd->image = NULL;
+    xosd_error = "Out of memory";
+    return -1;
+  }
+  _xosd_atlas_ref();
+  return 0;
+}
+
+static void
+headless_close(xosd * osd)
+{
+  FUNCTION_START(Dfunction);
+  _xosd_atlas_unref();
+  free(osd->image->window.rgba);
+  free(osd->image->window.coverage);
+  free(osd->image->screen);
+  free(osd->image);
+  osd->image = NULL;
+}
+
+/* A clone draws into a screen image of its own, with the font of its
+ * source; the glyphs are shared through the atlas anyway. */
+static int
+headless_clone(xosd * osd, xosd * source)
+{
+  if (headless_open(osd) == -1)
+    return -1;
+  osd->image->face = source->image->face;
+  osd->image->size = source->image->size;
+  osd->image->extent = source->image->extent;
+  return 0;
+}
+
+static int
+headless_monitor(xosd * osd, int monitor)
+{
+  osd->screen_width = osd->image->width;
+  osd->screen_height = osd->image->height;
+  osd->screen_xpos = osd->screen_ypos = 0;
+  osd->monitor = monitor;
+  if (monitor != 0) {
+    xosd_error = "Headless screen has only one monitor";
+    return -1;
+  }
+  return 0;
+}
+
+static int
+headless_fd(xosd * osd)
+{
+  (void) osd;
+  return -1;
+}
+
+static int
+headless_pending(xosd * osd)
+{
+  (void) osd;
+  return 0;
+}
+
+static void
+headless_event(xosd * osd)
+{
+  (void) osd;
+}
+
+/* }}} */
+
+/* Exporting images. {{{ */
+int
+_xosd_headless_image(xosd * osd, unsigned char **rgba, int *width,
+                     int *height)
+{
+  struct xosd_image *img = osd->image;
+  size_t size = (size_t) img->width * img->height * 4;
+
+  if ((*rgba = malloc(size)) == NULL) {
+    xosd_error = "Out of memory";
+    return -1;
+  }
+  memcpy(*rgba, img->screen, size);
+  if (width)
+    *width = img->width;
+  if (height)
+    *height = img->height;
+  return 0;
+}
+
+/* Binary PPM without alpha, the display over black. */
+int
+_xosd_write_ppm(const char *filename, const unsigned char *rgba, int width,
+                int height)
+{
+  FILE *f;
+  size_t i, n = (size_t) width * height;
+
+  if ((f = fopen(filename, "wb")) == NULL) {
+    xosd_error = "Cannot open image file";
+    return -1;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", width, height);
+  for (i = 0; i < n; i++, rgba += 4) {
+    putc(rgba[0] * rgba[3] / 255, f);
+    putc(rgba[1] * rgba[3] / 255, f);
+    putc(rgba[2] * rgba[3] / 255, f);
+  }
+  if (fclose(f) != 0) {
+    xosd_error = "Cannot write image file";
+    return -1;
+  }
+  return 0;
+}
+
+int
+_xosd_write_png(const char *filename, const unsigned char *rgba, int width,
+                int height)
+{
+#ifdef HAVE_LIBPNG
+  png_structp png;
+  png_infop info;
+  FILE *f;
+  int y;
+
+  if ((f = fopen(filename, "wb")) == NULL) {
+    xosd_error = "Cannot open image file";
+    return -1;
+  }
+  png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  info = png ? png_create_info_struct(png) : NULL;
+  if (info == NULL || setjmp(png_jmpbuf(png))) {
+    png_destroy_write_struct(&png, &info);
+    fclose(f);
+    xosd_error = "Cannot write image file";
+    return -1;
+  }
+  png_init_io(png, f);
+  png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, info);
+  for (y = 0; y < height; y++)
+    png_write_row(png, (png_bytep) rgba + (size_t) y * width * 4);
+  png_write_end(png, NULL);
+  png_destroy_write_struct(&png, &info);
+  if (fclose(f) != 0) {
+    xosd_error = "Cannot write image file";
+    return -1;
+  }
+  return 0;
+#else
+  xosd_error = "libxosd was built without libpng";
+  return -1;
+#endif
+}
+
+/* }}} */
+
+const struct xosd_backend _xosd_backend_headless = {
+  .name = "headless",
+  .open = headless_open,
+  .clone = headless_clone,
+  .close = headless_close,
+  .fd = headless_fd,
+  .pending = headless_pending,
+  .event = headless_event,
+  .monitor = headless_monitor,
+  .set_font = headless_set_font,
+  .font_extent = headless_font_extent,
+  .text_width = headless_text_width,
+  .text_extents = headless_text_extents,
+  .parse_colour = headless_parse_colour,
+  .resize = headless_resize,
+  .move = headless_move,
+  .set_colour = headless_set_colour,
+  .set_clip = headless_set_clip,
+  .clear = headless_clear,
+  .fill_rects = headless_fill_rects,
+  .draw_text = headless_draw_text,
+  .draw_line = headless_draw_line,
+  .strip_begin = headless_strip_begin,
+  .strip_end = headless_strip_end,
+  .strip_copy = headless_strip_copy,
+  .strip_free = headless_strip_free,
+  .shape = headless_shape,
+  .show = headless_show,
+  .present = headless_present,
+  .flush = headless_flush,
+};
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
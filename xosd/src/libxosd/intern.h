@@ -2,7 +2,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <sys/time.h>
 #include <time.h>
@@ -17,6 +19,7 @@
 	((tvp)->tv_sec = (tvp)->tv_usec = 0)
 #endif /* }}} */
 #include <sys/select.h>
+#include <poll.h>
 
 #include <assert.h>
 #include <pthread.h>
@@ -29,9 +32,116 @@
 #ifdef HAVE_XINERAMA
 #  include <X11/extensions/Xinerama.h>
 #endif
+#ifdef HAVE_XRANDR
+#  include <X11/extensions/Xrandr.h>
+#endif
+#ifdef HAVE_XCB
+#  include <X11/Xlib-xcb.h>
+#endif
 
 #include "xosd.h"
 
+/* Runtime tracing, see trace.c. {{{ */
+extern int _xosd_trace_enabled;
+void _xosd_trace_init(void);
+void _xosd_trace(const char *name, char phase);
+void _xosd_trace_thread(const char *name);
+#define TRACE_BEGIN(name) \
+  do { if (_xosd_trace_enabled) _xosd_trace(name, 'B'); } while (0)
+#define TRACE_END(name) \
+  do { if (_xosd_trace_enabled) _xosd_trace(name, 'E'); } while (0)
+#define TRACE_INSTANT(name) \
+  do { if (_xosd_trace_enabled) _xosd_trace(name, 'i'); } while (0)
+#define TRACE_THREAD(name) \
+  do { if (_xosd_trace_enabled) _xosd_trace_thread(name); } while (0)
+/* }}} */
+
+/* Call recording, see record.c. {{{ */
+#include "record.h"
+extern FILE *_xosd_record_file;
+void _xosd_record_init(void);
+void _xosd_record_create(xosd * osd, int op, int value);
+void _xosd_record(xosd * osd, int op, int arg, int value, const char *string);
+#define RECORD(osd, op, arg, value, string) \
+  do { if (_xosd_record_file && (osd) != NULL) \
+         _xosd_record(osd, op, arg, value, string); } while (0)
+/* }}} */
+
+/* Where a character of a string starts and the width of the string up to
+ * it, see text_extents() of the backends. */
+struct xosd_extent
+{
+  int offset;                   /* bytes */
+  int x;                        /* pixels */
+};
+
+#include "glyph.h"
+
+/* Render backends, see x11.c and headless.c. {{{
+ * The drawing code draws into an offscreen image of the window and a mask
+ * of the pixels it touched, which becomes the shape of the window. All
+ * functions are called holding osd->ctx->mutex, once the event thread runs
+ * only by it. Coordinates are relative to the window. */
+struct xosd_backend
+{
+  const char *name;
+  int (*open) (xosd * osd);     /* -1 with xosd_error set on failure */
+  /* Open osd sharing what it can with source, which it copies. */
+  int (*clone) (xosd * osd, xosd * source);
+  void (*close) (xosd * osd);
+  int (*fd) (xosd * osd);       /* to wait on for events, -1 for none */
+  int (*pending) (xosd * osd);  /* events to handle without blocking */
+  void (*event) (xosd * osd);   /* handle them, for any osd->next */
+  int (*monitor) (xosd * osd, int monitor);     /* screen geometry */
+  /* Optional: windows on the other monitors as osd->mirror says, NULL if
+   * there is only one monitor. */
+  int (*mirror) (xosd * osd);
+  int (*set_font) (xosd * osd, const char *font);
+  XRectangle *(*font_extent) (xosd * osd);
+  int (*text_width) (xosd * osd, const char *string);
+  /* Offsets and widths of every prefix of string which ends on a character
+   * boundary, the whole string last. ext has room for strlen(string) + 1.
+   * Returns the number of characters. */
+  int (*text_extents) (xosd * osd, const char *string,
+                       struct xosd_extent * ext);
+  int (*parse_colour) (xosd * osd, XColor * col, unsigned long *pixel,
+                       const char *colour);
+  void (*resize) (xosd * osd);  /* to screen_width x height */
+  void (*move) (xosd * osd, int x, int y);
+  void (*set_colour) (xosd * osd, unsigned long pixel);
+  void (*set_clip) (xosd * osd, XRectangle * clip);     /* NULL=none */
+  void (*clear) (xosd * osd, XRectangle * area);        /* mask only */
+  void (*fill_rects) (xosd * osd, XRectangle * rects, int n);
+  void (*draw_text) (xosd * osd, const char *string, int x, int y);
+  /* Optional: the shadow at x + shadow_x, y + shadow_y, outline and text
+   * in the colours of osd, NULL to draw them with draw_text(). */
+  void (*draw_line) (xosd * osd, const char *string, int x, int y,
+                     int shadow_x, int shadow_y);
+  /* An offscreen strip of width x line_height pixels with a shape of its
+   * own, see draw_ticker(). Drawing goes into the strip, cleared, between
+   * strip_begin() and strip_end(). strip_begin() returns NULL when out of
+   * memory. strip_copy() puts its columns from src_x on at dst. */
+  void *(*strip_begin) (xosd * osd, int width);
+  void (*strip_end) (xosd * osd, void *strip);
+  void (*strip_copy) (xosd * osd, void *strip, int src_x, XRectangle * dst);
+  void (*strip_free) (xosd * osd, void *strip);
+  void (*shape) (xosd * osd, XRectangle * area);        /* NULL=all */
+  void (*show) (xosd * osd, int visible);
+  void (*present) (xosd * osd, XRectangle * area);
+  void (*flush) (xosd * osd);
+};
+extern const struct xosd_backend _xosd_backend_x11;
+extern const struct xosd_backend _xosd_backend_headless;
+
+/* Copy the screen of a headless object, see xosd_get_image(). */
+int _xosd_headless_image(xosd * osd, unsigned char **rgba, int *width,
+                         int *height);
+int _xosd_write_ppm(const char *filename, const unsigned char *rgba,
+                    int width, int height);
+int _xosd_write_png(const char *filename, const unsigned char *rgba,
+                    int width, int height);
+/* }}} */
+
 /* gcc -O2 optimizes debugging away if Dnone is chosen. {{{ */
 static const enum DEBUG_LEVEL {
   Dnone = 0,          /* Nothing */
@@ -63,35 +173,157 @@ static const enum DEBUG_LEVEL {
   } while (0)
 /* }}} */
 
-enum LINE { LINE_blank, LINE_text, LINE_percentage, LINE_slider };
+/* Line storage of an object, see arena.c. {{{ */
+#define ARENA_MAX 2048          /* largest buffer cut from a chunk */
+#define ARENA_CLASSES 6         /* buffer sizes from 64 to ARENA_MAX */
+union xosd_chunk;
+struct xosd_arena
+{
+  pthread_mutex_t mutex;        /* CONST serialize the rest */
+  void *(*alloc) (size_t size, void *data);     /* CONST of xosd_set_allocator() */
+  void (*release) (void *ptr, void *data);      /* CONST */
+  void *data;                   /* CONST */
+  union xosd_chunk *chunks;     /* DYN all chunks, the newest first */
+  char *next;                   /* DYN unused rest of the newest chunk */
+  size_t left;                  /* DYN bytes at next */
+  void *free[ARENA_CLASSES];    /* DYN released buffers by size */
+  unsigned long allocations;    /* DYN calls of alloc */
+};
+
+void _xosd_arena_init(struct xosd_arena *arena);
+void _xosd_arena_destroy(struct xosd_arena *arena);
+void *_xosd_arena_get(struct xosd_arena *arena, size_t * size);
+void _xosd_arena_put(struct xosd_arena *arena, void *p, size_t size);
+/* }}} */
+
+enum LINE { LINE_blank, LINE_text, LINE_percentage, LINE_slider,
+  LINE_ticker };
+#define LINE_HAS_TEXT(type) ((type) == LINE_text || (type) == LINE_ticker)
+/* Texts shorter than XOSD_LINE_SMALL are kept in the line itself. Longer
+ * ones are in a buffer of the arena, which belongs to one line and is
+ * reused while the texts fit. With a layout, a text wider than its line
+ * gets the extents of its characters measured into another such buffer,
+ * fit, followed by the cut text which is shown instead, see _fit_text().
+ * A ticker keeps its text the same way and is drawn once into a strip of
+ * the backend, which only lines of osd->lines have. */
+#define XOSD_LINE_SMALL 32
 union xosd_line
 {
   enum LINE type;
   struct xosd_text {
     enum LINE type;
-    int width;
-    char *string;
+    int width;                  /* CACHE (font) of what is shown, -1 if unknown */
+    size_t size;                /* of buf, 0=the text is in small */
+    char *buf;
+    char small[XOSD_LINE_SMALL];
+    int space;                  /* CACHE (layout) pixels it was fitted into */
+    int nchars;                 /* CACHE (font) characters in fit, -1=none */
+    int cut;                    /* CACHE (layout) the shown text is in fit */
+    size_t fit_size;            /* of fit, 0=none */
+    struct xosd_extent *fit;
+    void *strip;                /* CACHE (font,colours) of a ticker, NULL if none */
+    int pos;                    /* DYN pixels a ticker has moved */
   } text;
   struct xosd_bar {
     enum LINE type;
     int value;
+    int on;                     /* CACHE segments lit when drawn, -1 if never */
+    int nbars;                  /* CACHE number of segments when drawn */
+    int x;                      /* CACHE left edge when drawn */
   } bar;
 };
 
-struct xosd
+#define TEXT_STRING(t) ((t)->size ? (t)->buf : (t)->small)
+#define TEXT_SHOWN(t) ((t)->cut ? (char *) &(t)->fit[(t)->nchars + 1] \
+                       : TEXT_STRING(t))
+
+/* An update which arrived before the frame interval elapsed. */
+struct xosd_pending
+{
+  int set;
+  union xosd_line line;
+};
+
+/* A message of xosd_post(), waiting in osd->queue or shown. */
+struct xosd_message
+{
+  int priority;                 /* xosd_priority */
+  unsigned long seq;            /* order of posting, within a priority */
+  char *key;                    /* coalesces with the same key, NULL=by content */
+  int nlines;
+  union xosd_line *lines;       /* from line 0, texts in the arena */
+  size_t size;                  /* of the arena buffer of lines and key */
+};
+
+#define XOSD_QUEUE_MAX 32
+#define XOSD_EVENTS_MAX 16
+
+/* What an object shares with its clones, see xosd_clone(). One event
+ * thread serves them all and one mutex guards them and their X11
+ * connection, as it guarded a single object before. */
+struct xosd_context
 {
   pthread_t event_thread;       /* CONST handles X events */
 
-  pthread_mutex_t mutex;        /* CONST serialize X11 and structure */
+  pthread_mutex_t mutex;        /* CONST serialize X11 and structures */
   pthread_cond_t cond_wait;     /* CONST signal X11 done */
   int pipefd[2];                /* CONST signal X11 needed */
+  int kickfd[2];                /* CONST non-blocking, signal messages posted */
+  int threadless;               /* CONST no event_thread, see xosd_dispatch() */
+
+  xosd *objects;                /* DYN served, linked by osd->next */
+  int done;                     /* DYN the last object was destroyed */
+};
+
+struct xosd
+{
+  struct xosd_context *ctx;     /* CONST shared with clones */
+  xosd *next;                   /* DYN next object of ctx */
 
   pthread_mutex_t mutex_sync;   /* CONST mutual exclusion event notify */
   pthread_cond_t cond_sync;     /* CONST signal events */
 
+  pthread_mutex_t mutex_pending;/* CONST serialize coalesced lines */
+  struct xosd_pending *pending; /* DYN latest value per line, not yet drawn */
+  int npending;                 /* DYN number of set pending lines */
+  int frame_interval;           /* CONF minimum usec between frames, 0=off */
+  struct timeval last_frame;    /* DYN when lines were last drawn */
+  unsigned long dropped;        /* DYN coalesced updates never drawn */
+  struct timeval display_time;  /* DYN oldest unflushed xosd_display(), if timing */
+
+  pthread_mutex_t mutex_queue;  /* CONST serialize posted messages */
+  struct xosd_message queue[XOSD_QUEUE_MAX];    /* DYN by priority, then seq */
+  int nqueued;                  /* DYN messages in queue */
+  unsigned long seq;            /* DYN messages posted */
+  int min_time;                 /* CONF msec a message is shown at least */
+  struct xosd_message shown;    /* DYN message on screen, nlines=0 if none */
+  struct timeval shown_at;      /* DYN when it was put there */
+  struct xosd_arena arena;      /* CONST texts of lines, pending lines and messages */
+
+  xosd_stats stats;             /* DYN counters, see xosd_get_stats() */
+  int record_id;                /* CONST number in XOSD_RECORD, 0=not recorded */
+
+  const struct xosd_backend *backend;   /* CONST draws and shows */
+  struct xosd_image *image;     /* CONST headless backend, see headless.c */
+  unsigned long passes;         /* DYN event loop passes, under mutex_sync */
+  int eventfd[2];               /* CONST once set, see xosd_get_event_fd(), -1=none */
+  xosd_event events[XOSD_EVENTS_MAX];   /* DYN not yet read, under mutex_sync */
+  int event_head;               /* DYN oldest of events */
+  int nevents;                  /* DYN in events, the pipe is readable if any */
+  int timed_out;                /* DYN UPD_hide was set by the timeout */
+  int show_wait;                /* CONF xosd_show() waits for the map */
+
   Display *display;             /* CONST x11 */
+#ifdef HAVE_XCB
+  struct xosd_xcb *xcb;         /* CONST pipelined queries, NULL=Xlib only */
+#endif
   int screen;                   /* CONST x11 */
   int nscreens;                 /* Number of back-end screens on the X11 connection */
+  int monitor;                  /* CONF chosen by xosd_monitor(), from 0 */
+  struct xosd_conn *conn;       /* CONST x11 shared with clones, see x11.c */
+  int mirror;                   /* CONF shown on every monitor */
+  struct xosd_mirror *mirrors;  /* CACHE (mirror,monitor) x11 more windows */
+  int nmirrors;                 /* CACHE (mirror,monitor) */
   Window window;                /* CONST x11 */
   unsigned int depth;           /* CONST x11 */
   Pixmap mask_bitmap;           /* CACHE (font,offset) XShape mask */
@@ -105,9 +337,10 @@ struct xosd
   GC mask_gc;                   /* CONST x11 white on black to set XShape mask */
   GC mask_gc_back;              /* CONST x11 black on white to clear XShape mask */
 
-  int screen_width;             /* CONST x11 */
-  int screen_height;            /* CONST x11 */
-  int screen_xpos;              /* CONST x11 */
+  int screen_width;             /* CACHE (monitor) */
+  int screen_height;            /* CACHE (monitor) */
+  int screen_xpos;              /* CACHE (monitor) */
+  int screen_ypos;              /* CACHE (monitor) */
   int height;                   /* CACHE (font) */
   int line_height;              /* CACHE (font) */
   xosd_pos pos;                 /* CONF */
@@ -122,9 +355,12 @@ struct xosd
   XColor outline_colour;        /* CONF */
   unsigned long outline_pixel;  /* CACHE (outline_colour) */
   int bar_length;               /* CONF */
+  xosd_layout layout;           /* CONF of long text lines */
+  int ellipsis_width;           /* CACHE (font) of ELLIPSIS, -1 if unknown */
+  int ticker_speed;             /* CONF pixels per second */
+  struct timeval ticker_last;   /* DYN tickers moved up to, 0=not moving */
 
-  int generation;               /* DYN count of map/unmap */
-  int done;                     /* DYN */
+  int generation;               /* DYN count of map/unmap, also under mutex_sync */
   enum {
     UPD_none = 0,       /* Nothing changed */
     UPD_hide = (1<<0),  /* Force hiding */
@@ -134,9 +370,13 @@ struct xosd
     UPD_lines = (1<<4), /* Redraw content */
     UPD_mask = (1<<5),  /* Update mask */
     UPD_size = (1<<6),  /* Change font and window size */
+    UPD_bars = (1<<7),  /* Repaint flipped bar segments only */
+    UPD_strips = (1<<8), /* Render tickers again */
+    UPD_ticker = (1<<9), /* Move tickers only */
     UPD_content = UPD_mask | UPD_lines,
-    UPD_font = UPD_size | UPD_mask | UPD_lines | UPD_pos
+    UPD_font = UPD_size | UPD_mask | UPD_lines | UPD_pos | UPD_strips
   } update;                     /* DYN */
+  XRectangle damage;            /* DYN area repainted by UPD_bars, UPD_ticker */
 
   unsigned long pixel;          /* CACHE (pixel) */
   XColor colour;                /* CONF */
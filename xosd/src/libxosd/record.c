@@ -0,0 +1,127 @@
+/*
+ * XOSD
+ * 
+ * Copyright (c) 2000 Andre Renaud (andre@ignavus.net)
+ * 
+ * This program is free software; you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program; if not, write to the Free Software Foundation, Inc., 
+ * 675 Mass Ave, Cambridge, MA 02139, USA. 
+ */
+#include "intern.h"
+
+/* Call recording.
+ * Set XOSD_RECORD=FILE in the environment and every public call changing
+ * an xosd object is appended to FILE with the time since the previous
+ * call, see record.h for the format. xosd_replay plays such a file back
+ * against fresh objects, which turns a call pattern seen in the field into
+ * a repeatable benchmark.
+ *
+ * Settings are recorded before their arguments are checked, so failing
+ * ones are replayed as well.
+ */
+
+FILE *_xosd_record_file = NULL;
+
+static pthread_once_t record_once = PTHREAD_ONCE_INIT;
+static struct timespec record_last;
+static int record_instances;
+
+static void
+record_init(void)
+{
+  char *file = getenv("XOSD_RECORD");
+  FILE *f;
+
+  if (file == NULL || *file == '\0')
+    return;
+  if ((f = fopen(file, "wb")) == NULL) {
+    fprintf(stderr, "xosd: cannot write record %s\n", file);
+    return;
+  }
+  fwrite(XOSD_RECORD_MAGIC, 1, strlen(XOSD_RECORD_MAGIC), f);
+  clock_gettime(CLOCK_MONOTONIC, &record_last);
+  _xosd_record_file = f;
+}
+
+/* Read XOSD_RECORD, once per process. */
+void
+_xosd_record_init(void)
+{
+  pthread_once(&record_once, record_init);
+}
+
+/* Append one record. The stream lock keeps the times in file order. */
+static void
+record_write(int instance, int op, int arg, int value, const char *string)
+{
+  struct xosd_record r;
+  struct timespec now;
+  long long us;
+
+  memset(&r, 0, sizeof(r));
+  r.instance = instance;
+  r.op = op;
+  r.arg = arg;
+  if (string) {
+    size_t len = strlen(string);
+    r.value = len > XOSD_RECORD_MAX_STRING ? XOSD_RECORD_MAX_STRING
+      : (int32_t) len;
+  } else
+    r.value = value;
+
+  flockfile(_xosd_record_file);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  us = (now.tv_sec - record_last.tv_sec) * 1000000LL
+    + (now.tv_nsec - record_last.tv_nsec) / 1000;
+  /* Gaps beyond 71 minutes are shortened. */
+  r.delta = us > UINT32_MAX ? UINT32_MAX : us;
+  /* Advance by whole microseconds only, so rounding does not add up. */
+  record_last.tv_nsec += (us % 1000000) * 1000;
+  record_last.tv_sec += us / 1000000 + record_last.tv_nsec / 1000000000;
+  record_last.tv_nsec %= 1000000000;
+
+  fwrite(&r, sizeof(r), 1, _xosd_record_file);
+  if (string)
+    fwrite(string, 1, r.value, _xosd_record_file);
+  if (op == REC_destroy)
+    fflush(_xosd_record_file);
+  funlockfile(_xosd_record_file);
+}
+
+/* Number a new object and record its creation. */
+void
+_xosd_record_create(xosd * osd, int op, int value)
+{
+  int id = __sync_add_and_fetch(&record_instances, 1);
+
+  /* Objects beyond the numbering are not recorded. */
+  if (id > UINT16_MAX)
+    return;
+  osd->record_id = id;
+  record_write(id, op, 0, value, NULL);
+}
+
+/* Record a call on an object, unless it was created before recording. */
+void
+_xosd_record(xosd * osd, int op, int arg, int value, const char *string)
+{
+  if (osd->record_id == 0)
+    return;
+  if ((op == REC_string || op == REC_set_string || op == REC_ticker) &&
+      string == NULL)
+    return;
+  record_write(osd->record_id, op, arg, value, string);
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
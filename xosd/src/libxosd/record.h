@@ -0,0 +1,66 @@
+/* Format of the files written with XOSD_RECORD=FILE and read by xosd_replay.
+ *
+ * The file starts with XOSD_RECORD_MAGIC, followed by one struct
+ * xosd_record per call in host byte order. A string argument follows its
+ * record without a terminator; "value" holds its length then, at most
+ * XOSD_RECORD_MAX_STRING. Longer strings are recorded cut short. */
+#ifndef XOSD_RECORD_H
+#define XOSD_RECORD_H
+
+#include <stdint.h>
+
+#define XOSD_RECORD_MAGIC "XOSDREC1"
+#define XOSD_RECORD_MAX_STRING 65536
+
+struct xosd_record
+{
+  uint32_t delta;               /* microseconds since the previous record */
+  int32_t value;                /* integer argument or string length */
+  uint16_t instance;            /* xosd objects, numbered from 1 */
+  uint16_t arg;                 /* line or property, depending on op */
+  uint8_t op;                   /* enum xosd_record_op */
+  uint8_t reserved[3];
+};
+
+enum xosd_record_op
+{
+  REC_create = 0,               /* value: number of lines */
+  REC_clone,                    /* value: instance cloned */
+  REC_destroy,
+  REC_string,                   /* arg: line; string: text */
+  REC_percentage,               /* arg: line; value: percentage */
+  REC_slider,                   /* arg: line; value: percentage */
+  REC_set_int,                  /* arg: enum xosd_record_property; value */
+  REC_set_string,               /* arg: enum xosd_record_property; string */
+  REC_scroll,                   /* value: lines */
+  REC_show,
+  REC_hide,
+  REC_ticker,                   /* arg: line; string: text */
+  REC_nops
+};
+
+enum xosd_record_property
+{
+  REC_font = 0,                 /* string */
+  REC_colour,                   /* string */
+  REC_shadow_colour,            /* string */
+  REC_outline_colour,           /* string */
+  REC_timeout,
+  REC_pos,
+  REC_align,
+  REC_vertical_offset,
+  REC_horizontal_offset,
+  REC_shadow_offset,
+  REC_shadow_direction,
+  REC_outline_offset,
+  REC_bar_length,
+  REC_monitor,
+  REC_frame_rate,
+  REC_mirror,
+  REC_min_time,
+  REC_layout,
+  REC_ticker_speed,
+  REC_show_wait
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * XOSD
+ * 
+ * Copyright (c) 2000 Andre Renaud (andre@ignavus.net)
+ * 
+ * This program is free software; you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program; if not, write to the Free Software Foundation, Inc., 
+ * 675 Mass Ave, Cambridge, MA 02139, USA. 
+ */
+#include "intern.h"
+
+/* Runtime tracing.
+ * Set XOSD_TRACE=FILE in the environment and every thread using xosd
+ * records begin/end events into a buffer of its own; no lock is taken and
+ * nothing is printed while the program runs. At exit all buffers are
+ * written to FILE in the Chrome trace event format, which chrome://tracing
+ * and ui.perfetto.dev show as a flame chart per thread.
+ *
+ * A buffer holds TRACE_EVENTS events. Once it is full, further events of
+ * that thread are only counted, so the trace shows the start of a run.
+ */
+
+#define TRACE_EVENTS (1 << 16)
+
+struct trace_event
+{
+  const char *name;             /* static string */
+  char phase;                   /* 'B'egin, 'E'nd or 'i'nstant */
+  struct timespec ts;
+};
+
+struct trace_buffer
+{
+  struct trace_buffer *next;    /* CONST list of all buffers */
+  int tid;                      /* CONST trace thread number */
+  const char *name;             /* DYN thread name, if set */
+  volatile unsigned int count;  /* DYN events recorded */
+  unsigned long dropped;        /* DYN events not recorded */
+  struct trace_event events[TRACE_EVENTS];
+};
+
+int _xosd_trace_enabled = 0;
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static char *trace_file;
+static struct trace_buffer *volatile trace_buffers;
+static int trace_threads;
+static __thread struct trace_buffer *trace_buffer;
+
+/* Write all buffers as Chrome trace JSON. {{{ */
+static void
+trace_write(void)
+{
+  struct trace_buffer *b;
+  FILE *f;
+  int pid = getpid(), first = 1;
+  unsigned int i, n;
+
+  if ((f = fopen(trace_file, "w")) == NULL) {
+    fprintf(stderr, "xosd: cannot write trace %s\n", trace_file);
+    return;
+  }
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (b = trace_buffers; b != NULL; b = b->next) {
+    if (b->name) {
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n",
+              pid, b->tid, b->name);
+      first = 0;
+    }
+    n = b->count;
+    __sync_synchronize();       /* events up to count are complete */
+    for (i = 0; i < n; i++) {
+      struct trace_event *e = &b->events[i];
+      fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%ld.%03ld,"
+              "\"pid\":%d,\"tid\":%d%s}", first ? "" : ",\n", e->name,
+              e->phase, e->ts.tv_sec * 1000000L + e->ts.tv_nsec / 1000,
+              e->ts.tv_nsec % 1000, pid, b->tid,
+              e->phase == 'i' ? ",\"s\":\"t\"" : "");
+      first = 0;
+    }
+    if (b->dropped)
+      fprintf(stderr, "xosd: trace buffer of thread %d full, %lu events "
+              "dropped\n", b->tid, b->dropped);
+  }
+  fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+  fclose(f);
+}
+
+/* }}} */
+
+static void
+trace_init(void)
+{
+  char *file = getenv("XOSD_TRACE");
+
+  if (file == NULL || *file == '\0')
+    return;
+  trace_file = strdup(file);
+  if (trace_file != NULL && atexit(trace_write) == 0)
+    _xosd_trace_enabled = 1;
+}
+
+/* Read XOSD_TRACE, once per process. */
+void
+_xosd_trace_init(void)
+{
+  pthread_once(&trace_once, trace_init);
+}
+
+/* The buffer of the calling thread, created on its first event. */
+static struct trace_buffer *
+trace_get_buffer(void)
+{
+  struct trace_buffer *b = trace_buffer;
+
+  if (b == NULL) {
+    if ((b = calloc(1, sizeof(struct trace_buffer))) == NULL)
+      return NULL;
+    b->tid = __sync_add_and_fetch(&trace_threads, 1);
+    do
+      b->next = trace_buffers;
+    while (!__sync_bool_compare_and_swap(&trace_buffers, b->next, b));
+    trace_buffer = b;
+  }
+  return b;
+}
+
+/* Record one event of the calling thread. */
+void
+_xosd_trace(const char *name, char phase)
+{
+  struct trace_buffer *b = trace_get_buffer();
+  struct trace_event *e;
+
+  if (b == NULL)
+    return;
+  if (b->count == TRACE_EVENTS) {
+    b->dropped++;
+    return;
+  }
+  e = &b->events[b->count];
+  e->name = name;
+  e->phase = phase;
+  clock_gettime(CLOCK_MONOTONIC, &e->ts);
+  __sync_synchronize();         /* publish the event before the count */
+  b->count++;
+}
+
+/* Name the calling thread in the trace. */
+void
+_xosd_trace_thread(const char *name)
+{
+  struct trace_buffer *b = trace_get_buffer();
+
+  if (b != NULL)
+    b->name = name;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -0,0 +1,1285 @@
+/*
+ * XOSD
+ * 
+ * Copyright (c) 2000 Andre Renaud (andre@ignavus.net)
+ * 
+ * This program is free software; you can redistribute it and/or modify it 
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along 
+ * with this program; if not, write to the Free Software Foundation, Inc., 
+ * 675 Mass Ave, Cambridge, MA 02139, USA. 
+ */
+/* The X11 backend: an override-redirect window shaped by a 1 bit mask,
+ * drawn with Xlib font sets into a pixmap which is copied to the window. */
+#include "intern.h"
+#include <wchar.h>
+#include <X11/Xlibint.h>        /* output buffer, see x11_flush() */
+
+/* What the objects of a connection share: an object and its clones, see
+ * xosd_clone(). Freed with the last of them. {{{ */
+struct xosd_fontset
+{
+  XFontSet set;
+  char *name;
+  int refs;
+  struct xosd_fontset *next;
+};
+
+struct xosd_conn
+{
+  int refs;
+  unsigned long last_request;   /* NextRequest() after the last flush */
+  struct xosd_fontset *fonts;   /* in use by some object */
+  enum
+  { WM_unknown, WM_other, WM_gnome, WM_netwm } wm;
+  Atom wm_atoms[2];             /* layer, or state and stays on top */
+
+  /* Monitor layout, see "Screen geometry". */
+  XRectangle *monitors;         /* NULL if unknown */
+  int count;
+  int randr_event;              /* RandR event base, -1 if not followed */
+  int randr_monitors;           /* server speaks RandR 1.5 */
+  int xinerama;                 /* server has Xinerama */
+};
+
+static XFontSet font_ref(xosd * osd, XFontSet set);
+static void font_put(xosd * osd, XFontSet set);
+
+/* }}} */
+
+/* Parse textual colour value. {{{ */
+#ifdef HAVE_XCB
+static int colour_is_named(const char *colour);
+static int xcb_parse_colour(xosd * osd, XColor * col, unsigned long *pixel,
+                            const char *colour);
+#endif
+
+static int
+parse_colour(xosd * osd, XColor * col, unsigned long *pixel,
+             const char *colour)
+{
+  Colormap colourmap;
+  int retval = 0;
+
+  FUNCTION_START(Dfunction);
+#ifdef HAVE_XCB
+  if (osd->xcb != NULL && colour_is_named(colour))
+    return xcb_parse_colour(osd, col, pixel, colour);
+#endif
+  DEBUG(Dtrace, "getting colourmap");
+  colourmap = DefaultColormap(osd->display, osd->screen);
+
+  DEBUG(Dtrace, "parsing colour");
+  if (XParseColor(osd->display, colourmap, colour, col)) {
+    DEBUG(Dtrace, "attempting to allocate colour");
+    if (XAllocColor(osd->display, colourmap, col)) {
+      DEBUG(Dtrace, "allocation sucessful");
+      *pixel = col->pixel;
+    } else {
+      DEBUG(Dtrace, "defaulting to white. could not allocate colour");
+      *pixel = WhitePixel(osd->display, osd->screen);
+      retval = -1;
+    }
+  } else {
+    DEBUG(Dtrace, "could not poarse colour. defaulting to white");
+    *pixel = WhitePixel(osd->display, osd->screen);
+    retval = -1;
+  }
+
+  return retval;
+}
+
+/* }}} */
+
+/* Tell window manager to put window topmost. {{{ */
+/*
+ * gnome-compilant 
+ * tested with icewm + WindowMaker 
+ */
+static void
+stay_on_top_gnome(Display * dpy, Window win, Atom gnome_layer)
+{
+  /*
+   * FIXME: check capabilities 
+   */
+  XClientMessageEvent xev;
+
+  memset(&xev, 0, sizeof(xev));
+  xev.type = ClientMessage;
+  xev.window = win;
+  xev.message_type = gnome_layer;
+  xev.format = 32;
+  xev.data.l[0] = 6 /* WIN_LAYER_ONTOP */ ;
+
+  XSendEvent(dpy, DefaultRootWindow(dpy), False, SubstructureNotifyMask,
+             (XEvent *) & xev);
+}
+
+/*
+ * netwm compliant.
+ * tested with kde 
+ */
+static void
+stay_on_top_netwm(Display * dpy, Window win, Atom net_wm_state,
+                  Atom net_wm_top)
+{
+  XEvent e;
+
+  memset(&e, 0, sizeof(e));
+  e.xclient.type = ClientMessage;
+  e.xclient.message_type = net_wm_state;
+  e.xclient.display = dpy;
+  e.xclient.window = win;
+  e.xclient.format = 32;
+  e.xclient.data.l[0] = 1 /* _NET_WM_STATE_ADD */ ;
+  e.xclient.data.l[1] = net_wm_top;
+  e.xclient.data.l[2] = 0l;
+  e.xclient.data.l[3] = 0l;
+  e.xclient.data.l[4] = 0l;
+
+  XSendEvent(dpy, DefaultRootWindow(dpy), False,
+             SubstructureRedirectMask, &e);
+}
+
+/* The first window of a connection finds out what the window manager
+ * understands, the others just use it. */
+static void
+keep_on_top(xosd * osd, Window win)
+{
+  struct xosd_conn *c = osd->conn;
+
+  if (c->wm == WM_gnome)
+    stay_on_top_gnome(osd->display, win, c->wm_atoms[0]);
+  else if (c->wm == WM_netwm)
+    stay_on_top_netwm(osd->display, win, c->wm_atoms[0], c->wm_atoms[1]);
+  XRaiseWindow(osd->display, win);
+}
+
+static void
+stay_on_top(xosd * osd, Window win)
+{
+  Display *dpy = osd->display;
+  struct xosd_conn *c = osd->conn;
+  Atom gnome, net_wm, type;
+  int format;
+  unsigned long nitems, bytesafter;
+  unsigned char *args = NULL;
+  Window root = DefaultRootWindow(dpy);
+
+  FUNCTION_START(Dfunction);
+  if (c->wm != WM_unknown) {
+    keep_on_top(osd, win);
+    return;
+  }
+  /*
+   * build atoms 
+   */
+  gnome = XInternAtom(dpy, "_WIN_SUPPORTING_WM_CHECK", False);
+  net_wm = XInternAtom(dpy, "_NET_SUPPORTED", False);
+
+  c->wm = WM_other;
+  if (Success == XGetWindowProperty
+      (dpy, root, gnome, 0, (65536 / sizeof(long)), False,
+       AnyPropertyType, &type, &format, &nitems, &bytesafter, &args) &&
+      nitems > 0) {
+    c->wm = WM_gnome;
+    c->wm_atoms[0] = XInternAtom(dpy, "_WIN_LAYER", False);
+    XFree(args);
+  } else if (Success == XGetWindowProperty
+             (dpy, root, net_wm, 0, (65536 / sizeof(long)), False,
+              AnyPropertyType, &type, &format, &nitems, &bytesafter, &args)
+             && nitems > 0) {
+    c->wm = WM_netwm;
+    c->wm_atoms[0] = XInternAtom(dpy, "_NET_WM_STATE", False);
+    c->wm_atoms[1] = XInternAtom(dpy, "_NET_WM_STATE_STAYS_ON_TOP", False);
+    XFree(args);
+  }
+  keep_on_top(osd, win);
+}
+
+/* }}} */
+
+#ifdef HAVE_XCB
+/* Pipelined round trips over XCB. {{{
+ * Xlib waits for the reply to every query before it sends the next
+ * request. Through the XCB connection underneath it, xosd_create() sends
+ * its queries for atoms and the default colour right after connecting and
+ * collects the replies only where Xlib would have asked, so they arrive
+ * during the round trips Xlib makes anyway. Both window manager properties
+ * are then asked for at once.
+ *
+ * Only these round trips move to XCB. The requests still go through
+ * _xosd_lock() and the pipe handoff to the event thread stays: drawing
+ * uses Xlib, which is not initialized for threads, and it shares the
+ * connection and its sequence numbers with XCB. A backend on XCB alone
+ * would have to give up font sets. XOSD_XCB=0 in the environment turns
+ * this off.
+ */
+enum
+{ ATOM_gnome, ATOM_net_wm, ATOM_gnome_layer, ATOM_net_wm_state,
+  ATOM_net_wm_top, ATOMS
+};
+static const char *const xcb_atom_names[ATOMS] = {
+  "_WIN_SUPPORTING_WM_CHECK", "_NET_SUPPORTED", "_WIN_LAYER",
+  "_NET_WM_STATE", "_NET_WM_STATE_STAYS_ON_TOP"
+};
+
+struct xosd_xcb
+{
+  xcb_connection_t *c;
+  xcb_intern_atom_cookie_t atoms[ATOMS];
+  int atoms_pending;
+  xcb_alloc_named_color_cookie_t colour;  /* osd_default_colour */
+  int colour_pending;
+};
+
+/* Names are looked up by the server, numeric colours parsed by Xlib. */
+static int
+colour_is_named(const char *colour)
+{
+  return colour != NULL && colour[0] != '#' && strchr(colour, ':') == NULL;
+}
+
+static void
+xcb_start(xosd * osd)
+{
+  struct xosd_xcb *x;
+  const char *env = getenv("XOSD_XCB");
+  Colormap colourmap = DefaultColormap(osd->display, osd->screen);
+  int i;
+
+  FUNCTION_START(Dfunction);
+  if (env != NULL && strcmp(env, "0") == 0)
+    return;
+  if ((x = calloc(1, sizeof(struct xosd_xcb))) == NULL)
+    return;
+  x->c = XGetXCBConnection(osd->display);
+  for (i = 0; i < ATOMS; i++)
+    x->atoms[i] = xcb_intern_atom(x->c, 0, strlen(xcb_atom_names[i]),
+                                  xcb_atom_names[i]);
+  x->atoms_pending = 1;
+  if (colour_is_named(osd_default_colour)) {
+    x->colour = xcb_alloc_named_color(x->c, colourmap,
+                                      strlen(osd_default_colour),
+                                      osd_default_colour);
+    x->colour_pending = 1;
+  }
+  xcb_flush(x->c);
+  osd->xcb = x;
+}
+
+static void
+xcb_stop(xosd * osd)
+{
+  struct xosd_xcb *x = osd->xcb;
+  int i;
+
+  FUNCTION_START(Dfunction);
+  if (x == NULL)
+    return;
+  if (x->atoms_pending)
+    for (i = 0; i < ATOMS; i++)
+      xcb_discard_reply(x->c, x->atoms[i].sequence);
+  if (x->colour_pending)
+    xcb_discard_reply(x->c, x->colour.sequence);
+  free(x);
+  osd->xcb = NULL;
+}
+
+/* One round trip where XParseColor() and XAllocColor() take two. */
+static int
+xcb_parse_colour(xosd * osd, XColor * col, unsigned long *pixel,
+                 const char *colour)
+{
+  struct xosd_xcb *x = osd->xcb;
+  xcb_alloc_named_color_cookie_t cookie;
+  xcb_alloc_named_color_reply_t *reply;
+
+  FUNCTION_START(Dfunction);
+  if (x->colour_pending && strcmp(colour, osd_default_colour) == 0) {
+    cookie = x->colour;
+    x->colour_pending = 0;
+  } else
+    cookie = xcb_alloc_named_color(x->c,
+                                   DefaultColormap(osd->display,
+                                                   osd->screen),
+                                   strlen(colour), colour);
+
+  reply = xcb_alloc_named_color_reply(x->c, cookie, NULL);
+  if (reply == NULL) {
+    DEBUG(Dtrace, "defaulting to white. could not allocate colour");
+    *pixel = WhitePixel(osd->display, osd->screen);
+    return -1;
+  }
+  col->pixel = *pixel = reply->pixel;
+  col->red = reply->visual_red;
+  col->green = reply->visual_green;
+  col->blue = reply->visual_blue;
+  col->flags = DoRed | DoGreen | DoBlue;
+  free(reply);
+  return 0;
+}
+
+static void
+xcb_stay_on_top(xosd * osd)
+{
+  struct xosd_xcb *x = osd->xcb;
+  xcb_window_t root = DefaultRootWindow(osd->display);
+  xcb_get_property_cookie_t gnome, net_wm;
+  xcb_get_property_reply_t *reply;
+  xcb_atom_t atoms[ATOMS];
+  int i;
+
+  FUNCTION_START(Dfunction);
+  for (i = 0; i < ATOMS; i++) {
+    xcb_intern_atom_reply_t *atom =
+      xcb_intern_atom_reply(x->c, x->atoms[i], NULL);
+    atoms[i] = atom ? atom->atom : XCB_ATOM_NONE;
+    free(atom);
+  }
+  x->atoms_pending = 0;
+
+  gnome = xcb_get_property(x->c, 0, root, atoms[ATOM_gnome],
+                           XCB_GET_PROPERTY_TYPE_ANY, 0,
+                           65536 / sizeof(long));
+  net_wm = xcb_get_property(x->c, 0, root, atoms[ATOM_net_wm],
+                            XCB_GET_PROPERTY_TYPE_ANY, 0,
+                            65536 / sizeof(long));
+
+  osd->conn->wm = WM_other;
+  reply = xcb_get_property_reply(x->c, gnome, NULL);
+  if (reply != NULL && reply->value_len > 0) {
+    xcb_discard_reply(x->c, net_wm.sequence);
+    osd->conn->wm = WM_gnome;
+    osd->conn->wm_atoms[0] = atoms[ATOM_gnome_layer];
+  } else {
+    free(reply);
+    reply = xcb_get_property_reply(x->c, net_wm, NULL);
+    if (reply != NULL && reply->value_len > 0) {
+      osd->conn->wm = WM_netwm;
+      osd->conn->wm_atoms[0] = atoms[ATOM_net_wm_state];
+      osd->conn->wm_atoms[1] = atoms[ATOM_net_wm_top];
+    }
+  }
+  free(reply);
+  keep_on_top(osd, osd->window);
+}
+
+/* }}} */
+#endif
+
+/* Screen geometry. {{{
+ * The monitors of the display are queried once when it is opened and again
+ * only when RandR reports that outputs or CRTCs changed, so selecting a
+ * monitor takes no round trip. They come from RandR 1.5 monitors if the
+ * server has them, else from Xinerama; with neither the whole screen is
+ * the only place to go.
+ */
+static void
+layout_query(xosd * osd)
+{
+  struct xosd_conn *l = osd->conn;
+  XRectangle *monitors = NULL;
+  int count = 0;
+
+  FUNCTION_START(Dfunction);
+#ifdef HAVE_XRANDR
+  if (l->randr_monitors) {
+    XRRMonitorInfo *info;
+    int i;
+
+    info = XRRGetMonitors(osd->display, XRootWindow(osd->display, osd->screen),
+                          True, &count);
+    if (info != NULL && count > 0
+        && (monitors = malloc(count * sizeof(XRectangle))) != NULL)
+      for (i = 0; i < count; i++) {
+        monitors[i].x = info[i].x;
+        monitors[i].y = info[i].y;
+        monitors[i].width = info[i].width;
+        monitors[i].height = info[i].height;
+      }
+    if (info != NULL)
+      XRRFreeMonitors(info);
+  }
+#endif
+#ifdef HAVE_XINERAMA
+  if (monitors == NULL && l->xinerama && XineramaIsActive(osd->display)) {
+    XineramaScreenInfo *screeninfo;
+    int i;
+
+    screeninfo = XineramaQueryScreens(osd->display, &count);
+    if (screeninfo != NULL && count > 0
+        && (monitors = malloc(count * sizeof(XRectangle))) != NULL)
+      for (i = 0; i < count; i++) {
+        monitors[i].x = screeninfo[i].x_org;
+        monitors[i].y = screeninfo[i].y_org;
+        monitors[i].width = screeninfo[i].width;
+        monitors[i].height = screeninfo[i].height;
+      }
+    if (screeninfo != NULL)
+      XFree(screeninfo);
+  }
+#endif
+  free(l->monitors);
+  l->monitors = monitors;
+  l->count = monitors != NULL ? count : 0;
+  DEBUG(Dvalue, "%d monitors", l->count);
+}
+
+static int
+conn_open(xosd * osd)
+{
+  struct xosd_conn *l;
+
+  FUNCTION_START(Dfunction);
+  if ((l = calloc(1, sizeof(struct xosd_conn))) == NULL)
+    return -1;
+  l->refs = 1;
+  l->randr_event = -1;
+#ifdef HAVE_XRANDR
+  {
+    int error_base, major = 0, minor = 0;
+
+    if (XRRQueryExtension(osd->display, &l->randr_event, &error_base)) {
+      XRRQueryVersion(osd->display, &major, &minor);
+      l->randr_monitors = major > 1 || (major == 1 && minor >= 5);
+      XRRSelectInput(osd->display, XRootWindow(osd->display, osd->screen),
+                     RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask |
+                     RROutputChangeNotifyMask);
+    } else
+      l->randr_event = -1;
+  }
+#endif
+#ifdef HAVE_XINERAMA
+  {
+    int dummy_a, dummy_b;
+
+    l->xinerama = XineramaQueryExtension(osd->display, &dummy_a, &dummy_b);
+  }
+#endif
+  osd->conn = l;
+  layout_query(osd);
+  return 0;
+}
+
+/* Put osd on a monitor of the cached layout, the whole screen if there is
+ * no such monitor. */
+static int
+layout_apply(xosd * osd, int monitor)
+{
+  struct xosd_conn *l = osd->conn;
+
+  if (monitor >= 0 && monitor < l->count) {
+    osd->screen_width = l->monitors[monitor].width;
+    osd->screen_height = l->monitors[monitor].height;
+    osd->screen_xpos = l->monitors[monitor].x;
+    osd->screen_ypos = l->monitors[monitor].y;
+    osd->nscreens = l->count;
+    return 0;
+  }
+  osd->screen_width = XDisplayWidth(osd->display, osd->screen);
+  osd->screen_height = XDisplayHeight(osd->display, osd->screen);
+  osd->screen_xpos = 0;
+  osd->screen_ypos = 0;
+  xosd_error = "Error getting screen info from Xinerama";
+  return -1;
+}
+
+static int x11_mirror(xosd * osd);
+
+static int
+x11_monitor(xosd * osd, int monitor)
+{
+  int return_value;
+
+  osd->monitor = monitor;
+  return_value = layout_apply(osd, monitor);
+  if (osd->mirror)
+    x11_mirror(osd);
+  return return_value;
+}
+
+/* The outputs changed: query the layout again and move every object of
+ * the connection to its monitor, or the first one while that is gone. */
+static void
+layout_changed(xosd * osd)
+{
+  TRACE_INSTANT("monitors changed");
+  layout_query(osd);
+  for (; osd != NULL; osd = osd->next) {
+    int width = osd->screen_width;
+
+    if (osd->monitor < osd->conn->count)
+      layout_apply(osd, osd->monitor);
+    else
+      layout_apply(osd, 0);
+    osd->update |= osd->screen_width != width ? UPD_font : UPD_pos;
+    if (osd->mirror)
+      x11_mirror(osd);
+  }
+}
+
+/* }}} */
+
+/* Mirrors. {{{
+ * In mirror mode the object also has a window on every other monitor. All
+ * windows show the same pixmap through the same shape mask, so the content
+ * is drawn once and every further monitor costs just a window and a copy.
+ * A mirror takes the place on its monitor the main window has on its own.
+ */
+struct xosd_mirror
+{
+  Window window;
+  XRectangle monitor;
+  int mapped;
+};
+
+static void
+mirror_destroy(xosd * osd)
+{
+  int i;
+
+  for (i = 0; i < osd->nmirrors; i++)
+    XDestroyWindow(osd->display, osd->mirrors[i].window);
+  free(osd->mirrors);
+  osd->mirrors = NULL;
+  osd->nmirrors = 0;
+}
+
+static Window create_window(xosd * osd);
+
+/* One mirror for every monitor but the one of the main window, none if
+ * mirror mode is off. */
+static int
+x11_mirror(xosd * osd)
+{
+  struct xosd_conn *l = osd->conn;
+  struct xosd_mirror *m;
+  int i, n = 0;
+
+  FUNCTION_START(Dfunction);
+  mirror_destroy(osd);
+  if (!osd->mirror || l->count < 2)
+    return 0;
+  if ((m = calloc(l->count, sizeof(struct xosd_mirror))) == NULL) {
+    xosd_error = "Out of memory";
+    return -1;
+  }
+  for (i = 0; i < l->count; i++) {
+    XRectangle *r = &l->monitors[i];
+
+    if (r->x == osd->screen_xpos && r->y == osd->screen_ypos &&
+        r->width == osd->screen_width && r->height == osd->screen_height)
+      continue;
+    m[n].monitor = *r;
+    m[n].window = create_window(osd);
+    keep_on_top(osd, m[n].window);
+    n++;
+  }
+  osd->mirrors = m;
+  osd->nmirrors = n;
+  /* Sized, shaped and mapped by the next update. */
+  osd->update |= UPD_font;
+  return 0;
+}
+
+/* }}} */
+
+/* Connection and window. {{{ */
+static Window
+create_window(xosd * osd)
+{
+  XSetWindowAttributes setwinattr;
+  Window window;
+
+  setwinattr.override_redirect = 1;
+  window = XCreateWindow(osd->display,
+                         XRootWindow(osd->display, osd->screen),
+                         0, 0,
+                         osd->screen_width, osd->height,
+                         0,
+                         osd->depth,
+                         CopyFromParent,
+                         osd->visual, CWOverrideRedirect, &setwinattr);
+  XStoreName(osd->display, window, "XOSD");
+
+  DEBUG(Dtrace, "Request exposure events");
+  XSelectInput(osd->display, window, ExposureMask);
+  return window;
+}
+
+/* The window, pixmaps and colour GC of an object. */
+static void
+window_open(xosd * osd)
+{
+  XGCValues xgcv = { .graphics_exposures = False };
+
+  DEBUG(Dtrace, "creating X Window");
+  osd->window = create_window(osd);
+
+  osd->mask_bitmap =
+    XCreatePixmap(osd->display, osd->window, osd->screen_width,
+                  osd->height, 1);
+  osd->line_bitmap =
+    XCreatePixmap(osd->display, osd->window, osd->screen_width,
+                  osd->line_height, osd->depth);
+
+  osd->gc = XCreateGC(osd->display, osd->window, GCGraphicsExposures, &xgcv);
+  XSetBackground(osd->display, osd->gc,
+                 WhitePixel(osd->display, osd->screen));
+}
+
+static int
+x11_open(xosd * osd)
+{
+  int event_basep, error_basep;
+  char *display;
+  XGCValues xgcv = { .graphics_exposures = False };
+
+  FUNCTION_START(Dfunction);
+  DEBUG(Dtrace, "getting display");
+  display = getenv("DISPLAY");
+  if (!display) {
+    xosd_error = "No display";
+    return -1;
+  }
+
+  DEBUG(Dtrace, "Display query");
+  osd->display = XOpenDisplay(display);
+  if (!osd->display) {
+    xosd_error = "Cannot open display";
+    return -1;
+  }
+  osd->screen = XDefaultScreen(osd->display);
+#ifdef HAVE_XCB
+  DEBUG(Dtrace, "sending pipelined queries");
+  xcb_start(osd);
+#endif
+
+  DEBUG(Dtrace, "x shape extension query");
+  if (!XShapeQueryExtension(osd->display, &event_basep, &error_basep)) {
+    xosd_error = "X-Server does not support shape extension";
+#ifdef HAVE_XCB
+    xcb_stop(osd);
+#endif
+    XCloseDisplay(osd->display);
+    return -1;
+  }
+
+  osd->visual = DefaultVisual(osd->display, osd->screen);
+  osd->depth = DefaultDepth(osd->display, osd->screen);
+
+  DEBUG(Dtrace, "width and height initialization");
+  if (conn_open(osd) == -1) {
+    xosd_error = "Out of memory";
+#ifdef HAVE_XCB
+    xcb_stop(osd);
+#endif
+    XCloseDisplay(osd->display);
+    return -1;
+  }
+  x11_monitor(osd, 0);
+
+  window_open(osd);
+  osd->mask_gc = XCreateGC(osd->display, osd->mask_bitmap, GCGraphicsExposures, &xgcv);
+  osd->mask_gc_back = XCreateGC(osd->display, osd->mask_bitmap, GCGraphicsExposures, &xgcv);
+
+  XSetForeground(osd->display, osd->mask_gc_back,
+                 BlackPixel(osd->display, osd->screen));
+  XSetBackground(osd->display, osd->mask_gc_back,
+                 WhitePixel(osd->display, osd->screen));
+
+  XSetForeground(osd->display, osd->mask_gc,
+                 WhitePixel(osd->display, osd->screen));
+  XSetBackground(osd->display, osd->mask_gc,
+                 BlackPixel(osd->display, osd->screen));
+
+  DEBUG(Dtrace, "stay on top");
+#ifdef HAVE_XCB
+  if (osd->xcb != NULL)
+    xcb_stay_on_top(osd);
+  else
+#endif
+    stay_on_top(osd, osd->window);
+
+  osd->conn->last_request = NextRequest(osd->display);
+  return 0;
+}
+
+/* A clone uses the connection, shape GCs and fontset of its source and
+ * needs only its own window, pixmaps and colour GC. */
+static int
+x11_clone(xosd * osd, xosd * source)
+{
+  FUNCTION_START(Dfunction);
+  osd->display = source->display;
+#ifdef HAVE_XCB
+  osd->xcb = source->xcb;
+#endif
+  osd->screen = source->screen;
+  osd->visual = source->visual;
+  osd->depth = source->depth;
+  osd->conn = source->conn;
+  osd->conn->refs++;
+  osd->mask_gc = source->mask_gc;
+  osd->mask_gc_back = source->mask_gc_back;
+  if (source->fontset != NULL)
+    osd->fontset = font_ref(osd, source->fontset);
+
+  window_open(osd);
+  stay_on_top(osd, osd->window);
+  if (osd->mirror)
+    x11_mirror(osd);
+  return 0;
+}
+
+static void
+x11_close(xosd * osd)
+{
+  struct xosd_conn *c = osd->conn;
+
+  FUNCTION_START(Dfunction);
+  DEBUG(Dtrace, "freeing X resources");
+  XFreeGC(osd->display, osd->gc);
+  XFreePixmap(osd->display, osd->line_bitmap);
+  if (osd->fontset != NULL)
+    font_put(osd, osd->fontset);
+  XFreePixmap(osd->display, osd->mask_bitmap);
+  mirror_destroy(osd);
+  XDestroyWindow(osd->display, osd->window);
+  if (--c->refs > 0) {
+    /* The others stay, this one should vanish now. */
+    XFlush(osd->display);
+    return;
+  }
+
+  XFreeGC(osd->display, osd->mask_gc);
+  XFreeGC(osd->display, osd->mask_gc_back);
+#ifdef HAVE_XCB
+  xcb_stop(osd);
+#endif
+  free(c->monitors);
+  free(c);
+  osd->conn = NULL;
+
+  XCloseDisplay(osd->display);
+}
+
+static void
+x11_resize(xosd * osd)
+{
+  int i;
+
+  XResizeWindow(osd->display, osd->window, osd->screen_width, osd->height);
+  for (i = 0; i < osd->nmirrors; i++)
+    XResizeWindow(osd->display, osd->mirrors[i].window, osd->screen_width,
+                  osd->height);
+  XFreePixmap(osd->display, osd->mask_bitmap);
+  osd->mask_bitmap = XCreatePixmap(osd->display, osd->window,
+                                   osd->screen_width, osd->height, 1);
+  XFreePixmap(osd->display, osd->line_bitmap);
+  osd->line_bitmap = XCreatePixmap(osd->display, osd->window,
+                                   osd->screen_width, osd->height,
+                                   osd->depth);
+}
+
+static void
+x11_move(xosd * osd, int x, int y)
+{
+  int i;
+
+  XMoveWindow(osd->display, osd->window, x, y);
+  /* Keep the offsets from the edge the window is aligned to. */
+  for (i = 0; i < osd->nmirrors; i++) {
+    XRectangle *r = &osd->mirrors[i].monitor;
+    int mx = r->x + x - osd->screen_xpos, my = r->y + y - osd->screen_ypos;
+
+    if (osd->align == XOSD_center)
+      mx += (r->width - osd->screen_width) / 2;
+    else if (osd->align == XOSD_right)
+      mx += r->width - osd->screen_width;
+    if (osd->pos == XOSD_middle)
+      my += (r->height - osd->screen_height) / 2;
+    else if (osd->pos == XOSD_bottom)
+      my += r->height - osd->screen_height;
+    XMoveWindow(osd->display, osd->mirrors[i].window, mx, my);
+  }
+}
+
+static void
+x11_show(xosd * osd, int visible)
+{
+  int i;
+
+  if (visible)
+    XMapRaised(osd->display, osd->window);
+  else
+    XUnmapWindow(osd->display, osd->window);
+  for (i = 0; i < osd->nmirrors; i++) {
+    if (visible)
+      XMapRaised(osd->display, osd->mirrors[i].window);
+    else
+      XUnmapWindow(osd->display, osd->mirrors[i].window);
+    osd->mirrors[i].mapped = visible;
+  }
+}
+
+/* }}} */
+
+/* Fonts. {{{
+ * The objects of a connection share fontsets by name, so a clone or
+ * another object asking for the same font costs no round trips. */
+static XFontSet
+font_get(xosd * osd, const char *font)
+{
+  struct xosd_fontset *f;
+  char **missing;
+  int nmissing;
+  char *defstr;
+
+  for (f = osd->conn->fonts; f != NULL; f = f->next)
+    if (strcmp(f->name, font) == 0) {
+      f->refs++;
+      return f->set;
+    }
+  if ((f = calloc(1, sizeof(struct xosd_fontset))) == NULL ||
+      (f->name = strdup(font)) == NULL) {
+    free(f);
+    xosd_error = "Out of memory";
+    return NULL;
+  }
+  f->set = XCreateFontSet(osd->display, font, &missing, &nmissing, &defstr);
+  XFreeStringList(missing);
+  if (f->set == NULL) {
+    free(f->name);
+    free(f);
+    xosd_error = "Requested font not found";
+    return NULL;
+  }
+  f->refs = 1;
+  f->next = osd->conn->fonts;
+  osd->conn->fonts = f;
+  return f->set;
+}
+
+static XFontSet
+font_ref(xosd * osd, XFontSet set)
+{
+  struct xosd_fontset *f;
+
+  for (f = osd->conn->fonts; f != NULL; f = f->next)
+    if (f->set == set)
+      f->refs++;
+  return set;
+}
+
+static void
+font_put(xosd * osd, XFontSet set)
+{
+  struct xosd_fontset **p, *f;
+
+  for (p = &osd->conn->fonts; (f = *p) != NULL; p = &f->next)
+    if (f->set == set) {
+      if (--f->refs == 0) {
+        *p = f->next;
+        XFreeFontSet(osd->display, f->set);
+        free(f->name);
+        free(f);
+      }
+      return;
+    }
+}
+
+static int
+x11_set_font(xosd * osd, const char *font)
+{
+  XFontSet fontset2;
+
+  /*
+   * Try to create the new font. If it doesn't succeed, keep old font. 
+   */
+  fontset2 = font_get(osd, font);
+  if (fontset2 == NULL)
+    return -1;
+  if (osd->fontset != NULL)
+    font_put(osd, osd->fontset);
+  osd->fontset = fontset2;
+  return 0;
+}
+
+static XRectangle *
+x11_font_extent(xosd * osd)
+{
+  return &XExtentsOfFontSet(osd->fontset)->max_logical_extent;
+}
+
+static int
+x11_text_width(xosd * osd, const char *string)
+{
+  XRectangle rect;
+
+  XmbTextExtents(osd->fontset, string, strlen(string), NULL, &rect);
+  return rect.width;
+}
+
+/* All prefixes in one request of Xlib, not one per prefix. Characters are
+ * counted in the encoding of the locale, as Xlib does. */
+static int
+x11_text_extents(xosd * osd, const char *string, struct xosd_extent *ext)
+{
+  int len = strlen(string), nchars = 0, n, i, x;
+  XRectangle *logical, overall_ink, overall_logical;
+  mbstate_t state;
+
+  ext[0].offset = ext[0].x = 0;
+  if (len == 0)
+    return 0;
+  if ((logical = malloc(2 * len * sizeof(XRectangle))) == NULL ||
+      !XmbTextPerCharExtents(osd->fontset, string, len, logical + len,
+                             logical, len, &nchars, &overall_ink,
+                             &overall_logical))
+    nchars = 0;
+  memset(&state, 0, sizeof(state));
+  for (i = 0, n = 0; n < nchars - 1 && i < len; n++) {
+    size_t l = mbrlen(string + i, len - i, &state);
+    if (l == 0 || l > (size_t) (len - i)) {
+      l = 1;
+      memset(&state, 0, sizeof(state));
+    }
+    i += l;
+    /* Never shrinking, for a binary search. */
+    x = logical[n].x + logical[n].width;
+    ext[n + 1].offset = i;
+    ext[n + 1].x = (x > ext[n].x) ? x : ext[n].x;
+  }
+  /* The whole string, also if Xlib failed or counted differently. */
+  x = nchars ? overall_logical.width : x11_text_width(osd, string);
+  ext[n + 1].offset = len;
+  ext[n + 1].x = (x > ext[n].x) ? x : ext[n].x;
+  free(logical);
+  return n + 1;
+}
+
+/* }}} */
+
+/* Drawing. {{{
+ * Everything is drawn twice: into the pixmap with the colour of osd->gc,
+ * and into the shape mask with osd->mask_gc. */
+static void
+x11_set_colour(xosd * osd, unsigned long pixel)
+{
+  XSetForeground(osd->display, osd->gc, pixel);
+}
+
+static void
+x11_set_clip(xosd * osd, XRectangle * clip)
+{
+  if (clip != NULL) {
+    XSetClipRectangles(osd->display, osd->gc, 0, 0, clip, 1, Unsorted);
+    XSetClipRectangles(osd->display, osd->mask_gc, 0, 0, clip, 1, Unsorted);
+  } else {
+    XSetClipMask(osd->display, osd->gc, None);
+    XSetClipMask(osd->display, osd->mask_gc, None);
+  }
+}
+
+static void
+x11_clear(xosd * osd, XRectangle * area)
+{
+  XFillRectangles(osd->display, osd->mask_bitmap, osd->mask_gc_back, area, 1);
+  osd->stats.fill_rectangles++;
+}
+
+static void
+x11_fill_rects(xosd * osd, XRectangle * rects, int n)
+{
+  XFillRectangles(osd->display, osd->mask_bitmap, osd->mask_gc, rects, n);
+  XFillRectangles(osd->display, osd->line_bitmap, osd->gc, rects, n);
+  osd->stats.fill_rectangles += 2;
+}
+
+static void
+x11_draw_text(xosd * osd, const char *string, int x, int y)
+{
+  int len = strlen(string);
+
+  XmbDrawString(osd->display, osd->mask_bitmap, osd->fontset, osd->mask_gc, x,
+                y, string, len);
+  XmbDrawString(osd->display, osd->line_bitmap, osd->fontset, osd->gc, x, y,
+                string, len);
+  osd->stats.draw_strings += 2;
+}
+
+/* A strip is a pixmap and a mask like those of the window, drawn into by
+ * swapping them in. */
+struct x11_strip
+{
+  Pixmap pixmap;
+  Pixmap mask;
+  Pixmap line_bitmap;           /* of the window while drawing into the strip */
+  Pixmap mask_bitmap;
+};
+
+static void *
+x11_strip_begin(xosd * osd, int width)
+{
+  struct x11_strip *s;
+  XRectangle all;
+
+  if ((s = malloc(sizeof(struct x11_strip))) == NULL)
+    return NULL;
+  s->pixmap = XCreatePixmap(osd->display, osd->window, width,
+                            osd->line_height, osd->depth);
+  s->mask = XCreatePixmap(osd->display, osd->window, width,
+                          osd->line_height, 1);
+  s->line_bitmap = osd->line_bitmap;
+  s->mask_bitmap = osd->mask_bitmap;
+  osd->line_bitmap = s->pixmap;
+  osd->mask_bitmap = s->mask;
+  all.x = all.y = 0;
+  all.width = width;
+  all.height = osd->line_height;
+  x11_clear(osd, &all);
+  return s;
+}
+
+static void
+x11_strip_end(xosd * osd, void *strip)
+{
+  struct x11_strip *s = strip;
+
+  osd->line_bitmap = s->line_bitmap;
+  osd->mask_bitmap = s->mask_bitmap;
+}
+
+static void
+x11_strip_copy(xosd * osd, void *strip, int src_x, XRectangle * dst)
+{
+  struct x11_strip *s = strip;
+
+  XCopyArea(osd->display, s->mask, osd->mask_bitmap, osd->mask_gc, src_x, 0,
+            dst->width, dst->height, dst->x, dst->y);
+  XCopyArea(osd->display, s->pixmap, osd->line_bitmap, osd->gc, src_x, 0,
+            dst->width, dst->height, dst->x, dst->y);
+}
+
+static void
+x11_strip_free(xosd * osd, void *strip)
+{
+  struct x11_strip *s = strip;
+
+  XFreePixmap(osd->display, s->pixmap);
+  XFreePixmap(osd->display, s->mask);
+  free(s);
+}
+
+/* }}} */
+
+/* Showing. {{{ */
+static void
+shape_window(xosd * osd, Window window, XRectangle * area, Pixmap column)
+{
+  if (area == NULL) {
+    XShapeCombineMask(osd->display, window, ShapeBounding, 0, 0,
+                      osd->mask_bitmap, ShapeSet);
+    return;
+  }
+  XShapeCombineRectangles(osd->display, window, ShapeBounding, 0, 0,
+                          area, 1, ShapeSubtract, Unsorted);
+  XShapeCombineMask(osd->display, window, ShapeBounding, area->x,
+                    area->y, column, ShapeUnion);
+}
+
+static void
+x11_shape(xosd * osd, XRectangle * area)
+{
+  Pixmap column = None;
+  int i;
+
+  if (area != NULL) {
+    /* Replace just this part of the window shape. */
+    column = XCreatePixmap(osd->display, osd->window, area->width,
+                           area->height, 1);
+    XCopyArea(osd->display, osd->mask_bitmap, column, osd->mask_gc, area->x,
+              area->y, area->width, area->height, 0, 0);
+  }
+  shape_window(osd, osd->window, area, column);
+  for (i = 0; i < osd->nmirrors; i++)
+    shape_window(osd, osd->mirrors[i].window, area, column);
+  if (column != None)
+    XFreePixmap(osd->display, column);
+}
+
+static void
+x11_present(xosd * osd, XRectangle * area)
+{
+  int i;
+
+  XCopyArea(osd->display, osd->line_bitmap, osd->window, osd->gc,
+            area->x, area->y, area->width, area->height, area->x, area->y);
+  for (i = 0; i < osd->nmirrors; i++) {
+    struct xosd_mirror *m = &osd->mirrors[i];
+
+    /* Mirrors made while shown are mapped once they have content, the
+     * exposure then paints them. */
+    if (!m->mapped) {
+      XMapRaised(osd->display, m->window);
+      m->mapped = 1;
+    } else
+      XCopyArea(osd->display, osd->line_bitmap, m->window, osd->gc,
+                area->x, area->y, area->width, area->height, area->x,
+                area->y);
+  }
+}
+
+static void
+x11_flush(xosd * osd)
+{
+  osd->stats.bytes_flushed += osd->display->bufptr - osd->display->buffer;
+  osd->stats.requests += NextRequest(osd->display) - osd->conn->last_request;
+  XFlush(osd->display);
+  osd->conn->last_request = NextRequest(osd->display);
+}
+
+/* }}} */
+
+/* Events. {{{ */
+static int
+x11_fd(xosd * osd)
+{
+  return ConnectionNumber(osd->display);
+}
+
+/* The object of osd or its clones window belongs to. */
+static xosd *
+window_owner(xosd * osd, Window window)
+{
+  int i;
+
+  for (; osd != NULL; osd = osd->next) {
+    if (osd->window == window)
+      return osd;
+    for (i = 0; i < osd->nmirrors; i++)
+      if (osd->mirrors[i].window == window)
+        return osd;
+  }
+  return NULL;
+}
+
+/* Xlib may have queued events while reading a reply, without the socket
+ * becoming readable again, so this counts those as well. */
+static int
+x11_pending(xosd * osd)
+{
+  return XEventsQueued(osd->display, QueuedAfterReading);
+}
+
+static void
+x11_event(xosd * osd)
+{
+  XEvent report;
+  int changed = 0;
+
+  /* Take only what is there, XNextEvent() on an empty queue blocks. A
+   * change of outputs is a burst of RandR events, after which the layout
+   * is queried only once. */
+  while (x11_pending(osd) > 0) {
+    XNextEvent(osd->display, &report);
+    /* ignore sent by server/manual send flag */
+    switch (report.type & 0x7f) {
+    case Expose:
+      {
+        XExposeEvent *XE = &report.xexpose;
+        xosd *owner = window_owner(osd, XE->window);
+        /* http://x.holovko.ru/Xlib/chap10.html#10.9.1 */
+        DEBUG(Dvalue, "expose %d: x=%d y=%d w=%d h=%d", XE->count,
+              XE->x, XE->y, XE->width, XE->height);
+        if (owner == NULL)
+          break;
+        XCopyArea(osd->display, owner->line_bitmap, XE->window, owner->gc,
+                  report.xexpose.x, report.xexpose.y, report.xexpose.width,
+                  report.xexpose.height, report.xexpose.x, report.xexpose.y);
+        owner->stats.expose_repaints++;
+        break;
+      }
+    case GraphicsExpose:
+      {
+        XGraphicsExposeEvent *XE = &report.xgraphicsexpose;
+        DEBUG(Dvalue, "gfxexpose %d: x=%d y=%d w=%d h=%d code=%d",
+              XE->count, XE->x, XE->y, XE->width, XE->height, XE->major_code);
+        break;
+      }
+    case NoExpose:
+      {
+        XNoExposeEvent *XE = &report.xnoexpose;
+        DEBUG(Dvalue, "noexpose: code=%d", XE->major_code);
+        break;
+      }
+    default:
+#ifdef HAVE_XRANDR
+      if (osd->conn->randr_event == -1)
+        ;
+      else if (report.type ==
+               osd->conn->randr_event + RRScreenChangeNotify) {
+        DEBUG(Dvalue, "RRScreenChangeNotify");
+        XRRUpdateConfiguration(&report);
+        changed = 1;
+        break;
+      } else if (report.type == osd->conn->randr_event + RRNotify) {
+        DEBUG(Dvalue, "RRNotify %d", ((XRRNotifyEvent *) & report)->subtype);
+        changed = 1;
+        break;
+      }
+#endif
+      DEBUG(Dvalue, "XEvent=%d", report.type);
+      break;
+    }
+  }
+  if (changed)
+    layout_changed(osd);
+}
+
+/* }}} */
+
+const struct xosd_backend _xosd_backend_x11 = {
+  .name = "x11",
+  .open = x11_open,
+  .clone = x11_clone,
+  .close = x11_close,
+  .fd = x11_fd,
+  .pending = x11_pending,
+  .event = x11_event,
+  .monitor = x11_monitor,
+  .mirror = x11_mirror,
+  .set_font = x11_set_font,
+  .font_extent = x11_font_extent,
+  .text_width = x11_text_width,
+  .text_extents = x11_text_extents,
+  .parse_colour = parse_colour,
+  .resize = x11_resize,
+  .move = x11_move,
+  .set_colour = x11_set_colour,
+  .set_clip = x11_set_clip,
+  .clear = x11_clear,
+  .fill_rects = x11_fill_rects,
+  .draw_text = x11_draw_text,
+  .strip_begin = x11_strip_begin,
+  .strip_end = x11_strip_end,
+  .strip_copy = x11_strip_copy,
+  .strip_free = x11_strip_free,
+  .shape = x11_shape,
+  .show = x11_show,
+  .present = x11_present,
+  .flush = x11_flush,
+};
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -22,6 +22,9 @@
 #define SLIDER_SCALE 0.8
 #define SLIDER_SCALE_ON 0.7
 #define XOFFSET 10
+#define ELLIPSIS "..."
+#define TICKER_FPS 60           /* at most, however fast a ticker moves */
+#define TICKER_WIDTH_MAX 32767  /* pixels of a strip, longer texts are cut */
 
 const char *osd_default_font =
   "-misc-fixed-medium-r-semicondensed--*-*-*-*-c-*-*-*";
@@ -45,6 +48,89 @@ _wait_until_update(xosd * osd, int generation)
   pthread_mutex_unlock(&osd->mutex_sync);
 }
 
+/* Count a map or unmap. The caller holds ctx->mutex, readers without it
+ * use _generation(). With an event pipe, also queue the event and make the
+ * pipe readable, see xosd_get_event_fd(). */
+static void
+_next_generation(xosd * osd, xosd_event event)
+{
+  char c = 0;
+
+  pthread_mutex_lock(&osd->mutex_sync);
+  osd->generation++;
+  if (osd->eventfd[1] != -1) {
+    if (osd->nevents == XOSD_EVENTS_MAX) {
+      /* Lose the oldest, the application is not listening. */
+      osd->event_head = (osd->event_head + 1) % XOSD_EVENTS_MAX;
+      osd->nevents--;
+    }
+    osd->events[(osd->event_head + osd->nevents++) % XOSD_EVENTS_MAX] = event;
+    if (osd->nevents == 1 && write(osd->eventfd[1], &c, sizeof(c)) == -1)
+      DEBUG(Dtrace, "event pipe write failed %d", errno);
+  }
+  pthread_mutex_unlock(&osd->mutex_sync);
+}
+static int
+_generation(xosd * osd)
+{
+  int generation;
+
+  pthread_mutex_lock(&osd->mutex_sync);
+  generation = osd->generation;
+  pthread_mutex_unlock(&osd->mutex_sync);
+  return generation;
+}
+
+/* }}} */
+
+/* Statistics. {{{
+ * Counters are updated while holding ctx->mutex. Taking the time is only
+ * done once somebody asked for the statistics, osd->stats.timing is set. */
+static void
+_stats_add(xosd_histogram * h, unsigned long us)
+{
+  int bucket = 0;
+
+  while (bucket < XOSD_HISTOGRAM_BUCKETS - 1 && us >> bucket)
+    bucket++;
+  h->count++;
+  h->total_us += us;
+  if (us > h->max_us)
+    h->max_us = us;
+  h->buckets[bucket]++;
+}
+
+/* Microseconds since *start, which is moved on to now. */
+static unsigned long
+_stats_lap(struct timeval *start)
+{
+  struct timeval now;
+  long us;
+
+  gettimeofday(&now, NULL);
+  us = (now.tv_sec - start->tv_sec) * 1000000L + now.tv_usec - start->tv_usec;
+  *start = now;
+  return (us < 0) ? 0 : us;
+}
+
+/* End an update phase of the event loop, started with TRACE_BEGIN(). */
+#define PHASE_END(osd, start, p) \
+  do { \
+    if ((osd)->stats.timing) \
+      _stats_add(&(osd)->stats.phase[p], _stats_lap(start)); \
+    TRACE_END("phase"); \
+  } while (0)
+
+/* Remember when the oldest not yet flushed xosd_display() was called. */
+static void
+_stats_displayed(xosd * osd, struct timeval *called)
+{
+  pthread_mutex_lock(&osd->mutex_pending);
+  if (!timerisset(&osd->display_time))
+    osd->display_time = *called;
+  pthread_mutex_unlock(&osd->mutex_pending);
+}
+
 /* }}} */
 
 /* Serialize access to the X11 connection. {{{
@@ -56,7 +142,7 @@ _wait_until_update(xosd * osd, int generation)
  * the loading application has done its first X11 call, after which calling
  * XInitThreads() is no longer possible. (Debian-Bug #252170)
  *
- * The exposure-thread gets the MUTEX and sleeps on a select([X11,pipe]). When
+ * The exposure-thread gets the MUTEX and sleeps on a poll([X11,pipe]). When
  * an X11 event occurs, the tread can directly use X11 calls.
  * When another thread needs to do an X11 call, it uses _xosd_lock(osd) to
  * notify the exposure-thread via the pipe, which uses cond_wait to voluntarily
@@ -67,28 +153,59 @@ _wait_until_update(xosd * osd, int generation)
  * releasing the MUTEX.
  * The number of characters in the pipe is an indication for the number of
  * threads waiting for the X11-MUTEX.
+ * An object of xosd_create_threadless() has no exposure-thread. The thread
+ * calling the API is the only one using X11, so there is nothing to lock,
+ * and _xosd_unlock() does the drawing itself.
  */
+static long _update_all(struct xosd_context *ctx);
 static /*inline */ void
-_xosd_lock(xosd * osd)
+_xosd_lock_for(xosd * osd, const char *api)
 {
   char c = 0;
   FUNCTION_START(Dlocking);
-  if (write(osd->pipefd[1], &c, sizeof(c)) != -1) {
-    pthread_mutex_lock(&osd->mutex);
+  if (osd->ctx->threadless) {
+    /* Nobody else uses the connection. */
+    TRACE_BEGIN(api);
+    return;
   }
+  TRACE_BEGIN("lock wait");
+  if (write(osd->ctx->pipefd[1], &c, sizeof(c)) != -1) {
+    if (osd->stats.timing) {
+      struct timeval start;
+      gettimeofday(&start, NULL);
+      pthread_mutex_lock(&osd->ctx->mutex);
+      _stats_add(&osd->stats.lock_wait, _stats_lap(&start));
+    } else
+      pthread_mutex_lock(&osd->ctx->mutex);
+  }
+  TRACE_END("lock wait");
+  TRACE_BEGIN(api);
     FUNCTION_END(Dlocking);
 }
+/* The trace shows the time holding the lock under the API function name. */
+#define _xosd_lock(osd) _xosd_lock_for(osd, __func__)
 static /*inline */ void
 _xosd_unlock(xosd * osd)
 {
   char c;
   int generation = osd->generation, update = osd->update;
+  int wait = osd->show_wait;
   FUNCTION_START(Dlocking);
-  if (read(osd->pipefd[0], &c, sizeof(c)) != -1) {
-    pthread_cond_signal(&osd->cond_wait);
-    pthread_mutex_unlock(&osd->mutex);
-    if (update & UPD_show)
+  if (osd->ctx->threadless) {
+    /* Draw now, as the event thread would. */
+    TRACE_END("api");
+    _update_all(osd->ctx);
+    return;
+  }
+  if (read(osd->ctx->pipefd[0], &c, sizeof(c)) != -1) {
+    TRACE_END("api");
+    pthread_cond_signal(&osd->ctx->cond_wait);
+    pthread_mutex_unlock(&osd->ctx->mutex);
+    if (wait && update & UPD_show) {
+      TRACE_BEGIN("wait shown");
       _wait_until_update(osd, generation & ~1); /* no wait when already shown. */
+      TRACE_END("wait shown");
+    }
   }
   FUNCTION_END(Dlocking);
 }
@@ -97,32 +214,137 @@ _xosd_unlock(xosd * osd)
 
 /* Draw percentage/slider bar. {{{ */
 static void                     /*inline */
-_draw_bar(xosd * osd, int nbars, int on, XRectangle * p, XRectangle * mod,
-          int is_slider)
+_draw_bar(xosd * osd, int first, int last, int on, XRectangle * p,
+          XRectangle * mod, int is_slider)
 {
   int i;
   XRectangle rs[2];
   FUNCTION_START(Dfunction);
 
-  rs[0].x = rs[1].x = mod->x + p->x;
+  rs[0].x = rs[1].x = mod->x + p->x + first * p->width;
   rs[0].y = (rs[1].y = mod->y + p->y) + p->height / 3;
   rs[0].width = mod->width + p->width * SLIDER_SCALE;
   rs[0].height = mod->height + p->height / 3;
   rs[1].width = mod->width + p->width * SLIDER_SCALE_ON;
   rs[1].height = mod->height + p->height;
-  for (i = 0; i < nbars; i++, rs[0].x = rs[1].x += p->width) {
+  for (i = first; i <= last; i++, rs[0].x = rs[1].x += p->width) {
     XRectangle *r = &(rs[is_slider ? (i == on) : (i < on)]);
-    XFillRectangles(osd->display, osd->mask_bitmap, osd->mask_gc, r, 1);
-    XFillRectangles(osd->display, osd->line_bitmap, osd->gc, r, 1);
+    osd->backend->fill_rects(osd, r, 1);
+  }
+  FUNCTION_END(Dfunction);
+}
+static void
+_draw_bar_layers(xosd * osd, int first, int last, int on, XRectangle * p,
+                 int is_slider)
+{
+  XRectangle m;
+
+  /* Outline */
+  if (osd->outline_offset) {
+    m.x = m.y = -osd->outline_offset;
+    m.width = m.height = 2 * osd->outline_offset;
+    osd->backend->set_colour(osd, osd->outline_pixel);
+    _draw_bar(osd, first, last, on, p, &m, is_slider);
+  }
+  /* Shadow */
+  if (osd->shadow_offset) {
+    m.x = m.y = osd->shadow_offset;
+    m.width = m.height = 0;
+    osd->backend->set_colour(osd, osd->shadow_pixel);
+    _draw_bar(osd, first, last, on, p, &m, is_slider);
+  }
+  /* Bar/Slider */
+  if (1) {
+    m.x = m.y = m.width = m.height = 0;
+    osd->backend->set_colour(osd, osd->pixel);
+    _draw_bar(osd, first, last, on, p, &m, is_slider);
+  }
+}
+
+/* Grow osd->damage to cover area, which is presented after a partial
+ * repaint. */
+static void
+_add_damage(xosd * osd, XRectangle * area)
+{
+  if (osd->damage.width == 0) {
+    osd->damage = *area;
+  } else {
+    int x2 = osd->damage.x + osd->damage.width;
+    int y2 = osd->damage.y + osd->damage.height;
+    if (area->x + area->width > x2)
+      x2 = area->x + area->width;
+    if (area->y + area->height > y2)
+      y2 = area->y + area->height;
+    if (area->x < osd->damage.x)
+      osd->damage.x = area->x;
+    if (area->y < osd->damage.y)
+      osd->damage.y = area->y;
+    osd->damage.width = x2 - osd->damage.x;
+    osd->damage.height = y2 - osd->damage.y;
+  }
+}
+
+/* Repaint the segments first..last of a bar in place. {{{
+ * Outline and shadow of a segment reach into its neighbours, so the column
+ * is cleared and all segments touching it are redrawn clipped to it. Only
+ * that column of the XShape mask is replaced and recorded as damage. */
+static void
+_redraw_bar_segments(xosd * osd, int nbars, int on, XRectangle * p,
+                     int is_slider, int first, int last)
+{
+  int margin = osd->outline_offset + osd->shadow_offset, reach;
+  XRectangle clip;
+
+  FUNCTION_START(Dfunction);
+  /* The bar is drawn outline_offset above its line, see draw_text(). */
+  clip.x = p->x + first * p->width - margin;
+  clip.y = p->y - osd->outline_offset;
+  clip.width = (last - first + 1) * p->width + 2 * margin;
+  clip.height = osd->line_height;
+  if (clip.x < 0) {
+    clip.width += clip.x;
+    clip.x = 0;
+  }
+  if (clip.y < 0) {
+    clip.height += clip.y;
+    clip.y = 0;
   }
+  if (clip.x + clip.width > osd->screen_width)
+    clip.width = osd->screen_width - clip.x;
+  if (clip.y + clip.height > osd->height)
+    clip.height = osd->height - clip.y;
+  if ((short) clip.width <= 0 || (short) clip.height <= 0)
+    return;
+
+  reach = (p->width > 0) ? 2 * margin / p->width + 1 : nbars;
+  first = (first - reach < 0) ? 0 : first - reach;
+  last = (last + reach >= nbars) ? nbars - 1 : last + reach;
+
+  osd->backend->clear(osd, &clip);
+  osd->backend->set_clip(osd, &clip);
+  _draw_bar_layers(osd, first, last, on, p, is_slider);
+  osd->backend->set_clip(osd, NULL);
+
+#ifndef DEBUG_XSHAPE
+  /* Replace just this column of the window shape. */
+  osd->backend->shape(osd, &clip);
+#endif
+
+  _add_damage(osd, &clip);
   FUNCTION_END(Dfunction);
 }
+
+/* }}} */
+
+/* Draw a bar line. With partial set only the segments whose state differs
+ * from the last drawing are repainted, otherwise the caller has cleared the
+ * line and everything is drawn. */
 static void
-draw_bar(xosd * osd, int line)
+draw_bar(xosd * osd, int line, int partial)
 {
   struct xosd_bar *l = &osd->lines[line].bar;
   int is_slider = l->type == LINE_slider, nbars, on;
-  XRectangle p, m;
+  XRectangle p;
   p.x = XOFFSET;
   p.y = osd->line_height * line;
   p.width = -osd->extent->y / 2;
@@ -157,60 +379,236 @@ draw_bar(xosd * osd, int line)
   }
   on = ((nbars - is_slider) * l->value) / 100;
 
-  DEBUG(Dvalue, "percent=%d, nbars=%d, on=%d", l->value, nbars, on);
+  DEBUG(Dvalue, "percent=%d, nbars=%d, on=%d, was=%d", l->value, nbars, on,
+        l->on);
+
+  if (!partial) {
+    _draw_bar_layers(osd, 0, nbars - 1, on, &p, is_slider);
+  } else if (l->on < 0 || l->nbars != nbars || l->x != p.x) {
+    _redraw_bar_segments(osd, nbars, on, &p, is_slider, 0, nbars - 1);
+  } else if (l->on != on) {
+    if (is_slider) {
+      _redraw_bar_segments(osd, nbars, on, &p, is_slider, l->on, l->on);
+      _redraw_bar_segments(osd, nbars, on, &p, is_slider, on, on);
+    } else if (l->on < on) {
+      _redraw_bar_segments(osd, nbars, on, &p, is_slider, l->on, on - 1);
+    } else {
+      _redraw_bar_segments(osd, nbars, on, &p, is_slider, on, l->on - 1);
+    }
+  }
+  l->on = on;
+  l->nbars = nbars;
+  l->x = p.x;
+}
 
-  /* Outline */
-  if (osd->outline_offset) {
-    m.x = m.y = -osd->outline_offset;
-    m.width = m.height = 2 * osd->outline_offset;
-    XSetForeground(osd->display, osd->gc, osd->outline_pixel);
-    _draw_bar(osd, nbars, on, &p, &m, is_slider);
+/* }}} */
+
+/* Layout of long text lines. {{{
+ * The widths of all prefixes of a text come from the backend in one call
+ * and stay in the fit buffer of its line until the text or the font
+ * changes. Where the text is cut is found by binary search over them,
+ * again when the space for it changes, without measuring anything. */
+
+/* Pixels a line of text may take without leaving the screen. */
+static int
+_text_space(xosd * osd)
+{
+  int space = osd->screen_width - osd->hoffset -
+    2 * (XOFFSET + osd->outline_offset) - osd->shadow_offset;
+  return (space > 0) ? space : 0;
+}
+
+/* The largest k from lo to hi with ext[k].x <= x, lo if there is none. */
+static int
+_extent_find(const struct xosd_extent *ext, int lo, int hi, int x)
+{
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (ext[mid].x <= x)
+      lo = mid;
+    else
+      hi = mid - 1;
   }
-  /* Shadow */
-  if (osd->shadow_offset) {
-    m.x = m.y = osd->shadow_offset;
-    m.width = m.height = 0;
-    XSetForeground(osd->display, osd->gc, osd->shadow_pixel);
-    _draw_bar(osd, nbars, on, &p, &m, is_slider);
+  return lo;
+}
+
+/* Measure string into *ext, a buffer of the arena of *size bytes, which
+ * is replaced if it has no room for the extents and extra bytes. Returns
+ * the number of characters, -1 when out of memory. */
+static int
+_measure(xosd * osd, const char *string, struct xosd_extent **ext,
+         size_t * size, size_t extra)
+{
+  size_t need = (strlen(string) + 1) * sizeof(struct xosd_extent) + extra;
+
+  if (*size < need) {
+    if (*size)
+      _xosd_arena_put(&osd->arena, *ext, *size);
+    *size = need;
+    if ((*ext = _xosd_arena_get(&osd->arena, size)) == NULL) {
+      xosd_error = "Out of memory";
+      *size = 0;
+      return -1;
+    }
   }
-  /* Bar/Slider */
-  if (1) {
-    m.x = m.y = m.width = m.height = 0;
-    XSetForeground(osd->display, osd->gc, osd->pixel);
-    _draw_bar(osd, nbars, on, &p, &m, is_slider);
+  return osd->backend->text_extents(osd, string, *ext);
+}
+
+/* The text to draw for l, cut to the screen as osd->layout says, with
+ * l->width set to its width. */
+static const char *
+_fit_text(xosd * osd, struct xosd_text *l)
+{
+  const char *string = TEXT_STRING(l);
+  const struct xosd_extent *ext;
+  int space, full, head, tail, n;
+  char *shown;
+
+  if (osd->layout == XOSD_layout_none) {
+    if (l->width < 0)
+      l->width = osd->backend->text_width(osd, string);
+    return string;
+  }
+  space = _text_space(osd);
+  if (l->width >= 0 && l->space == space)
+    return TEXT_SHOWN(l);
+
+  /* The whole width, measured only if it is not known yet. */
+  if (l->nchars >= 0)
+    full = l->fit[l->nchars].x;
+  else if (l->width >= 0 && !l->cut)
+    full = l->width;
+  else
+    full = osd->backend->text_width(osd, string);
+  l->space = space;
+  l->cut = 0;
+  l->width = full;
+  if (full <= space)
+    return string;
+
+  /* Room for the cut text after the extents. Out of memory, it runs off
+   * the screen as without a layout. */
+  if (l->nchars < 0 &&
+      (l->nchars = _measure(osd, string, &l->fit, &l->fit_size,
+                            strlen(string) + sizeof(ELLIPSIS))) < 0)
+    return string;
+  if (osd->ellipsis_width < 0)
+    osd->ellipsis_width = osd->backend->text_width(osd, ELLIPSIS);
+  ext = l->fit;
+  n = l->nchars;
+  space = (space > osd->ellipsis_width) ? space - osd->ellipsis_width : 0;
+  if (osd->layout == XOSD_layout_ellipsis_middle) {
+    head = _extent_find(ext, 0, n, space / 2);
+    /* The longest end which fits into the rest. */
+    tail = _extent_find(ext, head, n, full - (space - ext[head].x) - 1) + 1;
+  } else {
+    head = _extent_find(ext, 0, n, space);
+    tail = n;
   }
+  while (head > 0 && string[ext[head - 1].offset] == ' ')
+    head--;
+  while (tail < n && string[ext[tail].offset] == ' ')
+    tail++;
+
+  shown = (char *) &ext[n + 1];
+  memcpy(shown, string, ext[head].offset);
+  memcpy(shown + ext[head].offset, ELLIPSIS, sizeof(ELLIPSIS) - 1);
+  strcpy(shown + ext[head].offset + sizeof(ELLIPSIS) - 1,
+         string + ext[tail].offset);
+  l->cut = 1;
+  l->width = ext[head].x + osd->ellipsis_width + full - ext[tail].x;
+  return shown;
 }
 
 /* }}} */
 
 /* Draw text. {{{ */
 static void                     /*inline */
-_draw_text(xosd * osd, char *string, int x, int y)
+_draw_text(xosd * osd, const char *string, int x, int y)
 {
-  int len = strlen(string);
   FUNCTION_START(Dfunction);
-  XmbDrawString(osd->display, osd->mask_bitmap, osd->fontset, osd->mask_gc, x,
-                y, string, len);
-  XmbDrawString(osd->display, osd->line_bitmap, osd->fontset, osd->gc, x, y,
-                string, len);
+  osd->backend->draw_text(osd, string, x, y);
   FUNCTION_END(Dfunction);
 }
+
+/* Draw string with its shadow and outline, from x on the baseline y. */
+static void
+_draw_string(xosd * osd, const char *string, int x, int y)
+{
+  int sx = 0, sy = 0;
+
+  if (osd->shadow_direction) {
+    switch(osd->shadow_direction) {
+      case 0:
+        sy = -osd->shadow_offset;
+        break;
+      case 1:
+        sx = osd->shadow_offset;
+        sy = -osd->shadow_offset;
+        break;
+      case 2:
+        sx = osd->shadow_offset;
+        break;
+      case 3:
+        sx = sy = osd->shadow_offset;
+        break;
+      case 4:
+        sy = osd->shadow_offset;
+        break;
+      case 5:
+        sx = -osd->shadow_offset;
+        sy = osd->shadow_offset;
+        break;
+      case 6:
+        sx = -osd->shadow_offset;
+        break;
+      case 7:
+        sx = sy = -osd->shadow_offset;
+        break;
+      default:
+        break;
+    }
+  } else {
+    sx = sy = osd->shadow_offset;
+  }
+
+  if (osd->backend->draw_line != NULL) {
+    osd->backend->draw_line(osd, string, x, y, sx, sy);
+    return;
+  }
+
+  if (osd->shadow_offset && (sx || sy)) {
+    osd->backend->set_colour(osd, osd->shadow_pixel);
+    _draw_text(osd, string, x + sx, y + sy);
+  }
+  if (osd->outline_offset) {
+    int i, j;
+    osd->backend->set_colour(osd, osd->outline_pixel);
+    /* FIXME: echo . | osd_cat -O 50 -p middle -A center */
+    for (i = 1; i <= osd->outline_offset; i++)
+      for (j = 0; j < 9; j++)
+        if (j != 4)
+          _draw_text(osd, string, x + (j / 3 - 1) * i,
+                    y + (j % 3 - 1) * i);
+  }
+  if (1) {
+    osd->backend->set_colour(osd, osd->pixel);
+    _draw_text(osd, string, x, y);
+  }
+}
+
 static void
 draw_text(xosd * osd, int line)
 {
   int x = XOFFSET, y = osd->line_height * line - osd->extent->y;
   struct xosd_text *l = &osd->lines[line].text;
+  const char *string = TEXT_STRING(l);
 
   assert(osd);
   FUNCTION_START(Dfunction);
 
-  if (l->string != NULL) {
-    
-    if (l->width < 0) {
-      XRectangle rect;
-      XmbTextExtents(osd->fontset, l->string, strlen(l->string), NULL, &rect);
-      l->width = rect.width;
-    }
+  if (*string != '\0') {
+    string = _fit_text(osd, l);
 
     switch (osd->align) {
     case XOSD_center:
@@ -221,431 +619,920 @@ draw_text(xosd * osd, int line)
     case XOSD_left:
       break;
     }
-
-    if (osd->shadow_offset) {
-      XSetForeground(osd->display, osd->gc, osd->shadow_pixel);
-      if (osd->shadow_direction) {
-        switch(osd->shadow_direction) {
-          case 0:
-            _draw_text(osd, l->string, x, y - osd->shadow_offset);
-            break;
-          case 1:
-            _draw_text(osd, l->string, x + osd->shadow_offset, y - osd->shadow_offset);
-            break;
-          case 2:
-            _draw_text(osd, l->string, x + osd->shadow_offset, y);
-            break;
-          case 3:
-            _draw_text(osd, l->string, x + osd->shadow_offset, y + osd->shadow_offset);
-            break;
-          case 4:
-            _draw_text(osd, l->string, x, y + osd->shadow_offset);
-            break;
-          case 5:
-            _draw_text(osd, l->string, x - osd->shadow_offset, y + osd->shadow_offset);
-            break;
-          case 6:
-            _draw_text(osd, l->string, x - osd->shadow_offset, y);
-            break;
-          case 7:
-            _draw_text(osd, l->string, x - osd->shadow_offset, y - osd->shadow_offset);
-            break;
-          default:
-            //_draw_text(osd, l->string, x + osd->shadow_offset, y + osd->shadow_offset);
-            break;
-        }
-      } else {
-        _draw_text(osd, l->string, x +osd->shadow_offset, y + osd->shadow_offset);
-      }
-    }
-    if (osd->outline_offset) {
-      int i, j;
-      XSetForeground(osd->display, osd->gc, osd->outline_pixel);
-      /* FIXME: echo . | osd_cat -O 50 -p middle -A center */
-      for (i = 1; i <= osd->outline_offset; i++)
-        for (j = 0; j < 9; j++)
-          if (j != 4)
-            _draw_text(osd, l->string, x + (j / 3 - 1) * i,
-                      y + (j % 3 - 1) * i);
-    }
-    if (1) {
-      XSetForeground(osd->display, osd->gc, osd->pixel);
-      _draw_text(osd, l->string, x, y);
-    }
+    _draw_string(osd, string, x, y);
   }
 }
 
 /* }}} */
 
-/* Handles X11 events, timeouts and does the drawing. {{{
- * This is running in it's own thread for Expose-events.
- * The order of update handling is important:
- * 1. The size must be correct -> UPD_size first
- * 2. Change the position, which might expose part of window -> UPD_pos
- * 3. The XShape must be set before something is drawn -> UPD_mask, UPD_lines
- * 4. The window should be mapped before something is drawn -> UPD_show
- * 5. Start the timer last to not account for processing time -> UPD_timer
- * If you change this order, you'll get a broken display. You've been warned!
- */
-static void *
-event_loop(void *osdv)
+/* Tickers. {{{
+ * A ticker line moves its text through the line from right to left, and
+ * once it left at the left edge it enters at the right edge again. Shadow,
+ * outline and text are drawn only once, into a strip of the backend, and a
+ * move copies the part of the strip inside the line, so it costs the same
+ * whatever the font. */
+
+/* Width of the strip of a ticker. */
+static int
+_strip_width(xosd * osd, struct xosd_text *l)
+{
+  int width;
+
+  if (l->width < 0)
+    l->width = osd->backend->text_width(osd, TEXT_STRING(l));
+  width = l->width + 2 * (osd->outline_offset + osd->shadow_offset);
+  return width < TICKER_WIDTH_MAX ? width : TICKER_WIDTH_MAX;
+}
+
+/* Draw a ticker into a new strip. Out of memory leaves it without one,
+ * and nothing is shown. */
+static void
+_render_ticker(xosd * osd, struct xosd_text *l)
 {
-  xosd *osd = osdv;
-  int xfd, max;
+  int margin = osd->outline_offset + osd->shadow_offset;
 
   FUNCTION_START(Dfunction);
-  DEBUG(Dtrace, "event thread started");
-  assert(osd);
+  if (l->strip != NULL)
+    osd->backend->strip_free(osd, l->strip);
+  if ((l->strip = osd->backend->strip_begin(osd, _strip_width(osd, l)))
+      == NULL)
+    return;
+  osd->backend->set_clip(osd, NULL);
+  _draw_string(osd, TEXT_STRING(l), margin, -osd->extent->y);
+  osd->backend->strip_end(osd, l->strip);
+  FUNCTION_END(Dfunction);
+}
 
-  xfd = ConnectionNumber(osd->display);
-  max = (osd->pipefd[0] > xfd) ? osd->pipefd[0] : xfd;
+/* Copy the part of the strip of a ticker which is inside its line. With
+ * partial set the line is cleared first and its shape and damage updated,
+ * otherwise the caller has cleared it and does that. */
+static void
+draw_ticker(xosd * osd, int line, int partial)
+{
+  struct xosd_text *l = &osd->lines[line].text;
+  int width, x, right;
+  XRectangle r, dst;
 
-  pthread_mutex_lock(&osd->mutex);
-  DEBUG(Dtrace, "Request exposure events");
-  XSelectInput(osd->display, osd->window, ExposureMask);
-  osd->update |= UPD_size | UPD_pos | UPD_mask;
-  while (!osd->done) {
-    int retval, line;
-    fd_set readfds;
-    struct timeval tv, *tvp = NULL;
-
-    FD_ZERO(&readfds);
-    FD_SET(xfd, &readfds);
-    FD_SET(osd->pipefd[0], &readfds);
-
-    /* Hide display requested. */
-    if (osd->update & UPD_hide) {
-      DEBUG(Dupdate, "UPD_hide");
-      if (osd->generation & 1) {
-        XUnmapWindow(osd->display, osd->window);
-        osd->generation++;
-      }
-    }
-    /* The font, outline or shadow was changed. Recalculate line height,
-     * resize window and bitmaps. */
-    if (osd->update & UPD_size) {
-      XFontSetExtents *extents = XExtentsOfFontSet(osd->fontset);
-      DEBUG(Dupdate, "UPD_size");
-      osd->extent = &extents->max_logical_extent;
-      osd->line_height = osd->extent->height + osd->shadow_offset + 2 *
-        osd->outline_offset;
-      osd->height = osd->line_height * osd->number_lines;
-      for (line = 0; line < osd->number_lines; line++)
-        if (osd->lines[line].type == LINE_text)
-          osd->lines[line].text.width = -1;
-
-      XResizeWindow(osd->display, osd->window, osd->screen_width,
-                    osd->height);
-      XFreePixmap(osd->display, osd->mask_bitmap);
-      osd->mask_bitmap = XCreatePixmap(osd->display, osd->window,
-                                       osd->screen_width, osd->height, 1);
-      XFreePixmap(osd->display, osd->line_bitmap);
-      osd->line_bitmap = XCreatePixmap(osd->display, osd->window,
-                                       osd->screen_width, osd->height,
-                                       osd->depth);
-    }
-    /* H/V offset or vertical positon was changed. Horizontal alignment is
-     * handles internally as line realignment with UPD_content. */
-    if (osd->update & UPD_pos) {
-      int x = 0, y = 0;
-      DEBUG(Dupdate, "UPD_pos");
-      switch (osd->align) {
-      case XOSD_left:
-      case XOSD_center:
-        x = osd->screen_xpos + osd->hoffset;
-        break;
-      case XOSD_right:
-        x = osd->screen_xpos - osd->hoffset;
-      }
-      switch (osd->pos) {
-      case XOSD_bottom:
-        y = osd->screen_height - osd->height - osd->voffset;
-        break;
-      case XOSD_middle:
-        y = (osd->screen_height - osd->height) / 2 - osd->voffset;
-        break;
-      case XOSD_top:
-        y = osd->voffset;
-      }
-      XMoveWindow(osd->display, osd->window, x, y);
-    }
-    /* If the content changed, redraw lines in background buffer.
-     * Also update XShape unless only colours were changed. */
-    if (osd->update & (UPD_mask | UPD_lines)) {
-      DEBUG(Dupdate, "UPD_lines");
-      for (line = 0; line < osd->number_lines; line++) {
-        int y = osd->line_height * line;
-#ifdef DEBUG_XSHAPE
-        XSetForeground(osd->display, osd->gc, osd->outline_pixel);
-        XFillRectangle(osd->display, osd->line_bitmap, osd->gc, 0,
-                       y, osd->screen_width, osd->line_height);
-#endif
-        if (osd->update & UPD_mask) {
-          XFillRectangle(osd->display, osd->mask_bitmap, osd->mask_gc_back, 0,
-                         y, osd->screen_width, osd->line_height);
-        }
-        switch (osd->lines[line].type) {
-        case LINE_text:
-          draw_text(osd, line);
-          break;
-        case LINE_percentage:
-        case LINE_slider:
-          draw_bar(osd, line);
-        case LINE_blank:
-          break;
-        }
-      }
+  FUNCTION_START(Dfunction);
+  if (l->strip == NULL || (osd->update & UPD_strips))
+    _render_ticker(osd, l);
+  r.x = 0;
+  r.y = osd->line_height * line;
+  r.width = osd->screen_width;
+  r.height = osd->line_height;
+  if (partial)
+    osd->backend->clear(osd, &r);
+
+  if (l->strip != NULL) {
+    width = _strip_width(osd, l);
+    l->pos %= osd->screen_width + width;
+    /* Where the strip starts, which enters at the right edge. */
+    x = osd->screen_width - l->pos;
+    right = (x + width < osd->screen_width) ? x + width : osd->screen_width;
+    dst = r;
+    dst.x = (x > 0) ? x : 0;
+    if (right > dst.x) {
+      dst.width = right - dst.x;
+      osd->backend->strip_copy(osd, l->strip, dst.x - x, &dst);
     }
+  }
+
+  if (partial) {
 #ifndef DEBUG_XSHAPE
-    /* More than colours was changed, also update XShape. */
-    if (osd->update & UPD_mask) {
-      DEBUG(Dupdate, "UPD_mask");
-      XShapeCombineMask(osd->display, osd->window, ShapeBounding, 0, 0,
-                        osd->mask_bitmap, ShapeSet);
-    }
+    osd->backend->shape(osd, &r);
 #endif
-    /* Show display requested. */
-    if (osd->update & UPD_show) {
-      DEBUG(Dupdate, "UPD_show");
-      if (~osd->generation & 1) {
-        osd->generation++;
-        XMapRaised(osd->display, osd->window);
-      }
-    }
-    /* Copy content, if window was changed or exposed. */
-    if ((osd->generation & 1)
-        && osd->update & (UPD_size | UPD_pos | UPD_lines | UPD_show)) {
-      DEBUG(Dupdate, "UPD_copy");
-      XCopyArea(osd->display, osd->line_bitmap, osd->window, osd->gc, 0, 0,
-                osd->screen_width, osd->height, 0, 0);
-    }
-    /* Flush all pennding X11 requests, if any. */
-    if (osd->update & ~UPD_timer) {
-      XFlush(osd->display);
-      osd->update &= UPD_timer;
-    }
-    /* Restart the timer when requested. */
-    if (osd->update & UPD_timer) {
-      DEBUG(Dupdate, "UPD_timer");
-      osd->update = UPD_none;
-      if ((osd->generation & 1) && (osd->timeout > 0))
-        gettimeofday(&osd->timeout_start, NULL);
-      else
-        timerclear(&osd->timeout_start);
-    }
-    /* Calculate timeout delta or hide display. */
-    if (timerisset(&osd->timeout_start)) {
-      gettimeofday(&tv, NULL);
-      tv.tv_sec -= osd->timeout;
-      if (timercmp(&tv, &osd->timeout_start, <)) {
-        tv.tv_sec = osd->timeout_start.tv_sec - tv.tv_sec;
-        tv.tv_usec = osd->timeout_start.tv_usec - tv.tv_usec;
-        if (tv.tv_usec < 0) {
-          tv.tv_usec += 1000000;
-          tv.tv_sec -= 1;
-        }
-        tvp = &tv;
-      } else {
-        timerclear(&osd->timeout_start);
-        if (osd->generation & 1)
-          osd->update |= UPD_hide;
-        continue;               /* Hide the window first and than restart the loop */
-      }
-    }
-
-    /* Signal update */
-    pthread_mutex_lock(&osd->mutex_sync);
-    pthread_cond_broadcast(&osd->cond_sync);
-    pthread_mutex_unlock(&osd->mutex_sync);
-
-    /* Wait for the next X11 event or an API request via the pipe. */
-    retval = select(max + 1, &readfds, NULL, NULL, tvp);
-    DEBUG(Dvalue, "SELECT=%d PIPE=%d X11=%d", retval,
-          FD_ISSET(osd->pipefd[0], &readfds), FD_ISSET(xfd, &readfds));
+    _add_damage(osd, &r);
+  }
+  FUNCTION_END(Dfunction);
+}
 
-    if (retval == -1 && errno == EINTR) {
-      DEBUG(Dselect, "select() EINTR");
-      continue;
-    } else if (retval == -1) {
-      DEBUG(Dselect, "select() error %d", errno);
-      osd->done = 1;
+/* Move the tickers by the pixels due since they last moved, and have them
+ * redrawn with UPD_ticker. The rest of a pixel is kept for the next move,
+ * so they go at their speed however late the event loop wakes up. Returns
+ * the microseconds until they move next, 0 if there is no ticker shown. */
+static long
+_move_tickers(xosd * osd)
+{
+  struct timeval now;
+  long interval, elapsed, used, pixels, wait;
+  int line, shown;
+
+  shown = ((osd->generation & 1) || (osd->update & UPD_show)) &&
+    !(osd->update & UPD_hide) && osd->ticker_speed > 0;
+  for (line = 0; shown && line < osd->number_lines; line++)
+    if (osd->lines[line].type == LINE_ticker)
       break;
-    } else if (retval == 0) {
-      DEBUG(Dselect, "select() timeout");
-      continue;                 /* timeout */
-    } else if (FD_ISSET(osd->pipefd[0], &readfds)) {
-      /* Another thread wants to use the X11 connection */
-      pthread_cond_wait(&osd->cond_wait, &osd->mutex);
-      DEBUG(Dselect, "Resume exposure thread after X11 call");
-      continue;
-    } else if (FD_ISSET(xfd, &readfds)) {
-      XEvent report;
-      /* There is a event, but it might not be an Exposure-event, so don't use
-       * XWindowEvent(), since that might block. */
-      XNextEvent(osd->display, &report);
-      /* ignore sent by server/manual send flag */
-      switch (report.type & 0x7f) {
-      case Expose:
-        {
-          XExposeEvent *XE = &report.xexpose;
-          /* http://x.holovko.ru/Xlib/chap10.html#10.9.1 */
-          DEBUG(Dvalue, "expose %d: x=%d y=%d w=%d h=%d", XE->count,
-                XE->x, XE->y, XE->width, XE->height);
-#if 0
-          if (report.xexpose.count == 0) {
-            int ytop, ybot;
-            ytop = report.xexpose.y / osd->line_height;
-            ybot =
-              (report.xexpose.y + report.xexpose.height) / osd->line_height;
-            do {
-              osd->lines[ytop].width = -1;
-            } while (ytop++ < ybot);
-          }
-#endif
-          XCopyArea(osd->display, osd->line_bitmap, osd->window, osd->gc,
-                    report.xexpose.x, report.xexpose.y, report.xexpose.width,
-                    report.xexpose.height, report.xexpose.x, report.xexpose.y);
-          break;
-        }
-      case GraphicsExpose:
-        {
-          XGraphicsExposeEvent *XE = &report.xgraphicsexpose;
-          DEBUG(Dvalue, "gfxexpose %d: x=%d y=%d w=%d h=%d code=%d",
-                XE->count, XE->x, XE->y, XE->width, XE->height, XE->major_code);
-          break;
-        }
-      case NoExpose:
-        {
-          XNoExposeEvent *XE = &report.xnoexpose;
-          DEBUG(Dvalue, "noexpose: code=%d", XE->major_code);
-          break;
-        }
-      default:
-        DEBUG(Dvalue, "XEvent=%d", report.type);
-        break;
-      }
-      continue;
-    } else {
-      DEBUG(Dselect, "select() FATAL %d", retval);
-      exit(-1);                 /* Impossible */
-    }
+  if (!shown || line == osd->number_lines) {
+    timerclear(&osd->ticker_last);
+    return 0;
   }
-  pthread_mutex_unlock(&osd->mutex);
 
-  return NULL;
+  interval = 1000000L / osd->ticker_speed;
+  if (interval < 1000000L / TICKER_FPS)
+    interval = 1000000L / TICKER_FPS;
+  gettimeofday(&now, NULL);
+  elapsed = (now.tv_sec - osd->ticker_last.tv_sec) * 1000000L +
+    now.tv_usec - osd->ticker_last.tv_usec;
+  /* Just shown, or the clock went back. */
+  if (!timerisset(&osd->ticker_last) || elapsed < 0) {
+    osd->ticker_last = now;
+    return interval;
+  }
+  if (elapsed < interval)
+    return interval - elapsed;
+
+  pixels = (long long) elapsed * osd->ticker_speed / 1000000;
+  used = (long long) pixels * 1000000 / osd->ticker_speed;
+  osd->ticker_last.tv_usec += used % 1000000;
+  osd->ticker_last.tv_sec += used / 1000000 + osd->ticker_last.tv_usec /
+    1000000;
+  osd->ticker_last.tv_usec %= 1000000;
+  for (; line < osd->number_lines; line++)
+    if (osd->lines[line].type == LINE_ticker) {
+      struct xosd_text *l = &osd->lines[line].text;
+      l->pos = (l->pos + pixels) % (osd->screen_width +
+                                    _strip_width(osd, l));
+    }
+  osd->update |= UPD_ticker;
+  wait = interval - (elapsed - used);
+  return wait > 0 ? wait : 1;
 }
 
-/* }}} */
-
-/* Parse textual colour value. {{{ */
-static int
-parse_colour(xosd * osd, XColor * col, unsigned long *pixel,
-             const char *colour)
+/* Free the strips of all tickers, before the backend closes. */
+static void
+_free_strips(xosd * osd)
 {
-  Colormap colourmap;
-  int retval = 0;
+  int line;
 
-  FUNCTION_START(Dfunction);
-  DEBUG(Dtrace, "getting colourmap");
-  colourmap = DefaultColormap(osd->display, osd->screen);
-
-  DEBUG(Dtrace, "parsing colour");
-  if (XParseColor(osd->display, colourmap, colour, col)) {
-    DEBUG(Dtrace, "attempting to allocate colour");
-    if (XAllocColor(osd->display, colourmap, col)) {
-      DEBUG(Dtrace, "allocation sucessful");
-      *pixel = col->pixel;
-    } else {
-      DEBUG(Dtrace, "defaulting to white. could not allocate colour");
-      *pixel = WhitePixel(osd->display, osd->screen);
-      retval = -1;
+  for (line = 0; line < osd->number_lines; line++)
+    if (osd->lines[line].type == LINE_ticker &&
+        osd->lines[line].text.strip != NULL) {
+      osd->backend->strip_free(osd, osd->lines[line].text.strip);
+      osd->lines[line].text.strip = NULL;
     }
-  } else {
-    DEBUG(Dtrace, "could not poarse colour. defaulting to white");
-    *pixel = WhitePixel(osd->display, osd->screen);
-    retval = -1;
-  }
-
-  return retval;
 }
 
 /* }}} */
 
-/* Tell window manager to put window topmost. {{{ */
-void
-stay_on_top(Display * dpy, Window win)
+/* Line contents. {{{
+ * A text line longer than XOSD_LINE_SMALL owns a buffer of osd->arena.
+ * New texts are stored in place while they fit, and the buffer goes back
+ * to the arena when the line stops being text, so lines are only ever
+ * moved, never copied by value with their buffer. */
+
+/* Give back the buffers of l, if it has any. */
+static void
+_line_release(xosd * osd, union xosd_line *l)
+{
+  if (LINE_HAS_TEXT(l->type) && l->text.size) {
+    _xosd_arena_put(&osd->arena, l->text.buf, l->text.size);
+    l->text.size = 0;
+  }
+  if (LINE_HAS_TEXT(l->type) && l->text.fit_size) {
+    _xosd_arena_put(&osd->arena, l->text.fit, l->text.fit_size);
+    l->text.fit_size = 0;
+  }
+  if (l->type == LINE_ticker && l->text.strip != NULL) {
+    osd->backend->strip_free(osd, l->text.strip);
+    l->text.strip = NULL;
+  }
+}
+
+/* Make l a line of type, text or ticker, with the len bytes at string.
+ * Returns -1 when out of memory, with l blank. */
+static int
+_line_set_text(xosd * osd, union xosd_line *l, enum LINE type,
+               const char *string, size_t len)
+{
+  struct xosd_text *t = &l->text;
+
+  if (!LINE_HAS_TEXT(l->type)) {
+    t->size = t->fit_size = 0;
+    t->strip = NULL;
+  } else if (t->strip != NULL) {
+    osd->backend->strip_free(osd, t->strip);
+    t->strip = NULL;
+  }
+  if (LINE_HAS_TEXT(l->type) && t->size && t->size <= len) {
+    _xosd_arena_put(&osd->arena, t->buf, t->size);
+    t->size = 0;
+  }
+  if (t->size == 0 && len >= XOSD_LINE_SMALL) {
+    t->size = len + 1;
+    if ((t->buf = _xosd_arena_get(&osd->arena, &t->size)) == NULL) {
+      xosd_error = "Out of memory";
+      t->size = 0;
+      _line_release(osd, l);
+      l->type = LINE_blank;
+      return -1;
+    }
+  }
+  memcpy(TEXT_STRING(t), string, len);
+  TEXT_STRING(t)[len] = '\0';
+  t->type = type;
+  t->width = -1;
+  t->nchars = -1;
+  t->cut = 0;
+  t->pos = 0;
+  return 0;
+}
+
+/* Make l show what newline does, whose text is copied. */
+static void
+_line_copy(xosd * osd, union xosd_line *l, const union xosd_line *newline)
+{
+  if (LINE_HAS_TEXT(newline->type))
+    _line_set_text(osd, l, newline->type, TEXT_STRING(&newline->text),
+                   strlen(TEXT_STRING(&newline->text)));
+  else {
+    _line_release(osd, l);
+    *l = *newline;
+  }
+}
+
+/* Break string at spaces into lines from line on, or only count them if
+ * set is 0. The last line takes the rest, which _fit_text() cuts. Must be
+ * called with the X11 lock held. Returns the number of lines, -1 when out
+ * of memory. */
+static int
+_wrap_text(xosd * osd, int line, const char *string, int set)
+{
+  struct xosd_extent *ext = NULL;
+  size_t size = 0;
+  int space = _text_space(osd), n, start = 0, end, brk, rows = 0;
+
+  if ((n = _measure(osd, string, &ext, &size, 0)) == -1)
+    return -1;
+  do {
+    end = n;
+    if (line + rows < osd->number_lines - 1 &&
+        ext[n].x - ext[start].x > space) {
+      end = _extent_find(ext, start, n, ext[start].x + space);
+      /* After the last word which fits, else wherever the line is full. */
+      for (brk = end; brk > start && (string[ext[brk].offset] != ' ' ||
+                                      string[ext[brk - 1].offset] == ' ');
+           brk--);
+      if (brk > start)
+        end = brk;
+      else if (end == start)
+        end = start + 1;
+    }
+    if (set) {
+      struct xosd_text *t = &osd->lines[line + rows].text;
+      if (_line_set_text(osd, &osd->lines[line + rows], LINE_text,
+                         string + ext[start].offset,
+                         ext[end].offset - ext[start].offset) == -1) {
+        rows = -1;
+        break;
+      }
+      /* Measured already, unless it needs cutting. */
+      if (ext[end].x - ext[start].x <= space) {
+        t->width = ext[end].x - ext[start].x;
+        t->space = space;
+      }
+    }
+    rows++;
+    for (start = end; start < n && string[ext[start].offset] == ' ';
+         start++);
+  } while (start < n);
+  _xosd_arena_put(&osd->arena, ext, size);
+  return rows;
+}
+
+/* Replace the content of a line.
+ * Must be called with the X11 lock held. Returns the updates needed to show
+ * the new content, and the number of lines it took in *rows unless rows is
+ * NULL. A bar replaced by the same kind of bar keeps its drawing cache, so
+ * only the difference gets repainted, and so does a ticker with its text
+ * unchanged. The text of newline may be a string
+ * of the caller, with buf and size set but not from the arena. */
+static int
+_set_line(xosd * osd, int line, const union xosd_line *newline, int *rows)
+{
+  union xosd_line *l = &osd->lines[line];
+  int n;
+
+  if (rows != NULL)
+    *rows = 1;
+  if ((newline->type == LINE_percentage || newline->type == LINE_slider)
+      && newline->type == l->type && l->bar.on >= 0) {
+    l->bar.value = newline->bar.value;
+    return UPD_bars | UPD_timer | UPD_show;
+  }
+  /* The same ticker again goes on moving. */
+  if (newline->type == LINE_ticker && l->type == LINE_ticker &&
+      strcmp(TEXT_STRING(&newline->text), TEXT_STRING(&l->text)) == 0)
+    return UPD_timer | UPD_show;
+  if (newline->type == LINE_text && osd->layout == XOSD_layout_wrap &&
+      (n = _wrap_text(osd, line, TEXT_STRING(&newline->text), 1)) > 0) {
+    if (rows != NULL)
+      *rows = n;
+    return UPD_content | UPD_timer | UPD_show;
+  }
+  _line_copy(osd, l, newline);
+  return UPD_content | UPD_timer | UPD_show;
+}
+
+/* }}} */
+
+/* Coalesce updates to the frame rate. {{{
+ * With a frame interval set, lines passed to xosd_display() sooner than one
+ * interval after the last drawn frame are only parked in osd->pending. Newer
+ * values for the same line replace older ones, which are counted as dropped.
+ * The event thread moves them into place once the interval has elapsed, so
+ * the producer neither waits for the X11 lock nor for the window to map. */
+
+/* Microseconds until the next frame may be drawn, 0 if it is due. */
+static long
+_frame_wait(xosd * osd, struct timeval *now)
+{
+  long wait = osd->frame_interval -
+    ((now->tv_sec - osd->last_frame.tv_sec) * 1000000L +
+     (now->tv_usec - osd->last_frame.tv_usec));
+  return (wait > 0 && wait <= osd->frame_interval) ? wait : 0;
+}
+
+/* Park a line for the next frame. Returns 0 if it has to be drawn now. */
+static int
+_queue_line(xosd * osd, int line, const union xosd_line *newline)
+{
+  struct xosd_pending *p = &osd->pending[line];
+  struct timeval now;
+  int queued = 0, kick = 0;
+
+  gettimeofday(&now, NULL);
+  pthread_mutex_lock(&osd->mutex_pending);
+  if (osd->frame_interval && (osd->npending || _frame_wait(osd, &now))) {
+    if (p->set)
+      osd->dropped++;
+    else {
+      p->set = 1;
+      kick = (osd->npending++ == 0);
+    }
+    /* Into the buffer of the line it replaces, if it has one. */
+    _line_copy(osd, &p->line, newline);
+    queued = 1;
+  }
+  pthread_mutex_unlock(&osd->mutex_pending);
+
+  /* First line of a frame: make the event thread arm its frame timer. */
+  if (kick) {
+    _xosd_lock(osd);
+    _xosd_unlock(osd);
+  }
+  return queued;
+}
+
+/* Move parked lines into place, if their frame is due or force is set.
+ * Must be called with the X11 lock held. Returns the microseconds until
+ * the remaining lines are due, 0 if none are left. */
+static long
+_apply_pending(xosd * osd, int force)
+{
+  struct timeval now;
+  long wait = 0;
+  int line;
+
+  pthread_mutex_lock(&osd->mutex_pending);
+  if (osd->npending) {
+    gettimeofday(&now, NULL);
+    if (force || (wait = _frame_wait(osd, &now)) == 0) {
+      DEBUG(Dupdate, "applying %d pending lines", osd->npending);
+      for (line = 0; line < osd->number_lines; line++)
+        if (osd->pending[line].set) {
+          osd->update |= _set_line(osd, line, &osd->pending[line].line,
+                                   NULL);
+          osd->pending[line].set = 0;
+        }
+      osd->npending = 0;
+    }
+  }
+  pthread_mutex_unlock(&osd->mutex_pending);
+  return wait;
+}
+
+/* }}} */
+
+/* Posted messages. {{{
+ * xosd_post() only sorts a message into osd->queue and writes a byte to the
+ * non-blocking kick pipe, so producers never wait for the X11 lock. The
+ * event thread shows the head of the queue once the shown message had its
+ * min_time on screen, at once if the head has a higher priority. Messages
+ * with the same key, or without a key the same content, replace each other,
+ * in the queue as well as on the screen. */
+
+/* Give the lines and key of m back to the arena. */
+static void
+_message_free(xosd * osd, struct xosd_message *m)
+{
+  int line;
+
+  if (m->lines != NULL) {
+    for (line = 0; line < m->nlines; line++)
+      _line_release(osd, &m->lines[line]);
+    _xosd_arena_put(&osd->arena, m->lines, m->size);
+  }
+  m->nlines = 0;
+  m->lines = NULL;
+  m->key = NULL;
+}
+
+/* Whether b supersedes a. */
+static int
+_message_same(const struct xosd_message *a, const struct xosd_message *b)
+{
+  int line;
+
+  if (a->key != NULL || b->key != NULL)
+    return a->key != NULL && b->key != NULL && strcmp(a->key, b->key) == 0;
+  if (a->nlines != b->nlines)
+    return 0;
+  for (line = 0; line < a->nlines; line++) {
+    const union xosd_line *l = &a->lines[line], *m = &b->lines[line];
+    if (l->type != m->type)
+      return 0;
+    if (LINE_HAS_TEXT(l->type) &&
+        strcmp(TEXT_STRING(&l->text), TEXT_STRING(&m->text)) != 0)
+      return 0;
+    if ((l->type == LINE_percentage || l->type == LINE_slider) &&
+        l->bar.value != m->bar.value)
+      return 0;
+  }
+  return 1;
+}
+
+/* Sort m into the queue, replacing a message it supersedes. When the queue
+ * is full, the newest of the lowest priority goes, which may be m. Must be
+ * called holding mutex_queue. Returns the number of messages dropped. */
+static int
+_queue_message(xosd * osd, struct xosd_message *m)
+{
+  int i, dropped = 0;
+
+  for (i = 0; i < osd->nqueued; i++)
+    if (_message_same(&osd->queue[i], m)) {
+      /* Take the place of the old one, not its priority. */
+      m->seq = osd->queue[i].seq;
+      _message_free(osd, &osd->queue[i]);
+      memmove(&osd->queue[i], &osd->queue[i + 1],
+              (osd->nqueued - i - 1) * sizeof(struct xosd_message));
+      osd->nqueued--;
+      dropped++;
+      break;
+    }
+  if (osd->nqueued == XOSD_QUEUE_MAX) {
+    struct xosd_message *last = &osd->queue[XOSD_QUEUE_MAX - 1];
+    if (last->priority >= m->priority) {
+      _message_free(osd, m);
+      return dropped + 1;
+    }
+    _message_free(osd, last);
+    osd->nqueued--;
+    dropped++;
+  }
+  for (i = osd->nqueued; i > 0; i--) {
+    struct xosd_message *q = &osd->queue[i - 1];
+    if (q->priority > m->priority ||
+        (q->priority == m->priority && q->seq < m->seq))
+      break;
+    osd->queue[i] = *q;
+  }
+  osd->queue[i] = *m;
+  osd->nqueued++;
+  return dropped;
+}
+
+/* Copy the lines of m on the screen, m is kept in osd->shown. Wrapped
+ * lines push the following ones down, off the screen at its end. Must be
+ * called with the X11 lock held. */
+static void
+_show_message(xosd * osd, struct xosd_message *m)
+{
+  union xosd_line blank = { type:LINE_blank };
+  int line, row, rows;
+
+  for (line = 0, row = 0; row < osd->number_lines; line++, row += rows)
+    osd->update |= _set_line(osd, row, line < m->nlines ? &m->lines[line]
+                             : &blank, &rows);
+  osd->update &= ~UPD_hide;
+}
+
+/* Show what is due. Must be called with the X11 lock held. Returns the
+ * microseconds until the head of the queue is due, 0 if none waits. */
+static long
+_apply_queue(xosd * osd)
+{
+  struct xosd_message *head = &osd->queue[0];
+  struct timeval now;
+  long wait = 0, shown_for;
+  int i;
+
+  /* The shown message was hidden. */
+  if (osd->shown.nlines && (~osd->generation & 1) &&
+      !(osd->update & UPD_show))
+    _message_free(osd, &osd->shown);
+
+  pthread_mutex_lock(&osd->mutex_queue);
+  /* Newer values of the shown message are shown at once. */
+  for (i = 0; osd->shown.nlines && i < osd->nqueued; i++)
+    if (_message_same(&osd->shown, &osd->queue[i])) {
+      DEBUG(Dupdate, "updating shown message");
+      _message_free(osd, &osd->shown);
+      osd->shown = osd->queue[i];
+      memmove(&osd->queue[i], &osd->queue[i + 1],
+              (osd->nqueued - i - 1) * sizeof(struct xosd_message));
+      osd->nqueued--;
+      _show_message(osd, &osd->shown);
+      break;
+    }
+  if (osd->nqueued) {
+    gettimeofday(&now, NULL);
+    shown_for = (now.tv_sec - osd->shown_at.tv_sec) * 1000000L +
+      (now.tv_usec - osd->shown_at.tv_usec);
+    if (osd->shown.nlines == 0 || head->priority > osd->shown.priority ||
+        shown_for >= osd->min_time * 1000L || shown_for < 0) {
+      DEBUG(Dupdate, "showing message, %d queued", osd->nqueued - 1);
+      _message_free(osd, &osd->shown);
+      osd->shown = *head;
+      memmove(&osd->queue[0], &osd->queue[1],
+              (osd->nqueued - 1) * sizeof(struct xosd_message));
+      osd->nqueued--;
+      osd->shown_at = now;
+      _show_message(osd, &osd->shown);
+      if (osd->nqueued)
+        wait = osd->min_time > 0 ? osd->min_time * 1000L : 1;
+    } else
+      wait = osd->min_time * 1000L - shown_for;
+  }
+  pthread_mutex_unlock(&osd->mutex_queue);
+  return wait;
+}
+
+/* }}} */
+
+/* Bring one object up to date. {{{
+ * The order of update handling is important:
+ * 1. The size must be correct -> UPD_size first
+ * 2. Change the position, which might expose part of window -> UPD_pos
+ * 3. The XShape must be set before something is drawn -> UPD_mask, UPD_lines
+ * 4. The window should be mapped before something is drawn -> UPD_show
+ * 5. Start the timer last to not account for processing time -> UPD_timer
+ * If you change this order, you'll get a broken display. You've been warned!
+ * Returns the microseconds until it needs this again, -1 for not before the
+ * next request or event.
+ */
+static long
+_update(xosd * osd)
+{
+  int line, mapped;
+  long frame_wait, queue_wait, ticker_wait, wait = -1;
+  struct timeval tv, phase;
+  XRectangle all;
+
+  TRACE_BEGIN("update");
+  /* Take over coalesced lines whose frame is due, and posted messages. */
+  frame_wait = _apply_pending(osd, 0);
+  queue_wait = _apply_queue(osd);
+  ticker_wait = _move_tickers(osd);
+  if (osd->stats.timing)
+    gettimeofday(&phase, NULL);
+
+  /* Hide display requested. */
+  if (osd->update & UPD_hide) {
+    DEBUG(Dupdate, "UPD_hide");
+    TRACE_BEGIN("UPD_hide");
+    if (osd->generation & 1) {
+      osd->backend->show(osd, 0);
+      _next_generation(osd, osd->timed_out ? XOSD_event_timeout
+                       : XOSD_event_hidden);
+      osd->stats.hides++;
+    }
+    PHASE_END(osd, &phase, XOSD_phase_hide);
+  }
+  osd->timed_out = 0;
+  /* The font, outline or shadow was changed. Recalculate line height,
+   * resize window and bitmaps. */
+  if (osd->update & UPD_size) {
+    DEBUG(Dupdate, "UPD_size");
+    TRACE_BEGIN("UPD_size");
+    osd->extent = osd->backend->font_extent(osd);
+    osd->line_height = osd->extent->height + osd->shadow_offset + 2 *
+      osd->outline_offset;
+    osd->height = osd->line_height * osd->number_lines;
+    for (line = 0; line < osd->number_lines; line++)
+      if (LINE_HAS_TEXT(osd->lines[line].type))
+        osd->lines[line].text.width = -1;
+
+    osd->backend->resize(osd);
+    PHASE_END(osd, &phase, XOSD_phase_size);
+  }
+  /* H/V offset or vertical positon was changed. Horizontal alignment is
+   * handles internally as line realignment with UPD_content. */
+  if (osd->update & UPD_pos) {
+    int x = 0, y = 0;
+    DEBUG(Dupdate, "UPD_pos");
+    TRACE_BEGIN("UPD_pos");
+    switch (osd->align) {
+    case XOSD_left:
+    case XOSD_center:
+      x = osd->screen_xpos + osd->hoffset;
+      break;
+    case XOSD_right:
+      x = osd->screen_xpos - osd->hoffset;
+    }
+    switch (osd->pos) {
+    case XOSD_bottom:
+      y = osd->screen_ypos + osd->screen_height - osd->height -
+        osd->voffset;
+      break;
+    case XOSD_middle:
+      y = osd->screen_ypos + (osd->screen_height - osd->height) / 2 -
+        osd->voffset;
+      break;
+    case XOSD_top:
+      y = osd->screen_ypos + osd->voffset;
+    }
+    osd->backend->move(osd, x, y);
+    PHASE_END(osd, &phase, XOSD_phase_pos);
+  }
+  /* If the content changed, redraw lines in background buffer.
+   * Also update XShape unless only colours were changed. */
+  if (osd->update & (UPD_mask | UPD_lines)) {
+    DEBUG(Dupdate, "UPD_lines");
+    TRACE_BEGIN("UPD_lines");
+    for (line = 0; line < osd->number_lines; line++) {
+      XRectangle r;
+      r.x = 0;
+      r.y = osd->line_height * line;
+      r.width = osd->screen_width;
+      r.height = osd->line_height;
+#ifdef DEBUG_XSHAPE
+      osd->backend->set_colour(osd, osd->outline_pixel);
+      osd->backend->fill_rects(osd, &r, 1);
+#endif
+      if (osd->update & UPD_mask)
+        osd->backend->clear(osd, &r);
+      switch (osd->lines[line].type) {
+      case LINE_text:
+        draw_text(osd, line);
+        break;
+      case LINE_ticker:
+        /* It may have moved, so its shape changes with the colours too. */
+        draw_ticker(osd, line, !(osd->update & UPD_mask));
+        break;
+      case LINE_percentage:
+      case LINE_slider:
+        draw_bar(osd, line, 0);
+      case LINE_blank:
+        break;
+      }
+    }
+    PHASE_END(osd, &phase, XOSD_phase_lines);
+  } else if (osd->update & (UPD_bars | UPD_ticker)) {
+    /* Only bar values changed or tickers moved, repaint the segments which
+     * flipped and the lines of the tickers. */
+    DEBUG(Dupdate, "UPD_bars");
+    TRACE_BEGIN("UPD_bars");
+    for (line = 0; line < osd->number_lines; line++)
+      if ((osd->lines[line].type == LINE_percentage ||
+           osd->lines[line].type == LINE_slider) &&
+          (osd->update & UPD_bars))
+        draw_bar(osd, line, 1);
+      else if (osd->lines[line].type == LINE_ticker &&
+               (osd->update & UPD_ticker))
+        draw_ticker(osd, line, 1);
+    PHASE_END(osd, &phase, XOSD_phase_bars);
+  }
+#ifndef DEBUG_XSHAPE
+  /* More than colours was changed, also update XShape. */
+  if (osd->update & UPD_mask) {
+    DEBUG(Dupdate, "UPD_mask");
+    TRACE_BEGIN("UPD_mask");
+    osd->backend->shape(osd, NULL);
+    PHASE_END(osd, &phase, XOSD_phase_mask);
+  }
+#endif
+  /* Show display requested. */
+  mapped = 0;
+  if (osd->update & UPD_show) {
+    DEBUG(Dupdate, "UPD_show");
+    TRACE_BEGIN("UPD_show");
+    if (~osd->generation & 1) {
+      _next_generation(osd, XOSD_event_shown);
+      osd->backend->show(osd, 1);
+      mapped = 1;
+      osd->stats.shows++;
+    }
+    PHASE_END(osd, &phase, XOSD_phase_show);
+  }
+  /* Copy content, if window was changed or exposed. */
+  if ((osd->generation & 1)
+      && (mapped || osd->update & (UPD_size | UPD_pos | UPD_lines))) {
+    DEBUG(Dupdate, "UPD_copy");
+    TRACE_BEGIN("UPD_copy");
+    all.x = all.y = 0;
+    all.width = osd->screen_width;
+    all.height = osd->height;
+    osd->backend->present(osd, &all);
+    PHASE_END(osd, &phase, XOSD_phase_copy);
+  } else if ((osd->generation & 1) && osd->damage.width) {
+    DEBUG(Dupdate, "UPD_copy %d+%d", osd->damage.x, osd->damage.width);
+    TRACE_BEGIN("UPD_copy");
+    osd->backend->present(osd, &osd->damage);
+    PHASE_END(osd, &phase, XOSD_phase_copy);
+  }
+  osd->damage.width = osd->damage.height = 0;
+  /* Flush all pennding X11 requests, if any. */
+  if (osd->update & ~UPD_timer) {
+    if (osd->frame_interval && osd->update & (UPD_lines | UPD_bars)) {
+      pthread_mutex_lock(&osd->mutex_pending);
+      gettimeofday(&osd->last_frame, NULL);
+      pthread_mutex_unlock(&osd->mutex_pending);
+    }
+    TRACE_BEGIN("flush");
+    osd->backend->flush(osd);
+    osd->stats.flushes++;
+    osd->update &= UPD_timer;
+    PHASE_END(osd, &phase, XOSD_phase_flush);
+    if (osd->stats.timing) {
+      pthread_mutex_lock(&osd->mutex_pending);
+      if (timerisset(&osd->display_time)) {
+        _stats_add(&osd->stats.display_to_flush,
+                   _stats_lap(&osd->display_time));
+        timerclear(&osd->display_time);
+      }
+      pthread_mutex_unlock(&osd->mutex_pending);
+    }
+  }
+  /* Restart the timer when requested. */
+  if (osd->update & UPD_timer) {
+    DEBUG(Dupdate, "UPD_timer");
+    osd->update = UPD_none;
+    if ((osd->generation & 1) && (osd->timeout > 0))
+      gettimeofday(&osd->timeout_start, NULL);
+    else
+      timerclear(&osd->timeout_start);
+  }
+  TRACE_END("update");
+  /* Calculate timeout delta or hide display. */
+  if (timerisset(&osd->timeout_start)) {
+    gettimeofday(&tv, NULL);
+    tv.tv_sec -= osd->timeout;
+    if (timercmp(&tv, &osd->timeout_start, <)) {
+      tv.tv_sec = osd->timeout_start.tv_sec - tv.tv_sec;
+      tv.tv_usec = osd->timeout_start.tv_usec - tv.tv_usec;
+      wait = tv.tv_sec * 1000000L + tv.tv_usec;
+    } else {
+      timerclear(&osd->timeout_start);
+      if (osd->generation & 1) {
+        osd->update |= UPD_hide;
+        osd->timed_out = 1;
+      }
+      return 0;               /* Hide the window first and than restart the loop */
+    }
+  }
+  /* Wake up for the next frame of pending lines, if that is earlier. */
+  if (frame_wait && (wait == -1 || frame_wait < wait))
+    wait = frame_wait;
+  /* And for the next posted message. */
+  if (queue_wait && (wait == -1 || queue_wait < wait))
+    wait = queue_wait;
+  /* And for the next move of the tickers. */
+  if (ticker_wait && (wait == -1 || ticker_wait < wait))
+    wait = ticker_wait;
+
+  /* Signal update */
+  pthread_mutex_lock(&osd->mutex_sync);
+  osd->passes++;
+  pthread_cond_broadcast(&osd->cond_sync);
+  pthread_mutex_unlock(&osd->mutex_sync);
+  return wait;
+}
+
+/* }}} */
+
+/* Update all objects of ctx, again while one needs it at once. Returns the
+ * microseconds until they need it again, -1 for not before the next request
+ * or event. */
+static long
+_update_all(struct xosd_context *ctx)
+{
+  long wait, w;
+  xosd *osd;
+
+  do {
+    wait = -1;
+    for (osd = ctx->objects; osd != NULL; osd = osd->next)
+      if ((w = _update(osd)) != -1 && (wait == -1 || w < wait))
+        wait = w;
+  } while (wait == 0);
+  return wait;
+}
+
+/* }}} */
+
+/* Handle the events of the backend, without blocking. {{{ */
+static void
+_handle_events(struct xosd_context *ctx)
+{
+  xosd *objects = ctx->objects;
+
+  while (objects->backend->pending(objects) > 0)
+    objects->backend->event(objects);
+}
+
+/* }}} */
+
+/* Handles X11 events, timeouts and does the drawing. {{{
+ * This is running in it's own thread for Expose-events, one for an object
+ * and all its clones.
+ */
+static void *
+event_loop(void *ctxv)
 {
-  Atom gnome, net_wm, type;
-  int format;
-  unsigned long nitems, bytesafter;
-  unsigned char *args = NULL;
-  Window root = DefaultRootWindow(dpy);
+  struct xosd_context *ctx = ctxv;
+  /* poll(), as select() fails with descriptors beyond FD_SETSIZE, which a
+   * few hundred objects reach. */
+  struct pollfd fds[3];
+  int nfds;
 
   FUNCTION_START(Dfunction);
-  /*
-   * build atoms 
-   */
-  gnome = XInternAtom(dpy, "_WIN_SUPPORTING_WM_CHECK", False);
-  net_wm = XInternAtom(dpy, "_NET_SUPPORTED", False);
-
-  /*
-   * gnome-compilant 
-   * tested with icewm + WindowMaker 
-   */
-  if (Success == XGetWindowProperty
-      (dpy, root, gnome, 0, (65536 / sizeof(long)), False,
-       AnyPropertyType, &type, &format, &nitems, &bytesafter, &args) &&
-      nitems > 0) {
-    /*
-     * FIXME: check capabilities 
-     */
-    XClientMessageEvent xev;
-    Atom gnome_layer = XInternAtom(dpy, "_WIN_LAYER", False);
-
-    memset(&xev, 0, sizeof(xev));
-    xev.type = ClientMessage;
-    xev.window = win;
-    xev.message_type = gnome_layer;
-    xev.format = 32;
-    xev.data.l[0] = 6 /* WIN_LAYER_ONTOP */ ;
-
-    XSendEvent(dpy, DefaultRootWindow(dpy), False, SubstructureNotifyMask,
-               (XEvent *) & xev);
-    XFree(args);
-  }
-  /*
-   * netwm compliant.
-   * tested with kde 
-   */
-  else if (Success == XGetWindowProperty
-           (dpy, root, net_wm, 0, (65536 / sizeof(long)), False,
-            AnyPropertyType, &type, &format, &nitems, &bytesafter, &args)
-           && nitems > 0) {
-    XEvent e;
-    Atom net_wm_state = XInternAtom(dpy, "_NET_WM_STATE", False);
-    Atom net_wm_top = XInternAtom(dpy, "_NET_WM_STATE_STAYS_ON_TOP", False);
-
-    memset(&e, 0, sizeof(e));
-    e.xclient.type = ClientMessage;
-    e.xclient.message_type = net_wm_state;
-    e.xclient.display = dpy;
-    e.xclient.window = win;
-    e.xclient.format = 32;
-    e.xclient.data.l[0] = 1 /* _NET_WM_STATE_ADD */ ;
-    e.xclient.data.l[1] = net_wm_top;
-    e.xclient.data.l[2] = 0l;
-    e.xclient.data.l[3] = 0l;
-    e.xclient.data.l[4] = 0l;
-
-    XSendEvent(dpy, DefaultRootWindow(dpy), False,
-               SubstructureRedirectMask, &e);
-    XFree(args);
-  }
-  XRaiseWindow(dpy, win);
+  DEBUG(Dtrace, "event thread started");
+  assert(ctx);
+  TRACE_THREAD("xosd event loop");
+
+  pthread_mutex_lock(&ctx->mutex);
+  fds[0].fd = ctx->pipefd[0];
+  fds[1].fd = ctx->kickfd[0];
+  /* xosd_destroy() may have been quicker than the thread start. */
+  fds[2].fd = ctx->done ? -1 : ctx->objects->backend->fd(ctx->objects);
+  fds[0].events = fds[1].events = fds[2].events = POLLIN;
+  nfds = fds[2].fd != -1 ? 3 : 2;
+  while (!ctx->done) {
+    int retval;
+    long wait;
+
+    wait = _update_all(ctx);
+    /* Events read along with a reply leave the socket quiet. */
+    if (nfds > 2 && ctx->objects->backend->pending(ctx->objects) > 0) {
+      TRACE_INSTANT("queued X11");
+      _handle_events(ctx);
+      continue;
+    }
+
+    /* Wait for the next X11 event or an API request via the pipes. */
+    TRACE_BEGIN("poll");
+    retval = poll(fds, nfds, wait == -1 ? -1 : (int) ((wait + 999) / 1000));
+    TRACE_END("poll");
+    DEBUG(Dvalue, "POLL=%d PIPE=%d X11=%d", retval,
+          fds[0].revents, nfds > 2 ? fds[2].revents : 0);
+
+    if (retval == -1 && errno == EINTR) {
+      DEBUG(Dselect, "poll() EINTR");
+      continue;
+    } else if (retval == -1) {
+      DEBUG(Dselect, "poll() error %d", errno);
+      ctx->done = 1;
+      break;
+    } else if (retval == 0) {
+      DEBUG(Dselect, "poll() timeout");
+      TRACE_INSTANT("wakeup timeout");
+      continue;                 /* timeout */
+    } else if (fds[0].revents) {
+      /* Another thread wants to use the X11 connection */
+      TRACE_INSTANT("wakeup pipe");
+      pthread_cond_wait(&ctx->cond_wait, &ctx->mutex);
+      DEBUG(Dselect, "Resume exposure thread after X11 call");
+      continue;
+    } else if (fds[1].revents) {
+      /* A message was posted, the next pass sorts it out. */
+      char buf[64];
+      TRACE_INSTANT("wakeup post");
+      while (read(ctx->kickfd[0], buf, sizeof(buf)) > 0);
+      continue;
+    } else if (nfds > 2 && fds[2].revents) {
+      TRACE_INSTANT("wakeup X11");
+      _handle_events(ctx);
+      continue;
+    } else {
+      DEBUG(Dselect, "poll() FATAL %d", retval);
+      exit(-1);                 /* Impossible */
+    }
+  }
+  pthread_mutex_unlock(&ctx->mutex);
+
+  return NULL;
 }
 
 /* }}} */
 
+static xosd *_xosd_create(const struct xosd_backend *backend,
+                          int number_lines, int width, int height,
+                          int threadless);
+static xosd *_xosd_alloc(const struct xosd_backend *backend,
+                         int number_lines, int width, int height);
+static void _xosd_free(xosd * osd);
+
 /* xosd_init -- Create a new xosd "object" {{{
  * Deprecated: Use xosd_create. */
 xosd *
@@ -676,13 +1563,31 @@ xosd_init(const char *font, const char *colour, int timeout, xosd_pos pos,
 
 /* }}} */
 
-/* xosd_ -- Create a new xosd "object" with the same attributes as the provided xosd "object" {{{ */
+/* xosd_ -- Create a new xosd "object" with the same attributes as the provided xosd "object" {{{
+ * The clone shares the event thread, the X11 connection and the font of its
+ * source and only gets a window and lines of its own. */
 xosd *
 xosd_clone(xosd * osd2)
 {
-  xosd *osd = xosd_create(osd2->number_lines);
+  xosd *osd;
+
+  FUNCTION_START(Dfunction);
+  if (osd2 == NULL)
+    return NULL;
+  TRACE_BEGIN("xosd_clone");
+  osd = _xosd_alloc(osd2->backend, osd2->number_lines,
+                    osd2->screen_width, osd2->screen_height);
+  if (osd == NULL) {
+    TRACE_END("xosd_clone");
+    return NULL;
+  }
+
+  _xosd_lock(osd2);
   osd->align = osd2->align;
   osd->bar_length = osd2->bar_length;
+  osd->layout = osd2->layout;
+  osd->ticker_speed = osd2->ticker_speed;
+  osd->show_wait = osd2->show_wait;
   osd->shadow_colour = osd2->shadow_colour;
   osd->shadow_pixel = osd2->shadow_pixel;
 /* Copying original lines to the cloned xosd instance causes unintuitive behaviour
@@ -700,68 +1605,109 @@ xosd_clone(xosd * osd2)
   osd->screen_height = osd2->screen_height;
   osd->screen_width = osd2->screen_width;
   osd->screen_xpos = osd2->screen_xpos;
+  osd->screen_ypos = osd2->screen_ypos;
   osd->nscreens = osd2->nscreens;
+  osd->monitor = osd2->monitor;
+  osd->mirror = osd2->mirror;
+  osd->min_time = osd2->min_time;
+  osd->line_height = osd2->line_height;
+  osd->height = osd->line_height * osd->number_lines;
+
+  osd->ctx = osd2->ctx;
+  if (osd->backend->clone(osd, osd2) == -1) {
+    _xosd_unlock(osd2);
+    _xosd_free(osd);
+    TRACE_END("xosd_clone");
+    return NULL;
+  }
+  osd->update |= UPD_size | UPD_pos | UPD_mask;
+  osd->next = osd->ctx->objects;
+  osd->ctx->objects = osd;
+  _xosd_unlock(osd2);
+
+  if (_xosd_record_file && osd2->record_id)
+    _xosd_record_create(osd, REC_clone, osd2->record_id);
+  TRACE_END("xosd_clone");
   return osd;
 }
 
-/* xosd_create -- Create a new xosd "object" {{{ */
-xosd *
-xosd_create(int number_lines)
+/* }}} */
+
+/* Free what _xosd_alloc() set up. */
+static void
+_xosd_free(xosd * osd)
 {
-  xosd *osd;
-  int event_basep, error_basep, i;
-  char *display;
-  XSetWindowAttributes setwinattr;
-  XGCValues xgcv = { .graphics_exposures = False };
+  int i;
 
-  FUNCTION_START(Dfunction);
-  DEBUG(Dtrace, "getting display");
-  display = getenv("DISPLAY");
-  if (!display) {
-    xosd_error = "No display";
-    osd = NULL;
+  DEBUG(Dtrace, "freeing lines");
+  for (i = 0; i < osd->number_lines; i++)
+    _line_release(osd, &osd->lines[i]);
+  free(osd->lines);
+  for (i = 0; i < osd->number_lines; i++)
+    _line_release(osd, &osd->pending[i].line);
+  free(osd->pending);
+  for (i = 0; i < osd->nqueued; i++)
+    _message_free(osd, &osd->queue[i]);
+  _message_free(osd, &osd->shown);
+  _xosd_arena_destroy(&osd->arena);
+
+  DEBUG(Dtrace, "destroying condition and mutex");
+  pthread_cond_destroy(&osd->cond_sync);
+  pthread_mutex_destroy(&osd->mutex_queue);
+  if (osd->eventfd[0] != -1) {
+    close(osd->eventfd[0]);
+    close(osd->eventfd[1]);
   }
+  pthread_mutex_destroy(&osd->mutex_pending);
+  pthread_mutex_destroy(&osd->mutex_sync);
+
+  DEBUG(Dtrace, "freeing osd structure");
+  free(osd);
+}
+
+/* _xosd_alloc -- A new xosd "object" with the default settings {{{ */
+static xosd *
+_xosd_alloc(const struct xosd_backend *backend, int number_lines,
+            int width, int height)
+{
+  xosd *osd;
 
   DEBUG(Dtrace, "Mallocing osd");
-  osd = malloc(sizeof(xosd));
-  memset(osd, 0, sizeof(xosd));
+  osd = calloc(1, sizeof(xosd));
   if (osd == NULL) {
     xosd_error = "Out of memory";
-    free(osd);
+    return NULL;
   }
 
-  DEBUG(Dtrace, "Creating pipe");
-  if (pipe(osd->pipefd) == -1) {
-    xosd_error = "Error creating pipe";
-    osd = NULL;
+  DEBUG(Dtrace, "initializing number lines");
+  osd->number_lines = number_lines;
+  osd->lines = calloc(osd->number_lines, sizeof(union xosd_line));
+  osd->pending = calloc(osd->number_lines, sizeof(struct xosd_pending));
+  if (osd->lines == NULL || osd->pending == NULL) {
+    xosd_error = "Out of memory";
+    free(osd->lines);
+    free(osd->pending);
+    free(osd);
+    return NULL;
   }
+  osd->npending = 0;
+  osd->frame_interval = 0;
+  osd->dropped = 0;
+  osd->nqueued = 0;
+  osd->min_time = 1000;
+  osd->eventfd[0] = osd->eventfd[1] = -1;
+  osd->show_wait = 1;
 
   DEBUG(Dtrace, "initializing mutex");
-  pthread_mutex_init(&osd->mutex, NULL);
   pthread_mutex_init(&osd->mutex_sync, NULL);
+  pthread_mutex_init(&osd->mutex_pending, NULL);
+  pthread_mutex_init(&osd->mutex_queue, NULL);
+  _xosd_arena_init(&osd->arena);
   DEBUG(Dtrace, "initializing condition");
-  pthread_cond_init(&osd->cond_wait, NULL);
   pthread_cond_init(&osd->cond_sync, NULL);
 
-  DEBUG(Dtrace, "initializing number lines");
-  osd->number_lines = number_lines;
-  osd->lines = malloc(sizeof(union xosd_line) * osd->number_lines);
-  if (osd->lines == NULL) {
-    xosd_error = "Out of memory";
-    pthread_cond_destroy(&osd->cond_sync);
-    pthread_cond_destroy(&osd->cond_wait);
-    pthread_mutex_destroy(&osd->mutex_sync);
-    pthread_mutex_destroy(&osd->mutex);
-    close(osd->pipefd[0]);
-    close(osd->pipefd[1]);
-  }
-
-  for (i = 0; i < osd->number_lines; i++)
-    memset(&osd->lines[i], 0, sizeof(union xosd_line));
-
   DEBUG(Dtrace, "misc osd variable initialization");
   osd->generation = 0;
-  osd->done = 0;
   osd->pos = XOSD_top;
   osd->hoffset = 0;
   osd->align = XOSD_left;
@@ -770,89 +1716,285 @@ xosd_create(int number_lines)
   timerclear(&osd->timeout_start);
   osd->fontset = NULL;
   osd->bar_length = -1;         /* old automatic width calculation */
+  osd->layout = XOSD_layout_none;
+  osd->ellipsis_width = -1;
+  osd->ticker_speed = 100;
+  timerclear(&osd->ticker_last);
+
+  osd->backend = backend;
+  osd->screen_width = width;
+  osd->screen_height = height;
+  osd->screen_xpos = osd->screen_ypos = 0;
+  osd->monitor = 0;
+  osd->mirror = 0;
+  osd->mirrors = NULL;
+  osd->nmirrors = 0;
+  osd->line_height = 10 /*Dummy value */ ;
+  osd->height = osd->line_height * osd->number_lines;
+  return osd;
+}
 
-  DEBUG(Dtrace, "Display query");
-  osd->display = XOpenDisplay(display);
-  if (!osd->display) {
-    xosd_error = "Cannot open display";
-    free(osd->lines);
-  }
-  osd->screen = XDefaultScreen(osd->display);
+/* }}} */
+
+/* The event thread and its mutex, for an object and its clones. */
+static struct xosd_context *
+_xosd_context_new(void)
+{
+  struct xosd_context *ctx;
 
-  DEBUG(Dtrace, "x shape extension query");
-  if (!XShapeQueryExtension(osd->display, &event_basep, &error_basep)) {
-    xosd_error = "X-Server does not support shape extension";
-    XCloseDisplay(osd->display);
+  if ((ctx = calloc(1, sizeof(struct xosd_context))) == NULL) {
+    xosd_error = "Out of memory";
+    return NULL;
+  }
+  DEBUG(Dtrace, "Creating pipe");
+  if (pipe(ctx->pipefd) == -1) {
+    xosd_error = "Error creating pipe";
+    free(ctx);
+    return NULL;
+  }
+  /* Posting a message must neither block on a full pipe nor fail. */
+  if (pipe(ctx->kickfd) == -1) {
+    xosd_error = "Error creating pipe";
+    close(ctx->pipefd[0]);
+    close(ctx->pipefd[1]);
+    free(ctx);
+    return NULL;
   }
+  fcntl(ctx->kickfd[0], F_SETFL, O_NONBLOCK);
+  fcntl(ctx->kickfd[1], F_SETFL, O_NONBLOCK);
+  pthread_mutex_init(&ctx->mutex, NULL);
+  pthread_cond_init(&ctx->cond_wait, NULL);
+  return ctx;
+}
 
-  osd->visual = DefaultVisual(osd->display, osd->screen);
-  osd->depth = DefaultDepth(osd->display, osd->screen);
+static void
+_xosd_context_free(struct xosd_context *ctx)
+{
+  pthread_cond_destroy(&ctx->cond_wait);
+  pthread_mutex_destroy(&ctx->mutex);
+  close(ctx->pipefd[0]);
+  close(ctx->pipefd[1]);
+  close(ctx->kickfd[0]);
+  close(ctx->kickfd[1]);
+  free(ctx);
+}
+
+/* _xosd_create -- Create a new xosd "object" without recording it {{{ */
+static xosd *
+_xosd_create(const struct xosd_backend *backend, int number_lines,
+             int width, int height, int threadless)
+{
+  xosd *osd;
+
+  FUNCTION_START(Dfunction);
+  _xosd_trace_init();
+  _xosd_record_init();
+  TRACE_BEGIN("xosd_create");
+
+  osd = _xosd_alloc(backend, number_lines, width, height);
+  if (osd == NULL) {
+    TRACE_END("xosd_create");
+    return NULL;
+  }
+  if ((osd->ctx = _xosd_context_new()) == NULL) {
+    _xosd_free(osd);
+    TRACE_END("xosd_create");
+    return NULL;
+  }
+  osd->ctx->objects = osd;
+  osd->ctx->threadless = threadless;
+
+  DEBUG(Dtrace, "opening %s backend", backend->name);
+  if (backend->open(osd) == -1) {
+    _xosd_context_free(osd->ctx);
+    _xosd_free(osd);
+    TRACE_END("xosd_create");
+    return NULL;
+  }
 
   DEBUG(Dtrace, "font selection info");
-  xosd_set_font(osd, osd_default_font);
-  if (osd->fontset == NULL) {
+  if (xosd_set_font(osd, osd_default_font) == -1) {
     /*
      * if we still don't have a fontset, then abort 
      */
     xosd_error = "Default font not found";
-    XCloseDisplay(osd->display);
+    backend->close(osd);
+    _xosd_context_free(osd->ctx);
+    _xosd_free(osd);
+    TRACE_END("xosd_create");
+    return NULL;
   }
 
-  DEBUG(Dtrace, "width and height initialization");
+  DEBUG(Dtrace, "setting colour");
+  xosd_set_colour(osd, osd_default_colour);
 
-  xosd_monitor(osd, 1);
+  osd->update |= UPD_size | UPD_pos | UPD_mask;
+  if (threadless)
+    _update_all(osd->ctx);
+  else {
+    DEBUG(Dtrace, "initializing event thread");
+    pthread_create(&osd->ctx->event_thread, NULL, event_loop, osd->ctx);
+  }
 
-  osd->line_height = 10 /*Dummy value */ ;
-  osd->height = osd->line_height * osd->number_lines;
+  TRACE_END("xosd_create");
+  return osd;
+}
+
+/* }}} */
+
+/* xosd_create -- Create a new xosd "object" {{{ */
+xosd *
+xosd_create(int number_lines)
+{
+  xosd *osd = _xosd_create(&_xosd_backend_x11, number_lines, 0, 0, 0);
+
+  if (_xosd_record_file && osd != NULL)
+    _xosd_record_create(osd, REC_create, number_lines);
+  return osd;
+}
+
+/* }}} */
+
+/* xosd_create_headless -- Create a new xosd "object" drawing into memory {{{ */
+xosd *
+xosd_create_headless(int number_lines, int width, int height)
+{
+  xosd *osd;
+
+  if (width <= 0 || height <= 0) {
+    xosd_error = "Invalid image size";
+    return NULL;
+  }
+  osd = _xosd_create(&_xosd_backend_headless, number_lines, width, height,
+                     0);
+  if (_xosd_record_file && osd != NULL)
+    _xosd_record_create(osd, REC_create, number_lines);
+  return osd;
+}
+
+/* }}} */
+
+/* xosd_create_threadless -- Create a new xosd "object" without a thread {{{ */
+xosd *
+xosd_create_threadless(int number_lines, int width, int height)
+{
+  xosd *osd;
+
+  if (width < 0 || height < 0 || (width == 0) != (height == 0)) {
+    xosd_error = "Invalid image size";
+    return NULL;
+  }
+  osd = _xosd_create(width ? &_xosd_backend_headless : &_xosd_backend_x11,
+                     number_lines, width, height, 1);
+  if (_xosd_record_file && osd != NULL)
+    _xosd_record_create(osd, REC_create, number_lines);
+  return osd;
+}
+
+/* }}} */
+
+/* xosd_get_fd -- Get the file descriptor a threadless object waits on {{{ */
+int
+xosd_get_fd(xosd * osd)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  if (osd != NULL && osd->ctx->threadless)
+    return_val = osd->ctx->objects->backend->fd(osd->ctx->objects);
+
+  return return_val;
+}
 
-  DEBUG(Dtrace, "creating X Window");
-  setwinattr.override_redirect = 1;
+/* }}} */
 
-  osd->window = XCreateWindow(osd->display,
-                              XRootWindow(osd->display, osd->screen),
-                              0, 0,
-                              osd->screen_width, osd->height,
-                              0,
-                              osd->depth,
-                              CopyFromParent,
-                              osd->visual, CWOverrideRedirect, &setwinattr);
-  XStoreName(osd->display, osd->window, "XOSD");
+/* xosd_dispatch -- Handle events and timeouts of a threadless object {{{ */
+int
+xosd_dispatch(xosd * osd, int *timeout)
+{
+  struct xosd_context *ctx;
+  long wait;
+  int return_val = -1;
 
-  osd->mask_bitmap =
-    XCreatePixmap(osd->display, osd->window, osd->screen_width,
-                  osd->height, 1);
-  osd->line_bitmap =
-    XCreatePixmap(osd->display, osd->window, osd->screen_width,
-                  osd->line_height, osd->depth);
+  FUNCTION_START(Dfunction);
+  if (osd == NULL)
+    return -1;
+  ctx = osd->ctx;
+  if (!ctx->threadless) {
+    xosd_error = "xosd_dispatch: Object has an event thread";
+    return -1;
+  }
+  TRACE_BEGIN("xosd_dispatch");
+  /* The host may call on a timeout alone, or after an Xlib call of its
+   * own queued our events; only what is there is handled. */
+  _handle_events(ctx);
+  wait = _update_all(ctx);
+  if (timeout != NULL)
+    *timeout = (wait == -1) ? -1 : (int) ((wait + 999) / 1000);
+  TRACE_END("xosd_dispatch");
+  return_val = 0;
 
-  osd->gc = XCreateGC(osd->display, osd->window, GCGraphicsExposures, &xgcv);
-  osd->mask_gc = XCreateGC(osd->display, osd->mask_bitmap, GCGraphicsExposures, &xgcv);
-  osd->mask_gc_back = XCreateGC(osd->display, osd->mask_bitmap, GCGraphicsExposures, &xgcv);
+  return return_val;
+}
 
-  XSetBackground(osd->display, osd->gc,
-                 WhitePixel(osd->display, osd->screen));
+/* }}} */
 
-  XSetForeground(osd->display, osd->mask_gc_back,
-                 BlackPixel(osd->display, osd->screen));
-  XSetBackground(osd->display, osd->mask_gc_back,
-                 WhitePixel(osd->display, osd->screen));
+/* xosd_get_image -- Copy the pixels of a headless xosd "object" {{{ */
+int
+xosd_get_image(xosd * osd, unsigned char **rgba, int *width, int *height)
+{
+  int return_val = -1;
+  unsigned long pass;
+  int busy;
+
+  FUNCTION_START(Dfunction);
+  if (osd != NULL && rgba != NULL) {
+    if (osd->backend != &_xosd_backend_headless) {
+      xosd_error = "Not a headless xosd object";
+      return -1;
+    }
+    /* Let the event thread draw what was changed so far. */
+    _xosd_lock(osd);
+    busy = osd->update & ~UPD_timer;
+    pthread_mutex_lock(&osd->mutex_sync);
+    pass = osd->passes;
+    pthread_mutex_unlock(&osd->mutex_sync);
+    _xosd_unlock(osd);
+    if (busy) {
+      pthread_mutex_lock(&osd->mutex_sync);
+      while (osd->passes == pass)
+        pthread_cond_wait(&osd->cond_sync, &osd->mutex_sync);
+      pthread_mutex_unlock(&osd->mutex_sync);
+    }
 
-  XSetForeground(osd->display, osd->mask_gc,
-                 WhitePixel(osd->display, osd->screen));
-  XSetBackground(osd->display, osd->mask_gc,
-                 BlackPixel(osd->display, osd->screen));
+    _xosd_lock(osd);
+    return_val = _xosd_headless_image(osd, rgba, width, height);
+    _xosd_unlock(osd);
+  }
 
+  return return_val;
+}
 
-  DEBUG(Dtrace, "setting colour");
-  xosd_set_colour(osd, osd_default_colour);
+/* }}} */
 
-  DEBUG(Dtrace, "stay on top");
-  stay_on_top(osd->display, osd->window);
+/* xosd_write_image -- Write the pixels of a headless xosd "object" to a file {{{ */
+int
+xosd_write_image(xosd * osd, const char *filename)
+{
+  unsigned char *rgba;
+  int width, height, len, return_val = -1;
 
-  DEBUG(Dtrace, "initializing event thread");
-  pthread_create(&osd->event_thread, NULL, event_loop, osd);
+  FUNCTION_START(Dfunction);
+  if (filename != NULL && xosd_get_image(osd, &rgba, &width, &height) == 0) {
+    len = strlen(filename);
+    if (len > 4 && strcasecmp(filename + len - 4, ".png") == 0)
+      return_val = _xosd_write_png(filename, rgba, width, height);
+    else
+      return_val = _xosd_write_ppm(filename, rgba, width, height);
+    free(rgba);
+  }
 
-  return osd;
+  return return_val;
 }
 
 /* }}} */
@@ -862,46 +2004,44 @@ int
 xosd_monitor(xosd * osd, int monitor)
 {
    int return_value = -1;  
+   int width;
    if (osd != NULL) {     
-    #ifdef HAVE_XINERAMA
-      int nscreens;
-      XineramaScreenInfo *screeninfo = NULL;
-      int dummy_a, dummy_b;
-    #endif
+    RECORD(osd, REC_set_int, REC_monitor, monitor, NULL);
     monitor--;
 
     FUNCTION_START(Dfunction);
 
     _xosd_lock(osd);
+    width = osd->screen_width;
+    return_value = osd->backend->monitor(osd, monitor);
+    /* A monitor of another width needs the window resized and the lines
+     * aligned again. */
+    osd->update |= osd->screen_width != width ? UPD_font : UPD_pos;
+    _xosd_unlock(osd);
+  }
+  return return_value;
+}
 
-    #ifdef HAVE_XINERAMA
-      if (XineramaQueryExtension(osd->display, &dummy_a, &dummy_b) &&
-          (screeninfo = XineramaQueryScreens(osd->display, &nscreens)) &&
-        XineramaIsActive(osd->display) && (nscreens > monitor) && (monitor >= 0)) {
-      osd->screen_width = screeninfo[monitor].width;
-      osd->screen_height = screeninfo[monitor].height;
-      osd->screen_xpos = screeninfo[monitor].x_org;
-      osd->nscreens = nscreens;
-      return_value = 0;
-      } else
-    #endif
-    {
-      osd->screen_width = XDisplayWidth(osd->display, osd->screen);
-      osd->screen_height = XDisplayHeight(osd->display, osd->screen);
-      osd->screen_xpos = 0;
-      xosd_error = "Error getting screen info from Xinerama";
-      return_value = -1;
+/* }}} */
 
-    }
-    #ifdef HAVE_XINERAMA
-      if (screeninfo) {
-        XFree(screeninfo);
-      }
-    #endif
-    osd->update |= UPD_pos;
+/* xosd_set_mirror -- Show the object on every monitor at once {{{ */
+int
+xosd_set_mirror(xosd * osd, int mirror)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_mirror, mirror, NULL);
+  if (osd != NULL) {
+    _xosd_lock(osd);
+    osd->mirror = mirror != 0;
+    return_val = 0;
+    if (osd->backend->mirror != NULL)
+      return_val = osd->backend->mirror(osd);
     _xosd_unlock(osd);
   }
-  return return_value;
+
+  return return_val;
 }
 
 /* }}} */
@@ -1007,45 +2147,39 @@ xosd_uninit(xosd * osd)
 int
 xosd_destroy(xosd * osd)
 {
-  int i;
   FUNCTION_START(Dfunction);
   if (osd != NULL) {
+    struct xosd_context *ctx = osd->ctx;
+    xosd **p;
+    int last;
+
+    TRACE_BEGIN("xosd_destroy");
+    RECORD(osd, REC_destroy, 0, 0, NULL);
 
-    DEBUG(Dtrace, "waiting for threads to exit");
+    /* The event thread goes on while clones are left. */
     _xosd_lock(osd);
-    osd->done = 1;
+    for (p = &ctx->objects; *p != osd; p = &(*p)->next);
+    *p = osd->next;
+    last = ctx->objects == NULL;
+    if (last)
+      ctx->done = 1;
+    else {
+      _free_strips(osd);
+      osd->backend->close(osd);
+    }
+    osd->update = UPD_none;
     _xosd_unlock(osd);
 
-    DEBUG(Dtrace, "join threads");
-    pthread_join(osd->event_thread, NULL);
-
-    DEBUG(Dtrace, "freeing X resources");
-    XFreeGC(osd->display, osd->gc);
-    XFreeGC(osd->display, osd->mask_gc);
-    XFreeGC(osd->display, osd->mask_gc_back);
-    XFreePixmap(osd->display, osd->line_bitmap);
-    XFreeFontSet(osd->display, osd->fontset);
-    XFreePixmap(osd->display, osd->mask_bitmap);
-    XDestroyWindow(osd->display, osd->window);
-
-    XCloseDisplay(osd->display);
-
-    DEBUG(Dtrace, "freeing lines");
-    for (i = 0; i < osd->number_lines; i++)
-      if (osd->lines[i].type == LINE_text && osd->lines[i].text.string)
-        free(osd->lines[i].text.string);
-    free(osd->lines);
-
-    DEBUG(Dtrace, "destroying condition and mutex");
-    pthread_cond_destroy(&osd->cond_sync);
-    pthread_cond_destroy(&osd->cond_wait);
-    pthread_mutex_destroy(&osd->mutex_sync);
-    pthread_mutex_destroy(&osd->mutex);
-    close(osd->pipefd[0]);
-    close(osd->pipefd[1]);
-
-    DEBUG(Dtrace, "freeing osd structure");
-    free(osd);
+    if (last) {
+      DEBUG(Dtrace, "join threads");
+      if (!ctx->threadless)
+        pthread_join(ctx->event_thread, NULL);
+      _free_strips(osd);
+      osd->backend->close(osd);
+      _xosd_context_free(ctx);
+    }
+    _xosd_free(osd);
+    TRACE_END("xosd_destroy");
 
     FUNCTION_END(Dfunction);
   }
@@ -1060,6 +2194,7 @@ xosd_set_bar_length(xosd * osd, int length)
 {
   FUNCTION_START(Dfunction);
   int return_val = -1;
+  RECORD(osd, REC_set_int, REC_bar_length, length, NULL);
   if (osd != NULL && length != 0 && length > 0) {
     osd->bar_length = length;
     return_val = 0;
@@ -1070,26 +2205,97 @@ xosd_set_bar_length(xosd * osd, int length)
 
 /* }}} */
 
+/* xosd_set_layout -- Fit long text lines to the screen {{{ */
+int
+xosd_set_layout(xosd * osd, xosd_layout layout)
+{
+  int return_val = -1, line;
+
+  FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_layout, layout, NULL);
+  if (osd != NULL && layout >= XOSD_layout_none &&
+      layout <= XOSD_layout_ellipsis_middle) {
+    _xosd_lock(osd);
+    osd->layout = layout;
+    for (line = 0; line < osd->number_lines; line++)
+      if (osd->lines[line].type == LINE_text)
+        osd->lines[line].text.width = -1;
+    osd->update |= UPD_content;
+    _xosd_unlock(osd);
+    return_val = 0;
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
+/* xosd_text_lines -- Count the lines a text would take {{{ */
+int
+xosd_text_lines(xosd * osd, const char *text)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  if (osd != NULL && text != NULL) {
+    _xosd_lock(osd);
+    if (osd->layout == XOSD_layout_wrap && *text != '\0')
+      return_val = _wrap_text(osd, 0, text, 0);
+    else
+      return_val = 1;
+    _xosd_unlock(osd);
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
+/* xosd_set_ticker_speed -- Set how fast ticker lines move {{{ */
+int
+xosd_set_ticker_speed(xosd * osd, int pixels_per_second)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_ticker_speed, pixels_per_second, NULL);
+  if (osd != NULL && pixels_per_second > 0 && pixels_per_second <= 1000000) {
+    _xosd_lock(osd);
+    osd->ticker_speed = pixels_per_second;
+    _xosd_unlock(osd);
+    return_val = 0;
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
 /* xosd_display -- Display information {{{ */
 int
 xosd_display(xosd * osd, int line, xosd_command command, ...)
 {
   int return_value = -1;
   union xosd_line newline = { type:LINE_blank };
+  char buf[XOSD_MAX_PRINTF_BUF_SIZE];
+  struct timeval called;
   va_list a;
 
   FUNCTION_START(Dfunction);
   if (osd != NULL && (line >= 0 && line < osd->number_lines)) {
+    TRACE_BEGIN("xosd_display");
+    if (osd->stats.timing)
+      gettimeofday(&called, NULL);
     va_start(a, command);
     switch (command) {
     case XOSD_string:
     case XOSD_printf:
+    case XOSD_ticker:
       {
-        char buf[XOSD_MAX_PRINTF_BUF_SIZE];
         struct xosd_text *l = &newline.text;
         char *string = va_arg(a, char *);
         if (command == XOSD_printf) {
-          if (vsnprintf(buf, sizeof(buf), string, a) >= sizeof(buf)) {
+          if (vsnprintf(buf, sizeof(buf), string, a) >= (int) sizeof(buf)) {
             xosd_error = "xosd_display: Buffer too small";
             va_end(a);
             return_value = -1;
@@ -1097,10 +2303,11 @@ xosd_display(xosd * osd, int line, xosd_command command, ...)
           string = buf;
         }
         if (string && *string) {
+          /* Only a view of string, _set_line() copies it. */
           return_value = strlen(string);
-          l->type = LINE_text;
-          l->string = malloc(return_value + 1);
-          memcpy(l->string, string, return_value + 1);
+          l->type = (command == XOSD_ticker) ? LINE_ticker : LINE_text;
+          l->buf = string;
+          l->size = return_value + 1;
         } else {
           return_value = 0;
           l->type = LINE_blank;
@@ -1117,6 +2324,7 @@ xosd_display(xosd * osd, int line, xosd_command command, ...)
         return_value = (return_value < 0) ? 0 : (return_value > 100) ? 100 : return_value;
         l->type = (command == XOSD_percentage) ? LINE_percentage : LINE_slider;
         l->value = return_value;
+        l->on = -1;
         break;
       }
 
@@ -1128,19 +2336,29 @@ xosd_display(xosd * osd, int line, xosd_command command, ...)
       }
     }
 
-    _xosd_lock(osd);
-    /* Free old entry */
-    switch (osd->lines[line].type) {
-    case LINE_text:
-      free(osd->lines[line].text.string);
-    case LINE_blank:
-    case LINE_percentage:
-    case LINE_slider:
-      break;
+    if (_xosd_record_file) {
+      if (newline.type == LINE_text || newline.type == LINE_blank)
+        RECORD(osd, REC_string, line, 0,
+               newline.type == LINE_text ? TEXT_STRING(&newline.text) : "");
+      else if (newline.type == LINE_ticker)
+        RECORD(osd, REC_ticker, line, 0, TEXT_STRING(&newline.text));
+      else
+        RECORD(osd, newline.type == LINE_percentage ? REC_percentage
+               : REC_slider, line, newline.bar.value, NULL);
     }
-    osd->lines[line] = newline;
-    osd->update |= UPD_content | UPD_timer | UPD_show;
+
+    if (osd->stats.timing)
+      _stats_displayed(osd, &called);
+    /* Too soon after the last frame: leave it for the event thread. */
+    if (osd->frame_interval && _queue_line(osd, line, &newline)) {
+      TRACE_END("xosd_display");
+      return return_value;
+    }
+
+    _xosd_lock(osd);
+    osd->update |= _set_line(osd, line, &newline, NULL);
     _xosd_unlock(osd);
+    TRACE_END("xosd_display");
 
   }
   
@@ -1149,6 +2367,122 @@ xosd_display(xosd * osd, int line, xosd_command command, ...)
 
 /* }}} */
 
+/* xosd_post -- Queue a message for display {{{ */
+int
+xosd_post(xosd * osd, xosd_priority priority, const char *key, ...)
+{
+  struct xosd_message m;
+  xosd_command command;
+  int dropped, return_val = -1;
+  char c = 0;
+  va_list a;
+
+  FUNCTION_START(Dfunction);
+  if (osd == NULL || priority < XOSD_low || priority > XOSD_urgent)
+    return -1;
+  TRACE_BEGIN("xosd_post");
+  memset(&m, 0, sizeof(m));
+  m.priority = priority;
+  /* Lines and key in one buffer of the arena, so a steady stream of
+   * messages allocates nothing. */
+  m.size = osd->number_lines * sizeof(union xosd_line) +
+    (key ? strlen(key) + 1 : 0);
+  if ((m.lines = _xosd_arena_get(&osd->arena, &m.size)) == NULL) {
+    xosd_error = "Out of memory";
+    goto error;
+  }
+  memset(m.lines, 0, osd->number_lines * sizeof(union xosd_line));
+  if (key != NULL) {
+    m.key = (char *) &m.lines[osd->number_lines];
+    strcpy(m.key, key);
+  }
+  va_start(a, key);
+  while ((command = va_arg(a, xosd_command)) != XOSD_end) {
+    union xosd_line *l = &m.lines[m.nlines];
+    if (m.nlines == osd->number_lines) {
+      xosd_error = "xosd_post: Too many lines";
+      break;
+    }
+    switch (command) {
+    case XOSD_string:
+    case XOSD_ticker:
+      {
+        char *string = va_arg(a, char *);
+        l->type = LINE_blank;
+        if (string && *string &&
+            _line_set_text(osd, l, command == XOSD_ticker ? LINE_ticker :
+                           LINE_text, string, strlen(string)) == -1)
+          break;
+        m.nlines++;
+        continue;
+      }
+    case XOSD_percentage:
+    case XOSD_slider:
+      {
+        int value = va_arg(a, int);
+        l->type = (command == XOSD_percentage) ? LINE_percentage : LINE_slider;
+        l->bar.value = (value < 0) ? 0 : (value > 100) ? 100 : value;
+        l->bar.on = -1;
+        m.nlines++;
+        continue;
+      }
+    default:
+      /* XOSD_printf would leave no way to find the next command. */
+      xosd_error = "xosd_post: Unknown command";
+    }
+    break;
+  }
+  va_end(a);
+  if (command != XOSD_end || m.nlines == 0)
+    goto error;
+
+  pthread_mutex_lock(&osd->mutex_queue);
+  m.seq = osd->seq++;
+  dropped = _queue_message(osd, &m);
+  pthread_mutex_unlock(&osd->mutex_queue);
+  if (dropped) {
+    pthread_mutex_lock(&osd->mutex_pending);
+    osd->dropped += dropped;
+    pthread_mutex_unlock(&osd->mutex_pending);
+  }
+  if (osd->ctx->threadless) {
+    _xosd_lock(osd);
+    _xosd_unlock(osd);
+  } else if (write(osd->ctx->kickfd[1], &c, sizeof(c)) == -1 &&
+             errno != EAGAIN)
+    /* A full pipe already wakes the event thread. */
+    DEBUG(Dselect, "kick failed %d", errno);
+  TRACE_END("xosd_post");
+  return 0;
+
+error:
+  _message_free(osd, &m);
+  TRACE_END("xosd_post");
+  return return_val;
+}
+
+/* }}} */
+
+/* xosd_set_min_time -- Set how long a posted message is shown at least {{{ */
+int
+xosd_set_min_time(xosd * osd, int ms)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_min_time, ms, NULL);
+  if (osd != NULL && ms >= 0) {
+    _xosd_lock(osd);
+    osd->min_time = ms;
+    _xosd_unlock(osd);
+    return_val = 0;
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
 /* xosd_is_onscreen -- Returns weather the display is show {{{ */
 int
 xosd_is_onscreen(xosd * osd)
@@ -1157,7 +2491,7 @@ xosd_is_onscreen(xosd * osd)
 
   FUNCTION_START(Dfunction);
   if (osd != NULL) {
-    return_val = osd->generation & 1;
+    return_val = _generation(osd) & 1;
   }
 
   return return_val;
@@ -1175,8 +2509,22 @@ xosd_wait_until_no_display(xosd * osd)
   FUNCTION_START(Dfunction);
   if (osd != NULL) {
     return_val = 0;
-    if ((generation = osd->generation) & 1)
-      _wait_until_update(osd, generation);
+    if ((generation = _generation(osd)) & 1) {
+      if (osd->ctx->threadless)
+        /* Be the event thread until it is hidden. */
+        for (;;) {
+          struct pollfd p;
+          int timeout;
+          xosd_dispatch(osd, &timeout);
+          if (osd->generation != generation)
+            break;
+          p.fd = xosd_get_fd(osd);
+          p.events = POLLIN;
+          poll(&p, p.fd != -1, timeout);
+        }
+      else
+        _wait_until_update(osd, generation);
+    }
 
     FUNCTION_END(Dfunction);
   }
@@ -1193,10 +2541,11 @@ xosd_set_colour(xosd * osd, const char *colour)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_string, REC_colour, 0, colour);
   if (osd != NULL) {
     _xosd_lock(osd);
-    return_val = parse_colour(osd, &osd->colour, &osd->pixel, colour);
-    osd->update |= UPD_lines;
+    return_val = osd->backend->parse_colour(osd, &osd->colour, &osd->pixel, colour);
+    osd->update |= UPD_lines | UPD_strips;
     _xosd_unlock(osd);
   }
 
@@ -1212,10 +2561,11 @@ xosd_set_shadow_colour(xosd * osd, const char *colour)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_string, REC_shadow_colour, 0, colour);
   if (osd != NULL) {
     _xosd_lock(osd);
-    return_val = parse_colour(osd, &osd->shadow_colour, &osd->shadow_pixel, colour);
-    osd->update |= UPD_lines;
+    return_val = osd->backend->parse_colour(osd, &osd->shadow_colour, &osd->shadow_pixel, colour);
+    osd->update |= UPD_lines | UPD_strips;
     _xosd_unlock(osd);
   }
 
@@ -1231,11 +2581,12 @@ xosd_set_outline_colour(xosd * osd, const char *colour)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_string, REC_outline_colour, 0, colour);
   if (osd != NULL) {
     _xosd_lock(osd);
     return_val =
-      parse_colour(osd, &osd->outline_colour, &osd->outline_pixel, colour);
-    osd->update |= UPD_lines;
+      osd->backend->parse_colour(osd, &osd->outline_colour, &osd->outline_pixel, colour);
+    osd->update |= UPD_lines | UPD_strips;
     _xosd_unlock(osd);
   }
 
@@ -1249,29 +2600,21 @@ xosd_set_outline_colour(xosd * osd, const char *colour)
 int
 xosd_set_font(xosd * osd, const char *font)
 {
-  XFontSet fontset2;
-  char **missing;
-  int nmissing;
-  char *defstr;
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_string, REC_font, 0, font);
   if (osd != NULL && font != NULL) {
-    /*
-    * Try to create the new font. If it doesn't succeed, keep old font. 
-    */
     _xosd_lock(osd);
-    fontset2 = XCreateFontSet(osd->display, font, &missing, &nmissing, &defstr);
-    XFreeStringList(missing);
-    if (fontset2 == NULL) {
-      xosd_error = "Requested font not found";
-      return_val = -1;
-    } else {
-      if (osd->fontset != NULL)
-        XFreeFontSet(osd->display, osd->fontset);
-      osd->fontset = fontset2;
+    return_val = osd->backend->set_font(osd, font);
+    if (return_val == 0) {
+      int line;
+      /* Measured in the old font. */
+      for (line = 0; line < osd->number_lines; line++)
+        if (osd->lines[line].type == LINE_text)
+          osd->lines[line].text.nchars = -1;
+      osd->ellipsis_width = -1;
       osd->update |= UPD_font;
-      return_val = 0;
     }
     _xosd_unlock(osd);
   }
@@ -1288,6 +2631,7 @@ xosd_set_shadow_offset(xosd * osd, int shadow_offset)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_shadow_offset, shadow_offset, NULL);
   if (osd != NULL && shadow_offset > 0) {
     _xosd_lock(osd);
     osd->shadow_offset = shadow_offset;
@@ -1308,6 +2652,7 @@ xosd_set_shadow_direction(xosd * osd, int shadow_direction)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_shadow_direction, shadow_direction, NULL);
   if (osd != NULL && (shadow_direction >= 0 && shadow_direction < 7)) {
     _xosd_lock(osd);
     osd->shadow_direction = shadow_direction;
@@ -1326,6 +2671,7 @@ xosd_set_outline_offset(xosd * osd, int outline_offset)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_outline_offset, outline_offset, NULL);
   if (osd != NULL && outline_offset >= 0) {
     _xosd_lock(osd);
     osd->outline_offset = outline_offset;
@@ -1346,6 +2692,7 @@ xosd_set_vertical_offset(xosd * osd, int voffset)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_vertical_offset, voffset, NULL);
   if (osd != NULL) {
     _xosd_lock(osd);
     osd->voffset = voffset;
@@ -1366,10 +2713,14 @@ xosd_set_horizontal_offset(xosd * osd, int hoffset)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_horizontal_offset, hoffset, NULL);
   if (osd != NULL) {
     _xosd_lock(osd);
     osd->hoffset = hoffset;
     osd->update |= UPD_pos;
+    /* It takes away from the space of cut lines. */
+    if (osd->layout != XOSD_layout_none)
+      osd->update |= UPD_content;
     _xosd_unlock(osd);
     return_val = 0;
   }
@@ -1386,6 +2737,7 @@ xosd_set_pos(xosd * osd, xosd_pos pos)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_pos, pos, NULL);
   if (osd != NULL) {
     _xosd_lock(osd);
     osd->pos = pos;
@@ -1406,6 +2758,7 @@ xosd_set_align(xosd * osd, xosd_align align)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_align, align, NULL);
   if (osd != NULL) {
     _xosd_lock(osd);
     osd->align = align;
@@ -1449,6 +2802,7 @@ xosd_set_timeout(xosd * osd, int timeout)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_timeout, timeout, NULL);
   if (osd != NULL) {
     _xosd_lock(osd);
     osd->timeout = timeout;
@@ -1462,6 +2816,86 @@ xosd_set_timeout(xosd * osd, int timeout)
 
 /* }}} */
 
+/* xosd_get_event_fd -- Get a file descriptor readable on state changes {{{ */
+int
+xosd_get_event_fd(xosd * osd)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  if (osd != NULL) {
+    /* Set under both locks, read under either. */
+    _xosd_lock(osd);
+    pthread_mutex_lock(&osd->mutex_sync);
+    if (osd->eventfd[0] == -1) {
+      if (pipe(osd->eventfd) == -1) {
+        xosd_error = "Error creating pipe";
+        osd->eventfd[0] = osd->eventfd[1] = -1;
+      } else {
+        fcntl(osd->eventfd[0], F_SETFL, O_NONBLOCK);
+        fcntl(osd->eventfd[1], F_SETFL, O_NONBLOCK);
+        osd->nevents = osd->event_head = 0;
+      }
+    }
+    return_val = osd->eventfd[0];
+    pthread_mutex_unlock(&osd->mutex_sync);
+    _xosd_unlock(osd);
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
+/* xosd_read_event -- Get the next state change without blocking {{{ */
+int
+xosd_read_event(xosd * osd)
+{
+  int return_val = -1;
+  char c;
+
+  FUNCTION_START(Dfunction);
+  if (osd != NULL) {
+    pthread_mutex_lock(&osd->mutex_sync);
+    if (osd->eventfd[0] == -1)
+      xosd_error = "xosd_read_event: No event fd";
+    else if (osd->nevents == 0)
+      return_val = XOSD_event_none;
+    else {
+      return_val = osd->events[osd->event_head];
+      osd->event_head = (osd->event_head + 1) % XOSD_EVENTS_MAX;
+      /* The pipe stays readable while events are left. */
+      if (--osd->nevents == 0)
+        while (read(osd->eventfd[0], &c, sizeof(c)) > 0);
+    }
+    pthread_mutex_unlock(&osd->mutex_sync);
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
+/* xosd_set_show_wait -- Choose whether showing waits for the map {{{ */
+int
+xosd_set_show_wait(xosd * osd, int wait)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_show_wait, wait, NULL);
+  if (osd != NULL) {
+    _xosd_lock(osd);
+    osd->show_wait = wait != 0;
+    _xosd_unlock(osd);
+    return_val = 0;
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
 /* xosd_hide -- hide the display {{{ */
 int
 xosd_hide(xosd * osd)
@@ -1469,8 +2903,9 @@ xosd_hide(xosd * osd)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_hide, 0, 0, NULL);
   if (osd != NULL) {
-    if (osd->generation & 1) {
+    if (_generation(osd) & 1) {
       _xosd_lock(osd);
       osd->update &= ~UPD_show;
       osd->update |= UPD_hide;
@@ -1491,8 +2926,9 @@ xosd_show(xosd * osd)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_show, 0, 0, NULL);
   if (osd != NULL) {
-    if (~osd->generation & 1) {
+    if (~_generation(osd) & 1) {
       _xosd_lock(osd);
       osd->update &= ~UPD_hide;
       osd->update |= UPD_show | UPD_timer;
@@ -1515,22 +2951,20 @@ xosd_scroll(xosd * osd, int lines)
   int return_val = -1;
 
   FUNCTION_START(Dfunction);
+  RECORD(osd, REC_scroll, 0, lines, NULL);
   if (osd != NULL && (lines > 0 && lines <= osd->number_lines)) {
     _xosd_lock(osd);
+    /* Scroll what was last displayed, not what was last drawn. */
+    _apply_pending(osd, 1);
     /* Clear old text */
     for (i = 0, src = osd->lines; i < lines; i++, src++)
-      if (src->type == LINE_text && src->text.string) {
-        free(src->text.string);
-        src->text.string = NULL;
-      }
+      _line_release(osd, src);
     /* Move following lines forward */
     for (dst = osd->lines; i < osd->number_lines; i++)
       *dst++ = *src++;
     /* Blank new lines */
-    for (; dst < src; dst++) {
+    for (; dst < src; dst++)
       dst->type = LINE_blank;
-      dst->text.string = NULL;
-    }
     osd->update |= UPD_content;
     _xosd_unlock(osd);
     return_val = 0;
@@ -1556,5 +2990,77 @@ xosd_get_number_lines(xosd * osd)
 
 /* }}} */
 
+/* xosd_set_frame_rate -- Limit how often the display is redrawn {{{ */
+int
+xosd_set_frame_rate(xosd * osd, int fps)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  RECORD(osd, REC_set_int, REC_frame_rate, fps, NULL);
+  if (osd != NULL && fps >= 0) {
+    _xosd_lock(osd);
+    pthread_mutex_lock(&osd->mutex_pending);
+    osd->frame_interval = fps ? 1000000 / fps : 0;
+    pthread_mutex_unlock(&osd->mutex_pending);
+    if (!osd->frame_interval)
+      _apply_pending(osd, 1);
+    _xosd_unlock(osd);
+    return_val = 0;
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
+/* xosd_get_dropped_updates -- Count updates replaced before being drawn {{{ */
+long
+xosd_get_dropped_updates(xosd * osd)
+{
+  long return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  if (osd != NULL) {
+    pthread_mutex_lock(&osd->mutex_pending);
+    return_val = osd->dropped;
+    pthread_mutex_unlock(&osd->mutex_pending);
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
+/* xosd_get_stats -- Get counters and latency histograms {{{ */
+int
+xosd_get_stats(xosd * osd, xosd_stats * stats)
+{
+  int return_val = -1;
+
+  FUNCTION_START(Dfunction);
+  if (osd != NULL) {
+    _xosd_lock(osd);
+    osd->stats.timing = 1;
+    if (stats != NULL)
+      *stats = osd->stats;
+    _xosd_unlock(osd);
+
+    if (stats != NULL) {
+      pthread_mutex_lock(&osd->mutex_pending);
+      stats->dropped_updates = osd->dropped;
+      pthread_mutex_unlock(&osd->mutex_pending);
+      pthread_mutex_lock(&osd->arena.mutex);
+      stats->allocations = osd->arena.allocations;
+      pthread_mutex_unlock(&osd->arena.mutex);
+    }
+    return_val = 0;
+  }
+
+  return return_val;
+}
+
+/* }}} */
+
 /* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
  */
@@ -11,12 +11,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <xosd.h>
+#include <osdd.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <errno.h>
 #include <locale.h>
 #include <X11/Xlib.h>
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <fcntl.h>
 
 static struct option long_options[] = {
   {"help", 0, NULL, 'h'},
@@ -40,12 +46,16 @@ static struct option long_options[] = {
   {"text", 1, NULL, 'T'},
   {"direction", 1, NULL, 'D'},
   {"monitor", 1, NULL, 'm'},
+  {"drain", 2, NULL, 'r'},
+  {"daemon", 2, NULL, 'n'},
+  {"layout", 1, NULL, 'L'},
   {NULL, 0, NULL, 0}
 };
 
 FILE *fp;
 xosd *osd;
-char buffer[1024];
+char *buffer = NULL;
+size_t buffer_size = 0;
 
 char *font = NULL;
 char *colour = "red";
@@ -68,17 +78,351 @@ int lines = 5;
 int direction = 3;
 int monitor = 1;
 xosd_align align = XOSD_left;
+int drain = 0;
+xosd_layout layout = XOSD_layout_none;
+
+/* Output {{{
+ * With --daemon the lines go to an instance of osdd instead of a window of
+ * our own, so osd_cat can exit as soon as its input is shown. */
+osdd *daemon_conn = NULL;
+int instance = -1;
+struct timeval shown;
+
+static int
+out_create(int number_lines)
+{
+  if (instance >= 0 && (daemon_conn = osdd_connect(NULL)) != NULL) {
+    /* The daemon may fail to create the window, ask whether it did. */
+    if (osdd_open(daemon_conn, instance, number_lines) == 0 &&
+        osdd_sync(daemon_conn) == 0)
+      return 0;
+    osdd_close(daemon_conn);
+    daemon_conn = NULL;
+  }
+  /* No daemon running, fall back to a window of our own. */
+  osd = xosd_create(number_lines);
+  return osd ? 0 : -1;
+}
+
+static int
+out_style(void)
+{
+  if (daemon_conn) {
+    osdd_set_int(daemon_conn, instance, OSDD_shadow_offset, shadow);
+    osdd_set_int(daemon_conn, instance, OSDD_monitor, monitor);
+    osdd_set_int(daemon_conn, instance, OSDD_shadow_direction, direction);
+    osdd_set_string(daemon_conn, instance, OSDD_shadow_colour,
+                    shadow_colour ? shadow_colour : "black");
+    osdd_set_int(daemon_conn, instance, OSDD_outline_offset, outline_offset);
+    osdd_set_string(daemon_conn, instance, OSDD_outline_colour,
+                    outline_colour ? outline_colour : "black");
+    osdd_set_string(daemon_conn, instance, OSDD_colour,
+                    colour ? colour : osd_default_colour);
+    osdd_set_int(daemon_conn, instance, OSDD_timeout, delay);
+    osdd_set_int(daemon_conn, instance, OSDD_pos, pos);
+    osdd_set_int(daemon_conn, instance, OSDD_vertical_offset, voffset);
+    osdd_set_int(daemon_conn, instance, OSDD_horizontal_offset, hoffset);
+    osdd_set_int(daemon_conn, instance, OSDD_align, align);
+    /* The daemon reports a bad font, if at all, on its own stderr. */
+    return osdd_set_string(daemon_conn, instance, OSDD_font,
+                           font ? font : osd_default_font);
+  }
+
+  xosd_set_shadow_offset(osd, shadow);
+  xosd_monitor(osd, monitor);
+  xosd_set_shadow_direction(osd, direction);
+  if (shadow_colour) xosd_set_shadow_colour(osd, shadow_colour);
+  xosd_set_outline_offset(osd, outline_offset);
+  if (outline_colour) xosd_set_outline_colour(osd, outline_colour);
+  if (colour) xosd_set_colour(osd, colour);
+  xosd_set_timeout(osd, delay);
+  xosd_set_pos(osd, pos);
+  xosd_set_vertical_offset(osd, voffset);
+  xosd_set_horizontal_offset(osd, hoffset);
+  xosd_set_align(osd, align);
+  xosd_set_layout(osd, layout);
+  return font ? xosd_set_font(osd, font) : 0;
+}
+
+/* Lines the text will take. The daemon does no layout. */
+static int
+out_lines(const char *string)
+{
+  int n = daemon_conn ? 1 : xosd_text_lines(osd, string);
+  return n > 0 ? n : 1;
+}
+
+static int
+out_string(int line, const char *string)
+{
+  if (daemon_conn) {
+    gettimeofday(&shown, NULL);
+    return osdd_display(daemon_conn, instance, line, XOSD_string, string);
+  }
+  return xosd_display(osd, line, XOSD_string, string);
+}
+
+static int
+out_bar(int line, xosd_command command, int value)
+{
+  if (daemon_conn)
+    return osdd_display(daemon_conn, instance, line, command, value);
+  return xosd_display(osd, line, command, value);
+}
+
+static int
+out_scroll(int n)
+{
+  if (daemon_conn)
+    return osdd_scroll(daemon_conn, instance, n);
+  return xosd_scroll(osd, n);
+}
+
+/* Wait until the last line has been shown for the whole delay. The daemon
+ * is not asked, the line went out when we sent it. */
+static void
+out_wait(void)
+{
+  if (daemon_conn) {
+    struct timeval now;
+    long left;
+
+    gettimeofday(&now, NULL);
+    left = (shown.tv_sec + delay - now.tv_sec) * 1000000L
+      + shown.tv_usec - now.tv_usec;
+    if (left > 0)
+      usleep(left);
+  } else if (xosd_is_onscreen(osd))
+    xosd_wait_until_no_display(osd);
+}
+
+static void
+out_destroy(void)
+{
+  if (daemon_conn) {
+    osdd_close(daemon_conn);
+    return;
+  }
+  if (xosd_is_onscreen(osd))
+    xosd_wait_until_no_display(osd);
+  xosd_destroy(osd);
+}
+
+/* }}} */
+
+/* Drain mode {{{
+ * Instead of scrolling every line through the display, read all available
+ * input in large chunks, keep only the last "lines" lines in a ring and show
+ * them at most "drain" times per second. */
+#define DRAIN_CHUNK 65536
+#define DRAIN_BATCH (16 * DRAIN_CHUNK)
+
+char **ring;
+size_t *ring_size;
+int ring_head = 0, ring_count = 0;
+
+static void
+ring_push(const char *line, size_t len)
+{
+  int slot;
+
+  if (ring_count < lines) {
+    slot = (ring_head + ring_count++) % lines;
+  } else {
+    slot = ring_head;
+    ring_head = (ring_head + 1) % lines;
+  }
+  if (ring_size[slot] < len + 1) {
+    ring_size[slot] = len + 1;
+    ring[slot] = realloc(ring[slot], ring_size[slot]);
+  }
+  memcpy(ring[slot], line, len);
+  ring[slot][len] = '\0';
+}
+
+/* Push the last "lines" lines of data into the ring, scanning backwards so
+ * the lines before them are never touched. */
+static void
+ring_tail(const char *data, size_t len)
+{
+  const char *end = data + len, *p, *newline;
+  int n = 0;
+
+  if (len == 0)
+    return;
+  if (end[-1] == '\n')
+    end--;
+  for (p = end; p > data; p--)
+    if (p[-1] == '\n' && ++n == lines)
+      break;
+  while (p <= end) {
+    newline = memchr(p, '\n', end - p);
+    if (newline == NULL)
+      newline = end;
+    ring_push(p, newline - p);
+    p = newline + 1;
+  }
+}
+
+static void
+ring_show(void)
+{
+  int first, i, line, rows, n;
+
+  /* As many of the newest as fit, when lines wrap. */
+  for (first = ring_count, rows = 0; first > 0; first--, rows += n) {
+    n = out_lines(ring[(ring_head + first - 1) % lines]);
+    if (rows > 0 && rows + n > lines)
+      break;
+  }
+  for (i = first, line = 0; i < ring_count && line < lines; i++) {
+    out_string(line, ring[(ring_head + i) % lines]);
+    line += out_lines(ring[(ring_head + i) % lines]);
+  }
+  for (; line < lines; line++)
+    out_string(line, "");
+}
+
+/* A regular file does not grow while we look: map it and show its tail. */
+static int
+drain_mapped(int fd, off_t len)
+{
+  char *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if (data == MAP_FAILED)
+    return -1;
+  ring_tail(data, len);
+  munmap(data, len);
+  ring_show();
+  return 0;
+}
+
+static int
+drain_stream(int fd)
+{
+  char *buffer = NULL, *newline;
+  size_t size = 0, used = 0, scanned, complete;
+  ssize_t got, batch;
+  struct timeval now, next, tv;
+  int dirty = 0, eof = 0, retval;
+  long interval = 1000000 / drain;
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  timerclear(&next);
+  for (;;) {
+    fd_set readfds;
+
+    /* Push one frame per display interval. */
+    gettimeofday(&now, NULL);
+    if (dirty && (eof || !timercmp(&now, &next, <))) {
+      ring_show();
+      dirty = 0;
+      next.tv_sec = now.tv_sec + interval / 1000000;
+      next.tv_usec = now.tv_usec + interval % 1000000;
+      if (next.tv_usec >= 1000000) {
+        next.tv_usec -= 1000000;
+        next.tv_sec++;
+      }
+    }
+    if (eof)
+      break;
+
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    if (dirty) {
+      tv.tv_sec = next.tv_sec - now.tv_sec;
+      tv.tv_usec = next.tv_usec - now.tv_usec;
+      if (tv.tv_usec < 0) {
+        tv.tv_usec += 1000000;
+        tv.tv_sec--;
+      }
+    }
+    retval = select(fd + 1, &readfds, NULL, NULL, dirty ? &tv : NULL);
+    if (retval == -1 && errno == EINTR) {
+      continue;
+    } else if (retval == -1) {
+      fprintf(stderr, "Error waiting for input: %s\n", strerror(errno));
+      exit(1);
+    } else if (retval == 0) {
+      continue;                 /* next frame is due */
+    }
+
+    /* Read what is available, but give the display a chance in between.
+     * What is left in buffer has no newline. */
+    scanned = used;
+    for (batch = 0; batch < DRAIN_BATCH; batch += got) {
+      if (size - used < DRAIN_CHUNK) {
+        size += DRAIN_CHUNK;
+        buffer = realloc(buffer, size);
+      }
+      got = read(fd, buffer + used, size - used);
+      if (got > 0) {
+        used += got;
+      } else if (got == 0) {
+        eof = 1;
+        break;
+      } else if (errno == EINTR) {
+        got = 0;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      } else {
+        fprintf(stderr, "Error occured reading input file: %s\n",
+                strerror(errno));
+        exit(1);
+      }
+    }
+
+    /* Keep the trailing partial line for the next read. */
+    for (newline = buffer + used; newline > buffer + scanned; newline--)
+      if (newline[-1] == '\n')
+        break;
+    complete = eof ? used : (size_t) (newline - buffer);
+    if (!eof && complete == scanned)
+      complete = 0;
+    if (complete) {
+      ring_tail(buffer, complete);
+      memmove(buffer, buffer + complete, used - complete);
+      used -= complete;
+      dirty = 1;
+    } else if (used > DRAIN_CHUNK) {
+      /* A line without end: only its last DRAIN_CHUNK bytes are kept. */
+      memmove(buffer, buffer + used - DRAIN_CHUNK, DRAIN_CHUNK);
+      used = DRAIN_CHUNK;
+    }
+  }
+  free(buffer);
+  return 0;
+}
+
+static void
+drain_input(FILE * fp)
+{
+  int fd = fileno(fp);
+  struct stat st;
+
+  ring = calloc(lines, sizeof(char *));
+  ring_size = calloc(lines, sizeof(size_t));
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    if (st.st_size == 0 || drain_mapped(fd, st.st_size) == 0)
+      return;
+  }
+  drain_stream(fd);
+}
+
+/* }}} */
 
 int
 main(int argc, char *argv[])
 {
+  int retval;
+
   if (setlocale(LC_ALL, "") == NULL || !XSupportsLocale())
     fprintf(stderr, "Locale not available, expect problems with fonts.\n");
 
   while (1) {
     int option_index = 0;
     int c =
-      getopt_long(argc, argv, "l:A:a::f:c:d:o:i:s:p:O:S:u:b:P:T:D:m:hw",
+      getopt_long(argc, argv, "l:A:a::f:c:d:o:i:s:p:O:S:u:b:P:T:D:m:r::n::L:hw",
                   long_options,
                   &option_index);
     if (c == -1)
@@ -175,6 +519,34 @@ main(int argc, char *argv[])
     case 'm':
       monitor = atoi(optarg);
       break;
+    case 'r':
+      drain = optarg ? atoi(optarg) : 10;
+      if (drain <= 0) {
+        fprintf(stderr, "Illegal drain rate: %d\n", drain);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'n':
+      instance = optarg ? atoi(optarg) : 0;
+      if (instance < 0 || instance > 255) {
+        fprintf(stderr, "Illegal daemon instance: %d\n", instance);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'L':
+      if (strcasecmp(optarg, "none") == 0) {
+        layout = XOSD_layout_none;
+      } else if (strcasecmp(optarg, "wrap") == 0) {
+        layout = XOSD_layout_wrap;
+      } else if (strcasecmp(optarg, "end") == 0) {
+        layout = XOSD_layout_ellipsis_end;
+      } else if (strcasecmp(optarg, "middle") == 0) {
+        layout = XOSD_layout_ellipsis_middle;
+      } else {
+        fprintf(stderr, "Unknown layout: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
     case '?':
     case 'h':
     default:
@@ -205,6 +577,14 @@ main(int argc, char *argv[])
           "  -l, --lines=N       Scroll using n lines. Default is 5.\n"
           "  -d, --delay=TIME    Show for specified time\n"
           "  -w, --wait          Delay display even when new lines are ready\n"
+          "  -L, --layout=(none|wrap|end|middle)\n"
+          "                      Wrap lines wider than the screen, or cut them at\n"
+          "                      their end or in their middle. Not with --daemon.\n"
+          "  -r, --drain[=FPS]   Read fast input in bulk and only show the last lines,\n"
+          "                      at most FPS times a second (default 10).\n"
+          "  -n, --daemon[=INSTANCE]\n"
+          "                      Display through instance INSTANCE (default 0) of a\n"
+          "                      running osdd and exit without waiting for the delay.\n"
           "\n"
           "  -b, --barmode=(percentage|slider)\n"
           "                      Lets you display a percentage or slider bar instead of just text.\n"
@@ -225,7 +605,7 @@ main(int argc, char *argv[])
   }
 
   if (barmode) {
-    osd = xosd_create( (text && *text) ? 2 : 1);
+    retval = out_create((text && *text) ? 2 : 1);
   } else {
     if ((optind < argc) && strncmp(argv[optind], "-", 2)) {
       if ((fp = fopen(argv[optind], "r")) == NULL) {
@@ -235,26 +615,14 @@ main(int argc, char *argv[])
     } else
       fp = stdin;
 
-    osd = xosd_create(lines);
+    retval = out_create(lines);
   }
 
-  if (!osd) {
+  if (retval == -1) {
     fprintf(stderr, "Error initializing osd: %s\n", xosd_error);
     return EXIT_FAILURE;
   }
-  xosd_set_shadow_offset(osd, shadow);
-  xosd_monitor(osd, monitor);
-  xosd_set_shadow_direction(osd, direction);
-  if (shadow_colour) xosd_set_shadow_colour(osd, shadow_colour);
-  xosd_set_outline_offset(osd, outline_offset);
-  if (outline_colour) xosd_set_outline_colour(osd, outline_colour);
-  if (colour) xosd_set_colour(osd, colour);
-  xosd_set_timeout(osd, delay);
-  xosd_set_pos(osd, pos);
-  xosd_set_vertical_offset(osd, voffset);
-  xosd_set_horizontal_offset(osd, hoffset);
-  xosd_set_align(osd, align);
-  if (font && xosd_set_font(osd, font)) {
+  if (out_style() == -1) {
     /* This is critical, because fontset=NULL, will segfault later! */
     fprintf(stderr, "ABORT: %s\n", xosd_error);
     return EXIT_FAILURE;
@@ -262,14 +630,22 @@ main(int argc, char *argv[])
 
   switch (barmode) {
     case bar_percentage:
-      if (text) xosd_display(osd, 0, XOSD_string, text);
-      xosd_display(osd, text ? 1 : 0, XOSD_percentage, percentage);
+      if (text) out_string(0, text);
+      out_bar(text ? 1 : 0, XOSD_percentage, percentage);
       break;
     case bar_slider:
-      if (text) xosd_display(osd, 0, XOSD_string, text);
-      xosd_display(osd, text ? 1 : 0, XOSD_slider, percentage);
+      if (text) out_string(0, text);
+      out_bar(text ? 1 : 0, XOSD_slider, percentage);
       break;
     case bar_none:
+      /* A warm instance may still show the lines of its last client. */
+      if (daemon_conn && lines > 1)
+        out_scroll(lines);
+      if (drain) {
+        drain_input(fp);
+        fclose(fp);
+        break;
+      }
       /* Not really needed, but at least we aren't throwing around an unknown value */
       old_age.tv_sec = 0;
 
@@ -277,14 +653,15 @@ main(int argc, char *argv[])
         gettimeofday(&old_age, 0);
 
       while (!feof(fp)) {
-        if (fgets(buffer, sizeof(buffer) - 1, fp)) {
+        if (getline(&buffer, &buffer_size, fp) != -1) {
           char *newline = strchr(buffer, '\n');
+          int n;
           if (newline)
             newline[0] = '\0';
 
           /* Enforce delay even when new lines are available */
-          if (forcewait && xosd_is_onscreen(osd))
-            xosd_wait_until_no_display(osd);
+          if (forcewait)
+            out_wait();
 
           /* If more than scroll_age time passes after the last time somethings
            * was displayed, clear the full display by scolling off all lines at
@@ -293,18 +670,20 @@ main(int argc, char *argv[])
             gettimeofday(&new_age, 0);
             if ((new_age.tv_sec - old_age.tv_sec) > scroll_age) {
               if (lines > 1)
-                xosd_scroll(osd, lines);
+                out_scroll(lines);
               screen_line = 0;
             }
           }
-          /* else scroll of the first line if the display is full. */
-          if (screen_line >= lines) {
+          /* else scroll off the first lines if the text does not fit. */
+          n = out_lines(buffer);
+          if (screen_line + n > lines) {
             if (lines > 1)
-              xosd_scroll(osd, 1);
-            screen_line = lines - 1;
+              out_scroll(screen_line + n - lines);
+            screen_line = lines - n;
           }
 
-          xosd_display(osd, screen_line++, XOSD_string, buffer);
+          out_string(screen_line, buffer);
+          screen_line += n;
 
           old_age.tv_sec = new_age.tv_sec;
         } else if (!feof(fp)) {
@@ -314,12 +693,11 @@ main(int argc, char *argv[])
         }
       }
       fclose(fp);
+      free(buffer);
       break;
   }
 
-  if (xosd_is_onscreen(osd))
-    xosd_wait_until_no_display(osd);
-  xosd_destroy(osd);
+  out_destroy();
 
   return EXIT_SUCCESS;
 }
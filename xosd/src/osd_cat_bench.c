@@ -0,0 +1,115 @@
+/* osd_cat_bench -- measure how fast osd_cat consumes a flood of lines
+ *
+ * A synthetic producer writes fixed size lines into osd_cat's standard
+ * input as fast as the pipe accepts them. The throughput is the number of
+ * lines written divided by the time until osd_cat has exited, so lines
+ * still queued in the pipe are accounted for.
+ *
+ * Usage: osd_cat_bench [-s SECONDS] [-- OSD_CAT [ARGS...]]
+ * Without a command line, ./osd_cat is run once line by line and once in
+ * --drain mode.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LINE_LEN 64
+#define BLOCK_LINES 1024
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+run(char *const argv[], double seconds)
+{
+  static char block[LINE_LEN * BLOCK_LINES];
+  unsigned long lines = 0;
+  double start, stop;
+  int fds[2], status, i;
+  pid_t pid;
+
+  for (i = 0; i < BLOCK_LINES; i++) {
+    snprintf(block + i * LINE_LEN, LINE_LEN, "%-*s%08d", LINE_LEN - 9,
+             "osd_cat_bench synthetic log line", i);
+    block[(i + 1) * LINE_LEN - 1] = '\n';
+  }
+
+  if (pipe(fds) == -1) {
+    perror("pipe");
+    return -1;
+  }
+  start = now();
+  if ((pid = fork()) == 0) {
+    dup2(fds[0], 0);
+    close(fds[0]);
+    close(fds[1]);
+    execvp(argv[0], argv);
+    perror(argv[0]);
+    _exit(127);
+  }
+  close(fds[0]);
+
+  while (now() - start < seconds) {
+    size_t done = 0;
+    ssize_t got;
+    while (done < sizeof(block)) {
+      got = write(fds[1], block + done, sizeof(block) - done);
+      if (got == -1 && errno == EINTR)
+        continue;
+      if (got == -1)
+        goto out;               /* osd_cat is gone */
+      done += got;
+    }
+    lines += BLOCK_LINES;
+  }
+out:
+  close(fds[1]);
+  waitpid(pid, &status, 0);
+  stop = now();
+
+  for (i = 0; argv[i]; i++)
+    printf("%s%s", i ? " " : "", argv[i]);
+  printf(": %lu lines in %.2fs, %.0f lines/s\n", lines, stop - start,
+         lines / (stop - start));
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *plain[] = { "./osd_cat", "-l", "5", "-d", "1", NULL };
+  char *drain[] = { "./osd_cat", "-l", "5", "-d", "1", "--drain", NULL };
+  double seconds = 5;
+  int c, retval = 0;
+
+  while ((c = getopt(argc, argv, "s:h")) != -1) {
+    switch (c) {
+    case 's':
+      seconds = atof(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-s SECONDS] [-- OSD_CAT [ARGS...]]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  if (optind < argc)
+    return run(argv + optind, seconds) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+  retval |= run(plain, seconds);
+  retval |= run(drain, seconds);
+  return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
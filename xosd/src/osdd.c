@@ -0,0 +1,413 @@
+/* osdd -- keep xosd objects warm for short lived clients
+ *
+ * Clients such as "osd_cat --daemon" connect to a UNIX socket and send the
+ * messages described in osdd.h. Instances survive their clients, so a
+ * script showing the volume pays for a socket write instead of connecting
+ * to X, loading a font and waiting for the display timeout every time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <locale.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <X11/Xlib.h>
+
+#include <xosd.h>
+#include "osdd.h"
+
+#define MAX_CLIENTS 64
+
+struct instance
+{
+  xosd *osd;
+  int lines;
+  /* Last value of every property, so it survives a recreation and
+   * repeated settings are free. */
+  int set[OSDD_nproperties];
+  int value[OSDD_nproperties];
+  char *string[OSDD_nproperties];
+};
+
+struct client
+{
+  int fd;
+  char *buf;
+  size_t len;
+  int failed;                   /* a message failed since the last OSDD_sync */
+};
+
+static struct instance instances[256];
+static struct client clients[MAX_CLIENTS];
+static int nclients = 0;
+static int verbose = 0;
+static volatile sig_atomic_t quit = 0;
+
+static void
+on_signal(int sig)
+{
+  (void) sig;
+  quit = 1;
+}
+
+/* apply -- Pass one cached property on to the xosd object {{{ */
+static int
+apply(struct instance *in, enum osdd_property p)
+{
+  xosd *osd = in->osd;
+  int v = in->value[p];
+  char *s = in->string[p];
+
+  switch (p) {
+  case OSDD_font:
+    return xosd_set_font(osd, s);
+  case OSDD_colour:
+    return xosd_set_colour(osd, s);
+  case OSDD_shadow_colour:
+    return xosd_set_shadow_colour(osd, s);
+  case OSDD_outline_colour:
+    return xosd_set_outline_colour(osd, s);
+  case OSDD_timeout:
+    return xosd_set_timeout(osd, v);
+  case OSDD_pos:
+    return xosd_set_pos(osd, v);
+  case OSDD_align:
+    return xosd_set_align(osd, v);
+  case OSDD_vertical_offset:
+    return xosd_set_vertical_offset(osd, v);
+  case OSDD_horizontal_offset:
+    return xosd_set_horizontal_offset(osd, v);
+  case OSDD_shadow_offset:
+    return xosd_set_shadow_offset(osd, v);
+  case OSDD_shadow_direction:
+    return xosd_set_shadow_direction(osd, v);
+  case OSDD_outline_offset:
+    return xosd_set_outline_offset(osd, v);
+  case OSDD_bar_length:
+    return xosd_set_bar_length(osd, v);
+  case OSDD_monitor:
+    return xosd_monitor(osd, v);
+  case OSDD_frame_rate:
+    return xosd_set_frame_rate(osd, v);
+  case OSDD_ticker_speed:
+    return xosd_set_ticker_speed(osd, v);
+  default:
+    return -1;
+  }
+}
+
+/* }}} */
+
+static int
+is_string_property(enum osdd_property p)
+{
+  return p <= OSDD_outline_colour;
+}
+
+/* open_instance -- Create or recreate an instance {{{ */
+static int
+open_instance(struct instance *in, int lines)
+{
+  int p;
+
+  if (in->osd != NULL && in->lines == lines)
+    return 0;
+  if (in->osd != NULL)
+    xosd_destroy(in->osd);
+  in->lines = 0;
+  if ((in->osd = xosd_create(lines)) == NULL)
+    return -1;
+  in->lines = lines;
+
+  for (p = 0; p < OSDD_nproperties; p++)
+    if (in->set[p] && apply(in, p) == -1)
+      fprintf(stderr, "osdd: property %d: %s\n", p, xosd_error);
+  return 0;
+}
+
+/* }}} */
+
+/* set_property -- Store and apply a property unless it is unchanged {{{ */
+static int
+set_property(struct instance *in, enum osdd_property p, const char *s,
+             int v)
+{
+  if (p >= OSDD_nproperties || is_string_property(p) != (s != NULL))
+    return -1;
+
+  if (in->set[p]) {
+    if (s ? strcmp(s, in->string[p]) == 0 : v == in->value[p])
+      return 0;
+  }
+  if (s) {
+    char *copy = strdup(s);
+    if (copy == NULL)
+      return -1;
+    free(in->string[p]);
+    in->string[p] = copy;
+  }
+  in->value[p] = v;
+  in->set[p] = 1;
+
+  return in->osd ? apply(in, p) : 0;
+}
+
+/* }}} */
+
+/* handle -- Execute one message {{{ */
+static int
+handle(struct client *cl, const struct osdd_header *h, char *payload)
+{
+  struct instance *in = &instances[h->instance];
+  int32_t v = 0;
+
+  if (h->op != OSDD_string && h->op != OSDD_set_string &&
+      h->op != OSDD_ticker) {
+    if (h->length == sizeof(v))
+      memcpy(&v, payload, sizeof(v));
+    else if (h->length != 0)
+      return -1;
+  }
+  /* There is always room for the terminator, see read_client(). */
+  payload[h->length] = '\0';
+
+  if (h->op == OSDD_open) {
+    /* X would refuse the window height with an error killing the daemon. */
+    if (v < 1 || v > OSDD_MAX_LINES) {
+      xosd_error = "bad number of lines";
+      return -1;
+    }
+    return open_instance(in, v);
+  }
+  if (h->op == OSDD_set_int)
+    return set_property(in, h->arg, NULL, v);
+  if (h->op == OSDD_set_string)
+    return set_property(in, h->arg, payload, 0);
+  if (h->op == OSDD_sync) {
+    char ack = cl->failed;
+    cl->failed = 0;
+    return write(cl->fd, &ack, 1) == 1 ? 0 : -1;
+  }
+
+  if (in->osd == NULL) {
+    xosd_error = "instance not opened";
+    return -1;
+  }
+  switch (h->op) {
+  case OSDD_string:
+    return xosd_display(in->osd, h->arg, XOSD_string, payload);
+  case OSDD_percentage:
+    return xosd_display(in->osd, h->arg, XOSD_percentage, v);
+  case OSDD_slider:
+    return xosd_display(in->osd, h->arg, XOSD_slider, v);
+  case OSDD_show:
+    return xosd_show(in->osd);
+  case OSDD_hide:
+    return xosd_hide(in->osd);
+  case OSDD_scroll:
+    return xosd_scroll(in->osd, v);
+  case OSDD_ticker:
+    return xosd_display(in->osd, h->arg, XOSD_ticker, payload);
+  default:
+    xosd_error = "unknown message";
+    return -1;
+  }
+}
+
+/* }}} */
+
+/* read_client -- Read from a client and run complete messages {{{
+ * Returns -1 when the client should be dropped. */
+static int
+read_client(struct client *cl)
+{
+  const size_t size = sizeof(struct osdd_header) + OSDD_MAX_PAYLOAD + 1;
+  struct osdd_header h;
+  size_t done = 0;
+  ssize_t got;
+
+  if (cl->buf == NULL && (cl->buf = malloc(size)) == NULL)
+    return -1;
+  got = read(cl->fd, cl->buf + cl->len, size - 1 - cl->len);
+  if (got == -1)
+    return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+  if (got == 0)
+    return -1;
+  cl->len += got;
+
+  while (cl->len - done >= sizeof(h)) {
+    memcpy(&h, cl->buf + done, sizeof(h));
+    if (h.length > OSDD_MAX_PAYLOAD)
+      return -1;
+    if (cl->len - done - sizeof(h) < h.length)
+      break;
+    /* The payload is terminated in place, save the byte after it. */
+    {
+      char *payload = cl->buf + done + sizeof(h);
+      char next = payload[h.length];
+      if (handle(cl, &h, payload) == -1) {
+        cl->failed = 1;
+        if (verbose)
+          fprintf(stderr, "osdd: op %d on instance %d: %s\n", h.op,
+                  h.instance, xosd_error ? xosd_error : "bad message");
+      }
+      payload[h.length] = next;
+    }
+    done += sizeof(h) + h.length;
+  }
+  memmove(cl->buf, cl->buf + done, cl->len - done);
+  cl->len -= done;
+  return 0;
+}
+
+/* }}} */
+
+/* open_socket -- Listen on path, replacing a stale socket {{{ */
+static int
+open_socket(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "osdd: socket path too long: %s\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+    perror("osdd: socket");
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "osdd: already running on %s\n", path);
+    close(fd);
+    return -1;
+  }
+  unlink(path);
+
+  umask(077);
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1
+      || listen(fd, 16) == -1) {
+    fprintf(stderr, "osdd: %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+/* }}} */
+
+static void
+drop_client(int i)
+{
+  close(clients[i].fd);
+  free(clients[i].buf);
+  clients[i] = clients[--nclients];
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[PATH_MAX];
+  struct pollfd fds[MAX_CLIENTS + 1];
+  int foreground = 0, listen_fd, c, i, p;
+
+  if (setlocale(LC_ALL, "") == NULL || !XSupportsLocale())
+    fprintf(stderr, "Locale not available, expect problems with fonts.\n");
+
+  if (osdd_socket_path(path, sizeof(path)) == -1)
+    path[0] = '\0';
+  while ((c = getopt(argc, argv, "s:fvh")) != -1) {
+    switch (c) {
+    case 's':
+      snprintf(path, sizeof(path), "%s", optarg);
+      break;
+    case 'f':
+      foreground = 1;
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-f] [-v] [-s SOCKET]\n"
+              "Keep xosd displays open for osd_cat --daemon and other clients.\n"
+              "\n"
+              "  -f         Stay in the foreground\n"
+              "  -v         Report failed requests on standard error\n"
+              "  -s SOCKET  Listen on SOCKET (default: %s)\n", argv[0],
+              path);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if ((listen_fd = open_socket(path)) == -1)
+    return EXIT_FAILURE;
+  if (!foreground && daemon(0, verbose) == -1) {
+    perror("osdd: daemon");
+    return EXIT_FAILURE;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  while (!quit) {
+    fds[0].fd = listen_fd;
+    fds[0].events = nclients < MAX_CLIENTS ? POLLIN : 0;
+    for (i = 0; i < nclients; i++) {
+      fds[i + 1].fd = clients[i].fd;
+      fds[i + 1].events = POLLIN;
+    }
+    if (poll(fds, nclients + 1, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("osdd: poll");
+      break;
+    }
+
+    /* Backwards, so dropping a client does not skip another one. */
+    for (i = nclients - 1; i >= 0; i--) {
+      if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+        if (read_client(&clients[i]) == -1)
+          drop_client(i);
+    }
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listen_fd, NULL, NULL);
+      if (fd != -1) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        clients[nclients].fd = fd;
+        clients[nclients].buf = NULL;
+        clients[nclients].len = 0;
+        clients[nclients].failed = 0;
+        nclients++;
+      }
+    }
+  }
+
+  while (nclients > 0)
+    drop_client(nclients - 1);
+  close(listen_fd);
+  unlink(path);
+  for (i = 0; i < 256; i++) {
+    if (instances[i].osd)
+      xosd_destroy(instances[i].osd);
+    for (p = 0; p < OSDD_nproperties; p++)
+      free(instances[i].string[p]);
+  }
+  return EXIT_SUCCESS;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
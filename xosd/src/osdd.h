@@ -0,0 +1,178 @@
+#ifndef OSDD_H
+#define OSDD_H
+
+#include <stdint.h>
+#include <xosd.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* osdd keeps xosd objects alive in a daemon, so scripts do not pay for
+ * xosd_create() and the whole display timeout on every message. Clients
+ * talk to it over a local UNIX socket using the small binary protocol
+ * below; the functions further down wrap it. */
+
+/* Protocol {{{
+ * Every message is a header followed by "length" bytes of payload, all in
+ * host byte order. Integer payloads are a single int32_t, string payloads
+ * are not NUL terminated. Only OSDD_sync is answered, with one byte, once
+ * all previous messages on the connection have been applied: 0, or 1 if
+ * one of them failed since the last OSDD_sync. */
+  struct osdd_header
+  {
+    uint8_t op;                 /* enum osdd_op */
+    uint8_t instance;           /* which of the daemon's xosd objects */
+    uint16_t arg;               /* line or property, depending on op */
+    uint32_t length;            /* bytes of payload following */
+  };
+
+#define OSDD_MAX_PAYLOAD 65536
+#define OSDD_MAX_LINES 64        /* of an instance, see OSDD_open */
+
+  enum osdd_op
+  {
+    OSDD_open = 0,              /* int: lines, 1 to OSDD_MAX_LINES, (re)create */
+    OSDD_string,                /* arg: line; string: text */
+    OSDD_percentage,            /* arg: line; int: percentage */
+    OSDD_slider,                /* arg: line; int: percentage */
+    OSDD_set_int,               /* arg: enum osdd_property; int: value */
+    OSDD_set_string,            /* arg: enum osdd_property; string: value */
+    OSDD_show,
+    OSDD_hide,
+    OSDD_scroll,                /* int: lines */
+    OSDD_sync,
+    OSDD_ticker                 /* arg: line; string: text */
+  };
+
+  enum osdd_property
+  {
+    OSDD_font = 0,              /* string */
+    OSDD_colour,                /* string */
+    OSDD_shadow_colour,         /* string */
+    OSDD_outline_colour,        /* string */
+    OSDD_timeout,               /* int */
+    OSDD_pos,                   /* int: xosd_pos */
+    OSDD_align,                 /* int: xosd_align */
+    OSDD_vertical_offset,       /* int */
+    OSDD_horizontal_offset,     /* int */
+    OSDD_shadow_offset,         /* int */
+    OSDD_shadow_direction,      /* int */
+    OSDD_outline_offset,        /* int */
+    OSDD_bar_length,            /* int */
+    OSDD_monitor,               /* int */
+    OSDD_frame_rate,            /* int */
+    OSDD_ticker_speed,          /* int: pixels per second */
+    OSDD_nproperties
+  };
+
+/* }}} */
+
+/* The connection to the daemon "object" */
+  typedef struct osdd osdd;
+
+/* osdd_socket_path -- Get the default socket of the daemon
+ *
+ * $OSDD_SOCKET if set, otherwise "osdd" in $XDG_RUNTIME_DIR, otherwise
+ * /tmp/osdd-UID.
+ *
+ * ARGUMENTS
+ *     path     Buffer for the path.
+ *     size     Size of the buffer.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 if the path does not fit
+ */
+  int osdd_socket_path(char *path, size_t size);
+
+/* osdd_connect -- Connect to the daemon
+ *
+ * ARGUMENTS
+ *     path     Socket of the daemon, NULL for the default.
+ *
+ * RETURNS
+ *     A new osdd connection, NULL on failure.
+ */
+  osdd *osdd_connect(const char *path);
+
+/* osdd_close -- Close the connection
+ *
+ * Messages already sent are still applied by the daemon.
+ *
+ * ARGUMENTS
+ *     c        The connection.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int osdd_close(osdd * c);
+
+/* osdd_open -- Make sure an instance exists
+ *
+ * The daemon creates the instance, or recreates it when it has a different
+ * number of lines. Its style is kept between connections.
+ *
+ * ARGUMENTS
+ *     c             The connection.
+ *     instance      Instance number, 0 to 255.
+ *     number_lines  Number of lines of the display, 1 to OSDD_MAX_LINES.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int osdd_open(osdd * c, int instance, int number_lines);
+
+/* osdd_display -- Display information, like xosd_display()
+ *
+ * XOSD_printf is formatted on the client side.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int osdd_display(osdd * c, int instance, int line, xosd_command command,
+                   ...);
+
+/* osdd_set_int, osdd_set_string -- Change the style of an instance
+ *
+ * Equivalent to the matching xosd_set_*() call, see enum osdd_property.
+ * The daemon skips values which are already set.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int osdd_set_int(osdd * c, int instance, enum osdd_property property,
+                   int value);
+  int osdd_set_string(osdd * c, int instance, enum osdd_property property,
+                      const char *value);
+
+/* osdd_show, osdd_hide, osdd_scroll -- Like xosd_show(), xosd_hide() and
+ * xosd_scroll()
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int osdd_show(osdd * c, int instance);
+  int osdd_hide(osdd * c, int instance);
+  int osdd_scroll(osdd * c, int instance, int lines);
+
+/* osdd_sync -- Wait until the daemon has applied all sent messages
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure, also when one of the messages sent since the last
+ *     osdd_sync() failed, such as osdd_open() without an X display
+ */
+  int osdd_sync(osdd * c);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
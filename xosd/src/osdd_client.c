@@ -0,0 +1,253 @@
+/* osdd_client -- talk to the osdd daemon
+ *
+ * Every call writes one message with a single writev(); nothing is
+ * buffered, so a message is on its way as soon as the call returns.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "osdd.h"
+
+struct osdd
+{
+  int fd;
+};
+
+/* osdd_socket_path -- Get the default socket of the daemon {{{ */
+int
+osdd_socket_path(char *path, size_t size)
+{
+  const char *env;
+  int len;
+
+  if ((env = getenv("OSDD_SOCKET")) != NULL && *env)
+    len = snprintf(path, size, "%s", env);
+  else if ((env = getenv("XDG_RUNTIME_DIR")) != NULL && *env)
+    len = snprintf(path, size, "%s/osdd", env);
+  else
+    len = snprintf(path, size, "/tmp/osdd-%d", (int) getuid());
+
+  return (len < 0 || (size_t) len >= size) ? -1 : 0;
+}
+
+/* }}} */
+
+/* osdd_connect -- Connect to the daemon {{{ */
+osdd *
+osdd_connect(const char *path)
+{
+  struct sockaddr_un addr;
+  osdd *c;
+  int fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path == NULL) {
+    if (osdd_socket_path(addr.sun_path, sizeof(addr.sun_path)) == -1)
+      return NULL;
+  } else {
+    if (strlen(path) >= sizeof(addr.sun_path))
+      return NULL;
+    strcpy(addr.sun_path, path);
+  }
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    return NULL;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  if ((c = malloc(sizeof(osdd))) == NULL) {
+    close(fd);
+    return NULL;
+  }
+  c->fd = fd;
+  return c;
+}
+
+/* }}} */
+
+/* osdd_close -- Close the connection {{{ */
+int
+osdd_close(osdd * c)
+{
+  int ret;
+
+  if (c == NULL)
+    return -1;
+  ret = close(c->fd);
+  free(c);
+  return ret == 0 ? 0 : -1;
+}
+
+/* }}} */
+
+/* send_message -- Write one header and its payload {{{ */
+static int
+send_message(osdd * c, enum osdd_op op, int instance, int arg,
+             const void *payload, size_t length)
+{
+  struct osdd_header header;
+  struct iovec iov[2];
+  int n = 0;
+
+  if (c == NULL || instance < 0 || instance > 255 || arg < 0 || arg > 65535
+      || length > OSDD_MAX_PAYLOAD)
+    return -1;
+
+  header.op = op;
+  header.instance = instance;
+  header.arg = arg;
+  header.length = length;
+  iov[0].iov_base = &header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = (void *) payload;
+  iov[1].iov_len = length;
+
+  while (n < 2) {
+    ssize_t done = writev(c->fd, iov + n, 2 - n);
+    if (done == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    /* Partial write, skip what went out already. */
+    while (n < 2 && (size_t) done >= iov[n].iov_len)
+      done -= iov[n++].iov_len;
+    if (n < 2) {
+      iov[n].iov_base = (char *) iov[n].iov_base + done;
+      iov[n].iov_len -= done;
+    }
+  }
+  return 0;
+}
+
+static int
+send_int(osdd * c, enum osdd_op op, int instance, int arg, int value)
+{
+  int32_t v = value;
+  return send_message(c, op, instance, arg, &v, sizeof(v));
+}
+
+/* }}} */
+
+/* osdd_open -- Make sure an instance exists {{{ */
+int
+osdd_open(osdd * c, int instance, int number_lines)
+{
+  if (number_lines < 1 || number_lines > OSDD_MAX_LINES)
+    return -1;
+  return send_int(c, OSDD_open, instance, 0, number_lines);
+}
+
+/* }}} */
+
+/* osdd_display -- Display information {{{ */
+int
+osdd_display(osdd * c, int instance, int line, xosd_command command, ...)
+{
+  char buf[2000];
+  const char *string;
+  va_list a;
+  int ret = -1;
+
+  va_start(a, command);
+  switch (command) {
+  case XOSD_printf:
+    string = va_arg(a, char *);
+    if (vsnprintf(buf, sizeof(buf), string, a) >= (int) sizeof(buf))
+      break;
+    ret = send_message(c, OSDD_string, instance, line, buf, strlen(buf));
+    break;
+  case XOSD_string:
+  case XOSD_ticker:
+    string = va_arg(a, char *);
+    ret = send_message(c, command == XOSD_ticker ? OSDD_ticker : OSDD_string,
+                       instance, line, string, strlen(string));
+    break;
+  case XOSD_percentage:
+    ret = send_int(c, OSDD_percentage, instance, line, va_arg(a, int));
+    break;
+  case XOSD_slider:
+    ret = send_int(c, OSDD_slider, instance, line, va_arg(a, int));
+    break;
+  case XOSD_end:
+    break;
+  }
+  va_end(a);
+
+  return ret;
+}
+
+/* }}} */
+
+/* osdd_set_int, osdd_set_string -- Change the style of an instance {{{ */
+int
+osdd_set_int(osdd * c, int instance, enum osdd_property property, int value)
+{
+  return send_int(c, OSDD_set_int, instance, property, value);
+}
+
+int
+osdd_set_string(osdd * c, int instance, enum osdd_property property,
+                const char *value)
+{
+  if (value == NULL)
+    return -1;
+  return send_message(c, OSDD_set_string, instance, property, value,
+                      strlen(value));
+}
+
+/* }}} */
+
+/* osdd_show, osdd_hide, osdd_scroll {{{ */
+int
+osdd_show(osdd * c, int instance)
+{
+  return send_message(c, OSDD_show, instance, 0, NULL, 0);
+}
+
+int
+osdd_hide(osdd * c, int instance)
+{
+  return send_message(c, OSDD_hide, instance, 0, NULL, 0);
+}
+
+int
+osdd_scroll(osdd * c, int instance, int lines)
+{
+  return send_int(c, OSDD_scroll, instance, 0, lines);
+}
+
+/* }}} */
+
+/* osdd_sync -- Wait until the daemon has applied all sent messages {{{ */
+int
+osdd_sync(osdd * c)
+{
+  char ack;
+  ssize_t got;
+
+  if (send_message(c, OSDD_sync, 0, 0, NULL, 0) == -1)
+    return -1;
+  do
+    got = read(c->fd, &ack, 1);
+  while (got == -1 && errno == EINTR);
+  return got == 1 && ack == 0 ? 0 : -1;
+}
+
+/* }}} */
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -0,0 +1,209 @@
+/* player_bench -- drive the player engine of the XMMS and BMP plugins
+ *
+ * Feeds the engine in player_osd.c from a file or FIFO instead of a media
+ * player, see player_fifo.c for the format. By default it polls as fast
+ * as it can for a while, starting the file over at its end, and writes
+ * polls per second, the time per poll and the reads and titles per poll as
+ * JSON. It then plays a minute of an idle player in simulated time, with
+ * a source taking eight round trips a poll like XMMS, to show the calls
+ * the polling back off saves:
+ *
+ *   ./player_bench -H 1280x1024 -f changes.txt
+ *
+ * With -l, it polls at the pace of the plugins and shows the changes on
+ * the screen until the file ends, which a FIFO never does:
+ *
+ *   mkfifo /tmp/player && ./player_bench -l -f /tmp/player &
+ *   echo "volume 60" > /tmp/player
+ *
+ * Without -f, a built-in script of volume changes, song changes and quiet
+ * polls is played.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "xosd.h"
+#include "player_osd.h"
+
+static const struct player_show show_all = { 1, 1, 1, 1, 1, 1, 1 };
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* A file of 1000 polls: a song change every 100, a volume change every 10
+ * and nothing new in between. */
+static struct player_fifo *
+builtin_script(void)
+{
+  char path[] = "/tmp/player_bench.XXXXXX";
+  struct player_fifo *fifo;
+  FILE *f;
+  int fd, i;
+
+  if ((fd = mkstemp(path)) == -1 || (f = fdopen(fd, "w")) == NULL) {
+    perror("player_bench");
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f, "playing 1\nlength 10\nvolume 50\nbalance 50\n");
+  for (i = 0; i < 1000; i++) {
+    if (i % 100 == 0)
+      fprintf(f, "pos %d\ntitle Song_number_%%23%d\n", i / 100, i / 100);
+    else if (i % 10 == 0)
+      fprintf(f, "volume %d\n", 40 + i % 100 / 10);
+    fprintf(f, "\n");
+  }
+  fclose(f);
+  fifo = player_fifo_open(path);
+  unlink(path);
+  return fifo;
+}
+
+/* A player that never changes, costing what XMMS does. */
+static int
+idle_state(void *data, struct player_state *state)
+{
+  (void) data;
+  state->playing = 1;
+  state->length = 10;
+  state->volume = 50;
+  state->balance = 50;
+  return 8;
+}
+
+static char *
+idle_title(void *data, int pos)
+{
+  (void) data;
+  (void) pos;
+  return strdup("Idle");
+}
+
+static int
+idle_output_time(void *data)
+{
+  (void) data;
+  return 0;
+}
+
+static const struct player_source idle_source = {
+  .name = "idle",
+  .state = idle_state,
+  .title = idle_title,
+  .output_time = idle_output_time,
+};
+
+int
+main(int argc, char *argv[])
+{
+  struct player_fifo *fifo;
+  struct player_osd player;
+  const char *path = NULL;
+  double seconds = 1, start, elapsed;
+  int c, live = 0, width = 0, height = 0;
+  unsigned long ms;
+  xosd *osd;
+  FILE *out = stdout;
+
+  while ((c = getopt(argc, argv, "f:H:ls:o:h")) != -1) {
+    switch (c) {
+    case 'f':
+      path = optarg;
+      break;
+    case 'H':
+      if (sscanf(optarg, "%dx%d", &width, &height) != 2) {
+        fprintf(stderr, "player_bench: -H WIDTHxHEIGHT\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'l':
+      live = 1;
+      break;
+    case 's':
+      seconds = atof(optarg);
+      break;
+    case 'o':
+      if ((out = fopen(optarg, "w")) == NULL) {
+        perror(optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-f FILE] [-H WxH] [-l] [-s SECONDS] [-o FILE]\n"
+              "  -f  Read the player states from FILE, a file or FIFO\n"
+              "  -H  Draw into memory, on a screen of W by H pixels\n"
+              "  -l  Poll at the pace of the plugins until FILE ends\n"
+              "  -s  Duration of the measurement (default 1)\n"
+              "  -o  Write the JSON results to FILE instead of stdout\n",
+              argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  fifo = path ? player_fifo_open(path) : builtin_script();
+  if (fifo == NULL) {
+    perror(path ? path : "player_bench");
+    return EXIT_FAILURE;
+  }
+  osd = width ? xosd_create_headless(2, width, height) : xosd_create(2);
+  if (osd == NULL) {
+    fprintf(stderr, "player_bench: %s\n", xosd_error);
+    return EXIT_FAILURE;
+  }
+  xosd_set_timeout(osd, 3);
+  xosd_set_layout(osd, XOSD_layout_ellipsis_middle);     /* as the plugins */
+
+  player_osd_init(&player, osd, &player_fifo_source, fifo, &show_all);
+  if (live) {
+    for (;;) {
+      int interval = player_osd_poll(&player);
+
+      if (player_fifo_eof(fifo))
+        break;
+      usleep(interval * 1000);
+    }
+    xosd_wait_until_no_display(osd);
+  } else {
+    start = now();
+    do {
+      player_osd_poll(&player);
+      if (player_fifo_eof(fifo) && player_fifo_rewind(fifo) == -1)
+        break;
+    } while (now() - start < seconds);
+    elapsed = now() - start;
+    fprintf(out, "{\n  \"source\": \"%s\",\n  \"seconds\": %g,\n"
+            "  \"polls_per_second\": %.0f,\n  \"us_per_poll\": %.2f,\n"
+            "  \"reads_per_poll\": %.3f,\n  \"titles_per_poll\": %.3f,\n"
+            "  \"displays\": %lu,\n", path ? path : "built-in", seconds,
+            player.polls / elapsed, elapsed * 1e6 / player.polls,
+            (double) player.calls / player.polls,
+            (double) player.titles / player.polls, player.displays);
+  }
+  player_osd_free(&player);
+
+  if (!live) {
+    /* A minute of an idle player, the first poll shows it playing. */
+    player_osd_init(&player, osd, &idle_source, NULL, &show_all);
+    for (ms = 0; ms < 60000; ms += player_osd_poll(&player));
+    fprintf(out, "  \"idle_minute\": {\"polls\": %lu, \"calls\": %lu, "
+            "\"calls_polling_every_%d_ms\": %d, \"last_interval_ms\": %d}\n"
+            "}\n", player.polls, player.calls, PLAYER_POLL_MIN,
+            (8 + 1) * 60000 / PLAYER_POLL_MIN, player.interval);
+    player_osd_free(&player);
+  }
+
+  player_fifo_close(fifo);
+  xosd_destroy(osd);
+  return out == stdout || fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -0,0 +1,187 @@
+/* A player source reading its state from a file or a FIFO, to drive and
+ * benchmark the player engine without a media player. Lines are
+ *
+ *   playing 1
+ *   volume 40
+ *   title Some_Song%21
+ *
+ * with the keys playing, paused, shuffle, repeat, pos, length, volume,
+ * balance, title and time. Keys not given keep their value. Every poll
+ * reads up to the next empty line, or up to what is there to read, so a
+ * file of blocks separated by empty lines is played one block per poll
+ * and "echo volume 60 > fifo" works as well. */
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "player_osd.h"
+
+struct player_fifo
+{
+  int fd;
+  int fifo;                     /* fd is a FIFO, not a file */
+  int eof;
+  char buf[4096];
+  size_t len;                   /* bytes in buf */
+  struct player_state state;
+  char *title;
+  int time;
+};
+
+struct player_fifo *
+player_fifo_open(const char *path)
+{
+  struct player_fifo *fifo;
+  struct stat st;
+
+  if ((fifo = calloc(1, sizeof(*fifo))) == NULL)
+    return NULL;
+  if (stat(path, &st) == -1) {
+    free(fifo);
+    return NULL;
+  }
+  /* Opened for writing as well, a FIFO does not end with its writers. */
+  fifo->fifo = S_ISFIFO(st.st_mode);
+  fifo->fd = open(path, (fifo->fifo ? O_RDWR : O_RDONLY) | O_NONBLOCK);
+  if (fifo->fd == -1) {
+    free(fifo);
+    return NULL;
+  }
+  return fifo;
+}
+
+int
+player_fifo_rewind(struct player_fifo *fifo)
+{
+  if (fifo->fifo || lseek(fifo->fd, 0, SEEK_SET) == -1)
+    return -1;
+  fifo->len = 0;
+  fifo->eof = 0;
+  return 0;
+}
+
+int
+player_fifo_eof(struct player_fifo *fifo)
+{
+  return fifo->eof && fifo->len == 0;
+}
+
+void
+player_fifo_close(struct player_fifo *fifo)
+{
+  close(fifo->fd);
+  free(fifo->title);
+  free(fifo);
+}
+
+/* Apply one line. */
+static void
+parse(struct player_fifo *fifo, char *line)
+{
+  static const struct
+  {
+    const char *key;
+    size_t offset;
+  } keys[] = {
+    {"playing", offsetof(struct player_state, playing)},
+    {"paused", offsetof(struct player_state, paused)},
+    {"shuffle", offsetof(struct player_state, shuffle)},
+    {"repeat", offsetof(struct player_state, repeat)},
+    {"pos", offsetof(struct player_state, pos)},
+    {"length", offsetof(struct player_state, length)},
+    {"volume", offsetof(struct player_state, volume)},
+    {"balance", offsetof(struct player_state, balance)},
+  };
+  char *value = strchr(line, ' ');
+  unsigned int i;
+
+  if (value == NULL)
+    return;
+  *value++ = '\0';
+  if (strcmp(line, "title") == 0) {
+    free(fifo->title);
+    fifo->title = strdup(value);
+  } else if (strcmp(line, "time") == 0)
+    fifo->time = atoi(value);
+  else
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+      if (strcmp(line, keys[i].key) == 0)
+        *(int *) ((char *) &fifo->state + keys[i].offset) = atoi(value);
+}
+
+static int
+fifo_state(void *data, struct player_state *state)
+{
+  struct player_fifo *fifo = data;
+  int reads = 0;
+
+  for (;;) {
+    char *nl = memchr(fifo->buf, '\n', fifo->len);
+    ssize_t n;
+
+    if (nl != NULL) {
+      size_t used = nl - fifo->buf + 1;
+      int blank = nl == fifo->buf;
+
+      *nl = '\0';
+      parse(fifo, fifo->buf);
+      memmove(fifo->buf, nl + 1, fifo->len - used);
+      fifo->len -= used;
+      if (blank)
+        break;
+      continue;
+    }
+    if (fifo->len == sizeof(fifo->buf) - 1)
+      fifo->len = 0;            /* a line too long, dropped */
+    n = read(fifo->fd, fifo->buf + fifo->len,
+             sizeof(fifo->buf) - 1 - fifo->len);
+    reads++;
+    if (n > 0)
+      fifo->len += n;
+    else {
+      if (n == 0 || errno != EAGAIN)
+        fifo->eof = 1;
+      if (fifo->eof && fifo->len > 0) {
+        /* The last line without a newline. */
+        fifo->buf[fifo->len] = '\0';
+        parse(fifo, fifo->buf);
+        fifo->len = 0;
+      }
+      break;
+    }
+  }
+  *state = fifo->state;
+  return reads;
+}
+
+static char *
+fifo_title(void *data, int pos)
+{
+  struct player_fifo *fifo = data;
+
+  (void) pos;
+  return fifo->title ? strdup(fifo->title) : NULL;
+}
+
+static int
+fifo_output_time(void *data)
+{
+  struct player_fifo *fifo = data;
+
+  return fifo->time;
+}
+
+const struct player_source player_fifo_source = {
+  .name = "fifo",
+  .state = fifo_state,
+  .title = fifo_title,
+  .output_time = fifo_output_time,
+};
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -0,0 +1,272 @@
+/* XOSD
+
+Copyright (c) 2001 Andre Renaud (andre@ignavus.net)
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+/* The state diffing and formatting of the player plugins, shared by the
+ * XMMS and BMP plugins and by player_bench.
+ *
+ * Every source call may be a round trip to the player, and players tell
+ * general plugins nothing about state changes. So the state is polled
+ * every PLAYER_POLL_MIN ms after a change, and the interval is doubled up
+ * to PLAYER_POLL_MAX ms after POLL_BACKOFF ms without one. The title is
+ * only fetched when the song might have changed, and every POLL_TITLE
+ * polls for titles changed in place. */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "player_osd.h"
+
+#define POLL_BACKOFF 2000
+#define POLL_TITLE 10
+/* Round trips a poll of the XMMS plugin took before the title was cached:
+ * eight for the state and one for the title. */
+#define FIXED_CALLS 8
+
+void
+player_osd_init(struct player_osd *player, xosd * osd,
+                const struct player_source *source, void *data,
+                const struct player_show *show)
+{
+  memset(player, 0, sizeof(*player));
+  player->osd = osd;
+  player->source = source;
+  player->data = data;
+  player->show = show;
+  player->interval = PLAYER_POLL_MIN;
+  player->stats = getenv("XOSD_PLUGIN_STATS") != NULL;
+}
+
+void
+player_osd_free(struct player_osd *player)
+{
+  free(player->previous.title);
+  player->previous.title = NULL;
+}
+
+/* Convert hexcodes to ASCII, and underscores to spaces if asked to. {{{ */
+static void
+replace_hexcodes(char *text, int convert_underscore)
+{
+  char *head, *tail;
+  int c;
+
+  for (head = tail = text; *head; head++, tail++) {
+    /* replace underscors with spaces if necessary */
+    if (convert_underscore && *head == '_') {
+      *tail = ' ';
+      continue;
+    }
+    /* replace hex with character if necessary */
+    if (*head == '%' && isxdigit((unsigned char) head[1])
+        && isxdigit((unsigned char) head[2])) {
+      sscanf(head + 1, "%2x", &c);
+      *tail = (char) c;
+      head += 2;
+      continue;
+    }
+    *tail = *head;
+  }
+  *tail = '\0';
+}
+
+/* }}} */
+
+/* Polling. {{{ */
+/* Count the round trips of the last minute, and what polling every
+ * PLAYER_POLL_MIN ms would have taken. */
+static void
+poll_count(struct player_osd *player, int calls)
+{
+  const struct player_state *s = &player->previous;
+
+  player->polls++;
+  player->calls += calls;
+  player->minute_calls += calls;
+  player->fixed_calls += (FIXED_CALLS + (s->length != 0)) *
+    player->interval / PLAYER_POLL_MIN;
+  player->elapsed += player->interval;
+  if (player->elapsed < 60000)
+    return;
+  if (player->stats)
+    fprintf(stderr, "xosd: %lu player calls per minute, %lu when polling "
+            "every %d ms\n", player->minute_calls * 60000 / player->elapsed,
+            player->fixed_calls * 60000 / player->elapsed, PLAYER_POLL_MIN);
+  player->elapsed = player->minute_calls = player->fixed_calls = 0;
+}
+
+/* Poll again after PLAYER_POLL_MIN ms after a change, back off while quiet. */
+static int
+poll_next(struct player_osd *player, int changed)
+{
+  if (changed) {
+    player->interval = PLAYER_POLL_MIN;
+    player->quiet = 0;
+  } else if (++player->quiet * player->interval >= POLL_BACKOFF
+             && player->interval < PLAYER_POLL_MAX) {
+    player->interval *= 2;
+    if (player->interval > PLAYER_POLL_MAX)
+      player->interval = PLAYER_POLL_MAX;
+    player->quiet = 0;
+  }
+  return player->interval;
+}
+
+/* }}} */
+
+/* Show the title line, with the time played if withtime. */
+static int
+show_title(struct player_osd *player, const struct player_state *current,
+           int withtime)
+{
+  char *title;
+  int len, calls = 0, playlist_time = 0;
+
+  len = 13 + strlen(current->title) + (withtime ? 11 : 0);
+  if ((title = malloc(len)) == NULL)
+    return 0;
+  if (withtime) {
+    playlist_time = player->source->output_time(player->data);
+    calls++;
+  }
+  snprintf(title, len,
+           withtime ? "%i/%i: %s (%i:%02i)" : "%i/%i: %s",
+           current->pos + 1, current->length, current->title,
+           playlist_time / 1000 / 60, playlist_time / 1000 % 60);
+  replace_hexcodes(title, player->convert_underscore);
+  xosd_display(player->osd, 1, XOSD_string, title);
+  free(title);
+  return calls;
+}
+
+/* player_osd_poll -- Poll the player once and show what changed {{{ */
+int
+player_osd_poll(struct player_osd *player)
+{
+  const struct player_show *show = player->show;
+  struct player_state current, *previous = &player->previous;
+  char *text = NULL;
+  int calls, songchange, showtext, changed, withtime = 0;
+
+  memset(&current, 0, sizeof(current));
+  calls = player->source->state(player->data, &current);
+
+  /* Get the current title only if the playlist is not empty. Otherwise
+   * XMMS crashes. Deleting a song changes the length, so an unchanged
+   * position and length keep the title. */
+  if (previous->title == NULL || previous->pos != current.pos
+      || previous->length != current.length
+      || previous->playing != current.playing
+      || ++player->title_polls >= POLL_TITLE) {
+    player->title_polls = 0;
+    if (current.length) {
+      current.title = player->source->title(player->data, current.pos);
+      player->titles++;
+      calls++;
+    }
+  } else
+    current.title = previous->title;
+
+  /* Check for song change. Deleting a song from the playlist only changed the
+   * name, but not the position, so compare also by (still hexencoded) name. */
+  songchange =
+    (previous->pos != current.pos) ||
+    (previous->title == NULL && current.title != NULL) ||
+    (previous->title != NULL && current.title == NULL) ||
+    (previous->title != NULL && current.title != NULL &&
+     (strcasecmp(previous->title, current.title) != 0));
+
+  /* Possible show something when either song or state changed. */
+  showtext = songchange ||
+    ((current.playing != previous->playing) ||
+     (current.paused != previous->paused));
+  changed = showtext || current.length != previous->length
+    || current.volume != previous->volume
+    || current.balance != previous->balance
+    || current.repeat != previous->repeat
+    || current.shuffle != previous->shuffle;
+
+  /* Determine right text depending on state and state/title change.
+   *    +---+          +---+
+   *    |   |          |   |
+   *    +->PLAY<---->STOP<-+
+   *        ^          ^
+   *        |          |
+   *        +-->PAUSE--+
+   */
+  if (!current.playing) {       /* {PLAY,PAUSE,STOP} -> STOP */
+    text = "Stopped";
+    showtext &= show->stop;
+  } else if (current.paused) {  /* PLAY -> PAUSE */
+    text = "Paused";
+    showtext &= show->pause;
+    withtime = 1;
+  } else if (previous->paused && !current.paused && !songchange) {      /* PAUSE -SameSong-> PLAY */
+    text = "Unpaused";
+    showtext &= show->pause;
+    withtime = 1;
+  } else {                      /* {PLAY,STOP} -> PLAY <-OtherSong- PAUSE */
+    text = "Playing";
+    showtext &= show->trackname;
+  }
+
+  /* Decide what to display, in decreasing priority. */
+  if (showtext) {
+    xosd_display(player->osd, 0, XOSD_string, text);
+    if (show->trackname && (current.title != NULL))
+      calls += show_title(player, &current, withtime);
+    else
+      xosd_display(player->osd, 1, XOSD_string, "");
+    player->displays++;
+  } else if (current.volume != previous->volume && show->volume) {
+    /* XMMS returns -1 during a title change. skip this and try again later. */
+    if ((previous->volume != -1) && (current.volume != -1)) {
+      xosd_display(player->osd, 0, XOSD_string, "Volume");
+      xosd_display(player->osd, 1, XOSD_percentage, current.volume);
+      player->displays++;
+    }
+  } else if (current.balance != previous->balance && show->balance) {
+    /* FIXME: Same as above might happen, but with what values? */
+    xosd_display(player->osd, 0, XOSD_string, "Balance");
+    xosd_display(player->osd, 1, XOSD_slider, current.balance);
+    player->displays++;
+  } else if (current.repeat != previous->repeat && show->repeat) {
+    xosd_display(player->osd, 0, XOSD_string, "Repeat");
+    xosd_display(player->osd, 1, XOSD_string, current.repeat ? "On" : "Off");
+    player->displays++;
+  } else if (current.shuffle != previous->shuffle && show->shuffle) {
+    xosd_display(player->osd, 0, XOSD_string, "Shuffle");
+    xosd_display(player->osd, 1, XOSD_string, current.shuffle ? "On" : "Off");
+    player->displays++;
+  }
+
+  /* Copy current state (including title) for future comparison. Free old
+   * title first. */
+  if (previous->title && previous->title != current.title)
+    free(previous->title);
+  *previous = current;
+
+  poll_count(player, calls);
+  return poll_next(player, changed);
+}
+
+/* }}} */
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -0,0 +1,99 @@
+/* The engine of the XMMS and BMP plugins: polls a player through a source,
+ * compares its state with the last poll and shows what changed. See
+ * player_osd.c, and player_fifo.c for a source reading a file or FIFO. */
+#ifndef PLAYER_OSD_H
+#define PLAYER_OSD_H
+
+#include <xosd.h>
+
+/* Polling starts at PLAYER_POLL_MIN ms and backs off to PLAYER_POLL_MAX ms
+ * while the player is quiet. */
+#define PLAYER_POLL_MIN 100
+#define PLAYER_POLL_MAX 800
+
+struct player_state
+{
+  int playing;
+  int paused;
+  int shuffle;
+  int repeat;
+  int pos;                      /* in the playlist, from 0 */
+  int length;                   /* of the playlist */
+  int volume;                   /* 0 to 100, -1 while changing songs */
+  int balance;                  /* 0 to 100 */
+  char *title;                  /* of the song at pos, NULL if none */
+};
+
+/* What the engine asks a player. Every call may be a round trip to it. */
+struct player_source
+{
+  const char *name;
+  /* Fill in everything but the title. Returns the number of round trips
+   * it took. */
+  int (*state) (void *data, struct player_state *state);
+  /* The title of the song at pos, malloc()ed, or NULL. Only asked for
+   * with a playlist that is not empty. */
+  char *(*title) (void *data, int pos);
+  /* Milliseconds into the current song. */
+  int (*output_time) (void *data);
+};
+
+/* Which changes are shown. */
+struct player_show
+{
+  int volume;
+  int balance;
+  int pause;
+  int trackname;
+  int stop;
+  int repeat;
+  int shuffle;
+};
+
+struct player_osd
+{
+  xosd *osd;
+  const struct player_source *source;
+  void *data;
+  const struct player_show *show;
+  int convert_underscore;       /* show '_' in titles as ' ' */
+  struct player_state previous;
+  /* Polling */
+  int interval;                 /* ms until the next poll */
+  int quiet;                    /* polls at interval without a change */
+  int title_polls;              /* polls since the title was fetched */
+  /* Counters, reported once a minute when XOSD_PLUGIN_STATS is set */
+  int stats;
+  unsigned long polls;
+  unsigned long calls;          /* round trips to the player */
+  unsigned long titles;         /* titles fetched */
+  unsigned long displays;       /* changes shown */
+  unsigned long elapsed;        /* ms since the last report */
+  unsigned long minute_calls;
+  unsigned long fixed_calls;    /* if polled every PLAYER_POLL_MIN ms */
+};
+
+void player_osd_init(struct player_osd *player, xosd * osd,
+                     const struct player_source *source, void *data,
+                     const struct player_show *show);
+/* Poll the player once and show what changed. Returns the ms to wait for
+ * the next poll. */
+int player_osd_poll(struct player_osd *player);
+void player_osd_free(struct player_osd *player);
+
+/* A source reading lines of "key value" from a file or FIFO, see
+ * player_fifo.c. */
+struct player_fifo;
+extern const struct player_source player_fifo_source;
+
+struct player_fifo *player_fifo_open(const char *path);
+/* Start over at the beginning of a file. -1 for a FIFO. */
+int player_fifo_rewind(struct player_fifo *fifo);
+/* Whether a file was read to its end. */
+int player_fifo_eof(struct player_fifo *fifo);
+void player_fifo_close(struct player_fifo *fifo);
+
+#endif
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -16,11 +16,15 @@ You should have received a copy of the GNU General Public License
 along with this program; if not, write to the Free Software
 Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 */
+/* The plugin side of the XMMS and BMP plugins: configuration, the player
+ * source and the GTK timers driving player_osd.c. Both plugins compile
+ * this file with their own GTK, only the dialogs differ between
+ * xmms_plugin/ and bmp_plugin/.
+ */
 
-#include <ctype.h>
 #include <gtk/gtk.h>
 
-#include "bmp_osd.h"
+#include "player_plugin.h"
 
 #include <xmms/plugin.h>
 #include <xmms/xmmsctrl.h>
@@ -29,6 +33,10 @@ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 static void init(void);
 static void cleanup(void);
 static gint timeout_func(gpointer);
+static void schedule_dispatch(void);
+static void input_func(gpointer, gint, GdkInputCondition);
+static void stop_dispatch(void);
+static const struct player_source xmms_source;
 
 GeneralPlugin gp = {
   .handle = NULL,
@@ -42,22 +50,15 @@ GeneralPlugin gp = {
 };
 
 
-struct state
-{
-  gboolean playing;
-  gboolean paused;
-  gboolean shuffle;
-  gboolean repeat;
-  int pos;
-  int volume;
-  int balance;
-  gchar *title;
-};
-static struct state previous;
-struct show show;
+struct player_show show;
+static struct player_osd player;
 
 xosd *osd = NULL;
 static guint timeout_tag;
+static guint dispatch_tag;
+static gint input_tag;
+static gint timeout_interval;
+static gboolean convert_underscore;
 
 gchar *font;
 gchar *colour;
@@ -90,33 +91,28 @@ init(void)
 
   if (osd) {
     DEBUG("uniniting osd");
+    stop_dispatch();
     xosd_destroy(osd);
     osd = NULL;
   }
 
   read_config();
 
-#if 0
-  /* Deadlocks, because it is to early. */
-  previous.playing = xmms_remote_is_playing(gp.xmms_session);
-  previous.paused = xmms_remote_is_paused(gp.xmms_session);
-  previous.shuffle = xmms_remote_is_shuffle(gp.xmms_session);
-  previous.repeat = xmms_remote_is_repeat(gp.xmms_session);
-  previous.pos = xmms_remote_get_playlist_pos(gp.xmms_session);
-  previous.volume = xmms_remote_get_main_volume(gp.xmms_session);
-  previous.balance = (xmms_remote_get_balance(gp.xmms_session) + 100) / 2;
-  previous.title = NULL;
-#else
-  memset(&previous, 0, sizeof(struct state));
-#endif
-
   DEBUG("calling osd init function");
 
-  osd = xosd_create(2);
+  /* The player state is not asked for here, that deadlocks this early.
+   * Everything runs in the GTK main loop, so libxosd needs no thread. */
+  osd = xosd_create_threadless(2, 0, 0);
+  player_osd_init(&player, osd, &xmms_source, NULL, &show);
   apply_config();
   DEBUG("osd initialized");
-  if (osd)
-    timeout_tag = gtk_timeout_add(100, timeout_func, NULL);
+  timeout_interval = PLAYER_POLL_MIN;
+  if (osd) {
+    timeout_tag = gtk_timeout_add(timeout_interval, timeout_func, NULL);
+    input_tag = gdk_input_add(xosd_get_fd(osd), GDK_INPUT_READ, input_func,
+                              NULL);
+    schedule_dispatch();
+  }
 }
 
 /*
@@ -140,12 +136,10 @@ cleanup(void)
     colour = NULL;
   }
 
-  if (previous.title) {
-    g_free(previous.title);
-    previous.title = NULL;
-  }
+  player_osd_free(&player);
 
   if (osd) {
+    stop_dispatch();
     DEBUG("hide");
     xosd_hide(osd);
     DEBUG("uninit");
@@ -202,6 +196,8 @@ read_config(void)
     xmms_cfg_read_int(cfgfile, "osd", "show_stop", &show.stop);
     xmms_cfg_read_int(cfgfile, "osd", "show_repeat", &show.repeat);
     xmms_cfg_read_int(cfgfile, "osd", "show_shuffle", &show.shuffle);
+    xmms_cfg_read_boolean(cfgfile, "xmms", "convert_underscore",
+                          &convert_underscore);
     xmms_cfg_free(cfgfile);
   }
 
@@ -255,6 +251,7 @@ void
 apply_config(void)
 {
   DEBUG("apply_config");
+  player.convert_underscore = convert_underscore;
   if (osd) {
     if (xosd_set_font(osd, font) == -1)
       DEBUG("invalid font %s", font);
@@ -267,55 +264,59 @@ apply_config(void)
     xosd_set_align(osd, align);
     xosd_set_vertical_offset(osd, offset);
     xosd_set_horizontal_offset(osd, h_offset);
+    /* Long titles lose their middle instead of running off the screen. */
+    xosd_set_layout(osd, XOSD_layout_ellipsis_middle);
   }
   DEBUG("done");
 }
 
 /*
- * Convert hexcode to ASCII.
+ * The player as a source of the player engine.
  */
-static void
-replace_hexcodes(gchar * text)
+static int
+xmms_state(void *data, struct player_state *state)
 {
-  gchar *head, *tail;
-  int conv_underscore, c;
-  ConfigFile *cfgfile;
-  DEBUG("replace_hexcodes");
+  state->playing = xmms_remote_is_playing(gp.xmms_session);
+  state->paused = xmms_remote_is_paused(gp.xmms_session);
+  state->shuffle = xmms_remote_is_shuffle(gp.xmms_session);
+  state->repeat = xmms_remote_is_repeat(gp.xmms_session);
+  state->pos = xmms_remote_get_playlist_pos(gp.xmms_session);
+  state->volume = xmms_remote_get_main_volume(gp.xmms_session);
+  state->balance = (xmms_remote_get_balance(gp.xmms_session) + 100) / 2;
+  state->length = xmms_remote_get_playlist_length(gp.xmms_session);
+  return 8;
+}
 
-  if ((cfgfile = xmms_cfg_open_default_file()) != NULL) {
-    xmms_cfg_read_boolean(cfgfile, "xmms", "convert_underscore",
-                          &conv_underscore);
-    xmms_cfg_free(cfgfile);
-  }
+static char *
+xmms_title(void *data, int pos)
+{
+  gchar *title = xmms_remote_get_playlist_title(gp.xmms_session, pos);
+  char *copy = title ? strdup(title) : NULL;
 
-  for (head = tail = text; *head; head++, tail++) {
-    /* replace underscors with spaces if necessary */
-    if (conv_underscore && *head == '_') {
-      *tail = ' ';
-      continue;
-    }
-    /* replace hex with character if necessary */
-    if (*head == '%' && isxdigit(head[1]) && isxdigit(head[2])) {
-      sscanf(head + 1, "%2x", &c);
-      *tail = (char) c;
-      head += 2;
-      continue;
-    }
-    *tail = *head;
-  }
-  *tail = '\0';
+  g_free(title);
+  return copy;
+}
+
+static int
+xmms_output_time(void *data)
+{
+  return xmms_remote_get_output_time(gp.xmms_session);
 }
 
+static const struct player_source xmms_source = {
+  .name = "xmms",
+  .state = xmms_state,
+  .title = xmms_title,
+  .output_time = xmms_output_time,
+};
+
 /*
  * Callback funtion to handle delayed display.
  */
 static gint
 timeout_func(gpointer data)
 {
-  struct state current;
-  char *text = NULL;
-  gboolean songchange, showtext, withtime = FALSE;
-  gint playlist_length;
+  gint interval;
 
   DEBUG("timeout func");
 
@@ -323,111 +324,57 @@ timeout_func(gpointer data)
     return FALSE;
 
   GDK_THREADS_ENTER();
+  interval = player_osd_poll(&player);
+  schedule_dispatch();
+  GDK_THREADS_LEAVE();
 
-  current.playing = xmms_remote_is_playing(gp.xmms_session);
-  current.paused = xmms_remote_is_paused(gp.xmms_session);
-  current.shuffle = xmms_remote_is_shuffle(gp.xmms_session);
-  current.repeat = xmms_remote_is_repeat(gp.xmms_session);
-  current.pos = xmms_remote_get_playlist_pos(gp.xmms_session);
-  current.volume = xmms_remote_get_main_volume(gp.xmms_session);
-  current.balance = (xmms_remote_get_balance(gp.xmms_session) + 100) / 2;
-
-  /* Get the current title only if the playlist is not empty. Otherwise
-   * it'll crash. Don't forget to free the title! */
-  playlist_length = xmms_remote_get_playlist_length(gp.xmms_session);
-  current.title = playlist_length
-    ? xmms_remote_get_playlist_title(gp.xmms_session, current.pos) : NULL;
-
-  /* Check for song change. Deleting a song from the playlist only changed the
-   * name, but not the position, so compare also by (still hexencoded) name. */
-  songchange =
-    (previous.pos != current.pos) ||
-    (previous.title == NULL && current.title != NULL) ||
-    (previous.title != NULL && current.title == NULL) ||
-    (previous.title != NULL && current.title != NULL &&
-     (g_strcasecmp(previous.title, current.title) != 0));
-
-  /* Possible show something when either song or state changed. */
-  showtext = songchange ||
-    ((current.playing != previous.playing) ||
-     (current.paused != previous.paused));
-
-  /* Determine right text depending on state and state/title change.
-   *    +---+          +---+
-   *    |   |          |   |
-   *    +->PLAY<---->STOP<-+
-   *        ^          ^
-   *        |          |
-   *        +-->PAUSE--+
-   */
-  if (!current.playing) {       /* {PLAY,PAUSE,STOP} -> STOP */
-    text = "Stopped";
-    showtext &= show.stop;
-  } else if (current.paused) {  /* PLAY -> PAUSE */
-    text = "Paused";
-    showtext &= show.pause;
-    withtime = TRUE;
-  } else if (previous.paused && !current.paused && !songchange) {       /* PAUSE -SameSong-> PLAY */
-    text = "Unpaused";
-    showtext &= show.pause;
-    withtime = TRUE;
-  } else {                      /* {PLAY,STOP} -> PLAY <-OtherSong- PAUSE */
-    text = "Playing";
-    showtext &= show.trackname;
-  }
+  /* The engine backs off while the player is quiet. */
+  if (interval == timeout_interval)
+    return TRUE;
+  DEBUG("polling every %d ms", interval);
+  timeout_interval = interval;
+  timeout_tag = gtk_timeout_add(interval, timeout_func, NULL);
+  return FALSE;
+}
 
-  /* Decide what to display, in decreasing priority. */
-  if (showtext) {
-    xosd_display(osd, 0, XOSD_string, text);
-    if (show.trackname && (current.title != NULL)) {
-      int len;
-      char *title;
-      gint playlist_time;
-
-      len = 13 + strlen(current.title) + (withtime ? 11 : 0);
-      title = malloc(len);
-      playlist_time =
-        withtime ? xmms_remote_get_output_time(gp.xmms_session) : 0;
-      snprintf(title, len,
-               withtime ? "%i/%i: %s (%i:%02i)" : "%i/%i: %s",
-               current.pos + 1, playlist_length, current.title,
-               playlist_time / 1000 / 60, playlist_time / 1000 % 60);
-      replace_hexcodes(title);
-      xosd_display(osd, 1, XOSD_string, title);
-      free(title);
-    } else
-      xosd_display(osd, 1, XOSD_string, "");
-  } else if (current.volume != previous.volume && show.volume) {
-    DEBUG("V: %d->%d\n", previous.volume, current.volume);
-    /* xmms returns -1 during a title change. skip this and try again later. */
-    if ((previous.volume == -1) || (current.volume == -1))
-      goto skip;
-    xosd_display(osd, 0, XOSD_string, "Volume");
-    xosd_display(osd, 1, XOSD_percentage, current.volume);
-  } else if (current.balance != previous.balance && show.balance) {
-    DEBUG("B: %d->%d\n", previous.balance, current.balance);
-    /* FIXME: Same as above might happen, but with what values? */
-    xosd_display(osd, 0, XOSD_string, "Balance");
-    xosd_display(osd, 1, XOSD_slider, current.balance);
-  } else if (current.repeat != previous.repeat && show.repeat) {
-    xosd_display(osd, 0, XOSD_string, "Repeat");
-    xosd_display(osd, 1, XOSD_string, current.repeat ? "On" : "Off");
-  } else if (current.shuffle != previous.shuffle && show.shuffle) {
-    xosd_display(osd, 0, XOSD_string, "Shuffle");
-    xosd_display(osd, 1, XOSD_string, current.shuffle ? "On" : "Off");
-  }
+/*
+ * Let libxosd handle exposures and hide the display after its timeout.
+ */
+static gint
+dispatch_func(gpointer data)
+{
+  dispatch_tag = 0;
+  schedule_dispatch();
+  return FALSE;
+}
 
-skip:
-  /* copy current state (including title) for future comparison. Free old
-   * title first. */
-  if (previous.title)
-    g_free(previous.title);
-  previous = current;
+static void
+input_func(gpointer data, gint source, GdkInputCondition condition)
+{
+  schedule_dispatch();
+}
 
-  GDK_THREADS_LEAVE();
+static void
+schedule_dispatch(void)
+{
+  gint ms;
 
+  if (dispatch_tag)
+    gtk_timeout_remove(dispatch_tag);
+  dispatch_tag = 0;
+  if (xosd_dispatch(osd, &ms) == 0 && ms >= 0)
+    dispatch_tag = gtk_timeout_add(ms, dispatch_func, NULL);
+}
 
-  return TRUE;
+static void
+stop_dispatch(void)
+{
+  if (dispatch_tag)
+    gtk_timeout_remove(dispatch_tag);
+  dispatch_tag = 0;
+  if (input_tag)
+    gdk_input_remove(input_tag);
+  input_tag = 0;
 }
 
 /* vim: tabstop=8 shiftwidth=8 noexpandtab
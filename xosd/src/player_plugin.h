@@ -5,6 +5,7 @@
 #include <assert.h>
 
 #include <xosd.h>
+#include "player_osd.h"
 
 #if 0
 #define DEBUG(fmt, a...) fprintf (stderr, "%s:%d %s: " fmt "\n", __FILE__ , __LINE__ , __PRETTY_FUNCTION__ , ##a)
@@ -12,17 +13,7 @@
 #define DEBUG(fmt, a...)
 #endif
 
-struct show
-{
-  gboolean volume;
-  gboolean balance;
-  gboolean pause;
-  gboolean trackname;
-  gboolean stop;
-  gboolean repeat;
-  gboolean shuffle;
-};
-extern struct show show;
+extern struct player_show show;
 
 extern gchar *font;
 extern gchar *colour;
@@ -43,7 +34,7 @@ extern int colour_dialog_window(GtkButton * button, gpointer user_data);
 /* dlg_config.c */
 extern void configure(void);
 extern int colour_dialog_window(GtkButton * button, gpointer user_data);
-/* xmms_osd.c */
+/* player_plugin.c */
 extern xosd *osd;
 extern void read_config(void);
 extern void write_config(void);
@@ -0,0 +1,335 @@
+/* scale_bench -- cost of many xosd objects at once
+ *
+ * Overlays per window and per monitor mean hundreds of objects in one
+ * process. For 1, 2, 5 and so on up to 500 objects alive at the same time,
+ * this measures the time to create them, the resident memory and threads
+ * of the process, the pixmap memory the X server keeps for its clients
+ * (with the X-Resource extension), and for all of them together, updated
+ * round robin, the xosd_display() calls per second and the redraws per
+ * second the event threads flushed for them; many calls on one object
+ * share a redraw. The results are written as JSON, to
+ * be compared before and after changes to what objects share. Meant to be
+ * run on a private X server which accepts enough clients:
+ *
+ *   xvfb-run -s "-screen 0 1280x1024x24 -maxclients 1024" \
+ *     ./scale_bench -o scale.json
+ *
+ * With -m clone, all objects but the first are clones of it and share its
+ * X connection, event thread and fonts. With -m threadless, they are made
+ * by xosd_create_threadless() and have no event thread. With -H, they
+ * draw into memory, which needs no X server, but has no pixmaps either.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <X11/Xlib.h>
+#ifdef HAVE_XRES
+#include <X11/extensions/XRes.h>
+#endif
+
+#include "xosd.h"
+
+#ifndef XOSD_VERSION
+#define XOSD_VERSION "unknown"
+#endif
+
+#define TIMEOUT 600             /* never hide during a measurement */
+#define SETTLE 100000           /* usecs for the server to catch up */
+
+static const int counts[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500 };
+
+static enum { MODE_create, MODE_clone, MODE_threadless } mode;
+static const char *mode_names[] = { "create", "clone", "threadless" };
+static double seconds = 1;
+static int headless_width, headless_height;    /* 0 = X server */
+static FILE *out;
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Process and server state {{{ */
+static long
+rss_kb(void)
+{
+  FILE *f = fopen("/proc/self/statm", "r");
+  long size, resident = -1;
+
+  if (f == NULL)
+    return -1;
+  if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+    resident = -1;
+  fclose(f);
+  return resident == -1 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int
+threads(void)
+{
+  FILE *f = fopen("/proc/self/status", "r");
+  char line[256];
+  int n = -1;
+
+  if (f == NULL)
+    return -1;
+  while (fgets(line, sizeof(line), f) != NULL)
+    if (sscanf(line, "Threads: %d", &n) == 1)
+      break;
+  fclose(f);
+  return n;
+}
+
+/* Pixmap bytes of all clients of the server, -1 if unknown. */
+static long long
+pixmap_bytes(Display * dpy)
+{
+  long long sum = -1;
+#ifdef HAVE_XRES
+  XResClient *clients;
+  int event, error, n, i;
+
+  if (dpy == NULL || !XResQueryExtension(dpy, &event, &error) ||
+      !XResQueryClients(dpy, &n, &clients))
+    return -1;
+  for (sum = 0, i = 0; i < n; i++) {
+    unsigned long bytes;
+    if (XResQueryClientPixmapBytes(dpy, clients[i].resource_base, &bytes))
+      sum += bytes;
+  }
+  XFree(clients);
+#else
+  (void) dpy;
+#endif
+  return sum;
+}
+
+/* }}} */
+
+/* Objects {{{ */
+static xosd *
+new_osd(xosd * first)
+{
+  xosd *osd;
+
+  if (mode == MODE_threadless)
+    osd = xosd_create_threadless(2, headless_width, headless_height);
+  else if (mode == MODE_clone && first != NULL)
+    osd = xosd_clone(first);
+  else if (headless_width)
+    osd = xosd_create_headless(2, headless_width, headless_height);
+  else
+    osd = xosd_create(2);
+  if (osd != NULL)
+    xosd_set_timeout(osd, TIMEOUT);
+  return osd;
+}
+
+/* Redraws flushed for osd so far. */
+static unsigned long
+redraws(xosd * osd)
+{
+  xosd_stats stats;
+
+  xosd_get_stats(osd, &stats);
+  return stats.flushes;
+}
+
+/* Total redraws of n objects. */
+static unsigned long
+redraws_all(xosd ** osds, int n)
+{
+  unsigned long sum = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    sum += redraws(osds[i]);
+  return sum;
+}
+
+/* Wait until the last changes of all objects are drawn. Taking the lock
+ * does not wait for that, so every object gets one more change, drawn
+ * together with or after the ones before it. */
+static void
+sync_all(xosd ** osds, int n)
+{
+  static int round;
+  unsigned long *drawn = calloc(n, sizeof(unsigned long));
+  int i;
+
+  round++;
+  for (i = 0; i < n; i++) {
+    drawn[i] = redraws(osds[i]);
+    xosd_display(osds[i], 1, XOSD_printf, "sync %d", round);
+  }
+  for (i = 0; i < n; i++)
+    while (redraws(osds[i]) == drawn[i])
+      ;
+  free(drawn);
+}
+
+/* }}} */
+
+/* Measure n objects alive at once. Returns the number created. */
+static int
+measure(Display * dpy, int n)
+{
+  xosd **osds = calloc(n, sizeof(xosd *));
+  long rss_before = rss_kb(), rss_after;
+  long long pixmaps_before = pixmap_bytes(dpy), pixmaps_after;
+  int threads_before = threads(), threads_after, created, i;
+  double start, create, destroy, elapsed = 0;
+  long updates = 0;
+  unsigned long drawn = 0;
+
+  start = now();
+  for (created = 0; created < n; created++) {
+    if ((osds[created] = new_osd(created ? osds[0] : NULL)) == NULL)
+      break;
+    xosd_display(osds[created], 0, XOSD_printf, "osd %d", created);
+  }
+  sync_all(osds, created);
+  create = now() - start;
+
+  usleep(SETTLE);
+  rss_after = rss_kb();
+  threads_after = threads();
+  pixmaps_after = pixmap_bytes(dpy);
+
+  if (created > 0) {
+    drawn = redraws_all(osds, created);
+    start = now();
+    do {
+      xosd_display(osds[updates % created], 1, XOSD_printf, "update %ld",
+                   updates);
+      updates++;
+    } while (now() - start < seconds);
+    sync_all(osds, created);
+    elapsed = now() - start;
+    /* Without the one redraw of every object sync_all() asked for. */
+    drawn = redraws_all(osds, created) - drawn;
+    drawn = drawn > (unsigned long) created ? drawn - created : 0;
+  }
+
+  start = now();
+  for (i = created - 1; i >= 0; i--)
+    xosd_destroy(osds[i]);
+  destroy = now() - start;
+
+  fprintf(out, "    {\"instances\": %d, \"created\": %d", n, created);
+  if (created < n)
+    fprintf(out, ", \"error\": \"%s\"", xosd_error ? xosd_error : "");
+  fprintf(out, ",\n     \"create_ms\": %.1f, "
+          "\"create_us_per_instance\": %.1f, \"destroy_ms\": %.1f,\n",
+          create * 1e3, created ? create * 1e6 / created : 0, destroy * 1e3);
+  fprintf(out, "     \"rss_kb\": %ld, \"rss_kb_per_instance\": %.1f, "
+          "\"threads\": %d, \"threads_added\": %d,\n", rss_after,
+          created ? (double) (rss_after - rss_before) / created : 0,
+          threads_after, threads_after - threads_before);
+  if (pixmaps_after != -1 && pixmaps_before != -1)
+    fprintf(out, "     \"x_pixmap_bytes\": %lld, "
+            "\"x_pixmap_bytes_per_instance\": %.0f,\n",
+            pixmaps_after - pixmaps_before,
+            created ? (double) (pixmaps_after - pixmaps_before) / created : 0);
+  fprintf(out, "     \"updates_per_second\": %.0f, "
+          "\"redraws_per_second\": %.0f}", updates ? updates / elapsed : 0,
+          updates ? drawn / elapsed : 0);
+  fflush(out);
+  free(osds);
+  return created;
+}
+
+int
+main(int argc, char *argv[])
+{
+  Display *dpy = NULL;
+  struct rlimit rl;
+  int c, i, n, max = 500;
+
+  out = stdout;
+  while ((c = getopt(argc, argv, "n:m:s:o:H:h")) != -1) {
+    switch (c) {
+    case 'n':
+      max = atoi(optarg) > 0 ? atoi(optarg) : 1;
+      break;
+    case 'm':
+      for (i = 0; i < 3 && strcmp(optarg, mode_names[i]) != 0; i++);
+      if (i == 3) {
+        fprintf(stderr, "scale_bench: -m create|clone|threadless\n");
+        return EXIT_FAILURE;
+      }
+      mode = i;
+      break;
+    case 's':
+      seconds = atof(optarg);
+      break;
+    case 'o':
+      if ((out = fopen(optarg, "w")) == NULL) {
+        perror(optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'H':
+      if (sscanf(optarg, "%dx%d", &headless_width, &headless_height) != 2
+          || headless_width <= 0 || headless_height <= 0) {
+        fprintf(stderr, "scale_bench: -H WIDTHxHEIGHT\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-n MAX] [-m MODE] [-s SECONDS] [-o FILE] "
+              "[-H WIDTHxHEIGHT]\n"
+              "  -n  Largest number of objects (default 500)\n"
+              "  -m  create, clone or threadless (default create)\n"
+              "  -s  Duration of every update measurement (default 1)\n"
+              "  -o  Write the JSON results to FILE instead of stdout\n"
+              "  -H  Draw into memory with a screen of that size, no X server\n",
+              argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  /* Every object has an X connection and pipes of its own. */
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  if (!headless_width && (dpy = XOpenDisplay(NULL)) == NULL) {
+    fprintf(stderr, "scale_bench: cannot open display\n");
+    return EXIT_FAILURE;
+  }
+
+  fprintf(out, "{\n  \"version\": \"%s\",\n  \"mode\": \"%s\",\n"
+          "  \"seconds\": %g,\n", XOSD_VERSION, mode_names[mode], seconds);
+  if (headless_width)
+    fprintf(out, "  \"backend\": \"headless\",\n  \"screen\": {\"width\": "
+            "%d, \"height\": %d},\n", headless_width, headless_height);
+  else
+    fprintf(out, "  \"backend\": \"x11\",\n  \"screen\": {\"width\": %d, "
+            "\"height\": %d},\n", DisplayWidth(dpy, DefaultScreen(dpy)),
+            DisplayHeight(dpy, DefaultScreen(dpy)));
+  fprintf(out, "  \"runs\": [\n");
+  for (i = 0; i < (int) (sizeof(counts) / sizeof(counts[0])); i++) {
+    n = counts[i] < max ? counts[i] : max;
+    if (i > 0)
+      fprintf(out, ",\n");
+    /* Up to max, or as many as the server or the system allowed. */
+    if (measure(dpy, n) < n || n == max)
+      break;
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  if (dpy != NULL)
+    XCloseDisplay(dpy);
+  return out == stdout || fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
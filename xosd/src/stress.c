@@ -0,0 +1,286 @@
+/* stress -- many threads sharing few xosd objects
+ *
+ * Every thread picks one of the shared objects at random and makes a random
+ * call on it: mostly xosd_display(), sometimes xosd_scroll(), xosd_hide()
+ * or xosd_set_font(), and rarely xosd_destroy() followed by a new
+ * xosd_create() in the same slot. The number of threads doubles from one
+ * to the maximum, and the calls per second of every step are written as
+ * JSON. If no call completes for a while, the library is taken to be
+ * deadlocked and the program aborts, leaving a core to look at.
+ *
+ *   xvfb-run -s "-screen 0 1280x1024x24" ./stress -t 64 -i 4
+ *
+ * "make stress-tsan" and "make stress-asan" build the same program with
+ * the library compiled in under ThreadSanitizer and AddressSanitizer. With
+ * -H the objects draw into memory, and no X server is needed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "xosd.h"
+
+#define TIMEOUT 600             /* never hide on its own */
+#define LINES 4
+#define STALL 10                /* seconds without progress = deadlock */
+#define MAX_THREADS 1024
+#define MAX_INSTANCES 256
+
+enum call { C_display, C_percentage, C_scroll, C_hide, C_font, C_destroy,
+  C_ncalls
+};
+static const char *call_names[C_ncalls] = {
+  "display", "percentage", "scroll", "hide", "set_font", "destroy"
+};
+
+/* A shared object. Calls hold the lock for reading; destroying needs it
+ * for writing, as xosd leaves it to the caller not to use a destroyed
+ * object. */
+struct slot
+{
+  pthread_rwlock_t lock;
+  xosd *osd;
+};
+
+struct worker
+{
+  pthread_t thread;
+  unsigned int seed;
+  unsigned long calls[C_ncalls];  /* atomic, read by the watchdog */
+};
+
+static struct slot slots[MAX_INSTANCES];
+static struct worker workers[MAX_THREADS];
+static int ninstances = 1;
+static int max_threads = 16;
+static double seconds = 2;
+static int headless;
+static int stop;
+static FILE *out;
+
+static const char *fonts[] = {
+  "fixed",
+  "-misc-fixed-medium-r-semicondensed--*-*-*-*-c-*-*-*",
+  "-*-*-*-*-*-*-20-*-*-*-*-*-*-*",
+};
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static xosd *
+new_osd(void)
+{
+  xosd *osd = headless ? xosd_create_headless(LINES, 1280, 1024)
+    : xosd_create(LINES);
+
+  if (osd == NULL) {
+    fprintf(stderr, "xosd_create: %s\n", xosd_error);
+    exit(EXIT_FAILURE);
+  }
+  xosd_set_timeout(osd, TIMEOUT);
+  return osd;
+}
+
+/* Out of 1000 calls. */
+static enum call
+pick_call(unsigned int *seed)
+{
+  int r = rand_r(seed) % 1000;
+
+  if (r < 1)
+    return C_destroy;
+  if (r < 11)
+    return C_font;
+  if (r < 61)
+    return C_hide;
+  if (r < 161)
+    return C_scroll;
+  if (r < 411)
+    return C_percentage;
+  return C_display;
+}
+
+static void *
+work(void *arg)
+{
+  struct worker *w = arg;
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    struct slot *s = &slots[rand_r(&w->seed) % ninstances];
+    enum call c = pick_call(&w->seed);
+
+    if (c == C_destroy) {
+      pthread_rwlock_wrlock(&s->lock);
+      xosd_destroy(s->osd);
+      s->osd = new_osd();
+      pthread_rwlock_unlock(&s->lock);
+      __atomic_fetch_add(&w->calls[c], 1, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    pthread_rwlock_rdlock(&s->lock);
+    switch (c) {
+    case C_display:
+      xosd_display(s->osd, rand_r(&w->seed) % LINES, XOSD_printf,
+                   "thread %d call %lu", (int) (w - workers),
+                   w->calls[c]);
+      break;
+    case C_percentage:
+      xosd_display(s->osd, rand_r(&w->seed) % LINES, XOSD_percentage,
+                   rand_r(&w->seed) % 101);
+      break;
+    case C_scroll:
+      xosd_scroll(s->osd, 1);
+      break;
+    case C_hide:
+      xosd_hide(s->osd);
+      break;
+    case C_font:
+      xosd_set_font(s->osd, fonts[rand_r(&w->seed) % 3]);
+      break;
+    default:
+      break;
+    }
+    pthread_rwlock_unlock(&s->lock);
+    __atomic_fetch_add(&w->calls[c], 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+static unsigned long
+total_calls(int nthreads)
+{
+  unsigned long sum = 0;
+  int i, c;
+
+  for (i = 0; i < nthreads; i++)
+    for (c = 0; c < C_ncalls; c++)
+      sum += __atomic_load_n(&workers[i].calls[c], __ATOMIC_RELAXED);
+  return sum;
+}
+
+/* Run nthreads for the configured time, watching for progress. */
+static void
+step(int nthreads, const char *sep)
+{
+  unsigned long last = 0, calls;
+  double start, last_progress;
+  int i, c;
+
+  __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+  memset(workers, 0, sizeof(workers));
+  for (i = 0; i < nthreads; i++) {
+    workers[i].seed = i + 1;
+    if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0) {
+      perror("stress: pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  start = last_progress = now();
+  while (now() - start < seconds) {
+    usleep(100000);
+    if ((calls = total_calls(nthreads)) != last) {
+      last = calls;
+      last_progress = now();
+    } else if (now() - last_progress > STALL) {
+      fprintf(stderr, "stress: no call finished for %d seconds with %d "
+              "threads, deadlock?\n", STALL, nthreads);
+      abort();
+    }
+  }
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+  for (i = 0; i < nthreads; i++)
+    pthread_join(workers[i].thread, NULL);
+
+  calls = total_calls(nthreads);
+  fprintf(out, "    {\"threads\": %d, \"calls_per_second\": %.0f", nthreads,
+          calls / (now() - start));
+  for (c = 0; c < C_ncalls; c++) {
+    unsigned long n = 0;
+    for (i = 0; i < nthreads; i++)
+      n += workers[i].calls[c];
+    fprintf(out, ", \"%s\": %lu", call_names[c], n);
+  }
+  fprintf(out, "}%s\n", sep);
+  fflush(out);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int steps[32], nsteps = 0;
+  int c, i, n;
+
+  out = stdout;
+  while ((c = getopt(argc, argv, "t:i:s:o:Hh")) != -1) {
+    switch (c) {
+    case 't':
+      max_threads = atoi(optarg);
+      break;
+    case 'i':
+      ninstances = atoi(optarg);
+      break;
+    case 's':
+      seconds = atof(optarg);
+      break;
+    case 'o':
+      if ((out = fopen(optarg, "w")) == NULL) {
+        perror(optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'H':
+      headless = 1;
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-t THREADS] [-i INSTANCES] [-s SECONDS] [-o FILE] "
+              "[-H]\n"
+              "  -t  Largest number of threads, doubled from 1 (default 16)\n"
+              "  -i  Number of shared xosd objects (default 1)\n"
+              "  -s  Duration of every step (default 2)\n"
+              "  -o  Write the JSON results to FILE instead of stdout\n"
+              "  -H  Draw into memory instead of on an X server\n",
+              argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if (max_threads < 1 || max_threads > MAX_THREADS || ninstances < 1
+      || ninstances > MAX_INSTANCES) {
+    fprintf(stderr, "stress: 1 to %d threads and 1 to %d instances\n",
+            MAX_THREADS, MAX_INSTANCES);
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < ninstances; i++) {
+    pthread_rwlock_init(&slots[i].lock, NULL);
+    slots[i].osd = new_osd();
+  }
+
+  fprintf(out, "{\n  \"instances\": %d,\n  \"seconds\": %g,\n"
+          "  \"steps\": [\n", ninstances, seconds);
+  for (n = 1; n < max_threads; n *= 2)
+    steps[nsteps++] = n;
+  steps[nsteps++] = max_threads;
+  for (i = 0; i < nsteps; i++)
+    step(steps[i], i < nsteps - 1 ? "," : "");
+  fprintf(out, "  ]\n}\n");
+
+  for (i = 0; i < ninstances; i++) {
+    xosd_destroy(slots[i].osd);
+    pthread_rwlock_destroy(&slots[i].lock);
+  }
+  return out == stdout || fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
@@ -19,7 +19,7 @@ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 
 #include <gtk/gtk.h>
 
-#include "xmms_osd.h"
+#include "player_plugin.h"
 
 GtkWidget *colour_entry;
 
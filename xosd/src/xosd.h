@@ -1,6 +1,7 @@
 #ifndef XOSD_H
 #define XOSD_H
 
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -29,9 +30,28 @@ extern "C"
     XOSD_percentage,            /* Percentage bar (like a progress bar) */
     XOSD_string,                /* Text */
     XOSD_printf,                /* Formatted Text */
-    XOSD_slider                 /* Slider (like a volume control) */
+    XOSD_slider,                /* Slider (like a volume control) */
+    XOSD_end,                   /* Ends the lines of xosd_post() */
+    XOSD_ticker                 /* Text moving through its line */
   } xosd_command;
 
+/* Priority of a posted message, see xosd_post(). */
+  typedef enum
+  {
+    XOSD_low = 0,               /* Status, waits for everything else */
+    XOSD_normal,
+    XOSD_urgent                 /* Alerts, replace lower ones at once */
+  } xosd_priority;
+
+/* State changes, see xosd_read_event(). */
+  typedef enum
+  {
+    XOSD_event_none = 0,        /* Nothing happened */
+    XOSD_event_shown,           /* The window was mapped */
+    XOSD_event_hidden,          /* It was unmapped by xosd_hide() */
+    XOSD_event_timeout          /* It was unmapped after its timeout */
+  } xosd_event;
+
 /* Position of the display */
   typedef enum
   {
@@ -48,13 +68,25 @@ extern "C"
     XOSD_right
   } xosd_align;
 
+/* What happens to text wider than the screen, see xosd_set_layout(). */
+  typedef enum
+  {
+    XOSD_layout_none = 0,       /* It runs off the screen */
+    XOSD_layout_wrap,           /* It continues on the following lines */
+    XOSD_layout_ellipsis_end,   /* Its end is replaced by "..." */
+    XOSD_layout_ellipsis_middle /* Its middle is replaced by "..." */
+  } xosd_layout;
+
 /* xosd_clone -- Create a new xosd object with the same attributes as the input xosd object
+ *
+ * The clone shares the display connection, the event thread and the font
+ * of osd2 until either is destroyed.
  *
  * ARGUMENTS
- *    None.
+ *    osd2           The xosd object to copy.
  *
  * RETURNS
- *    A new xosd structure.
+ *    A new xosd structure, NULL on error.
  */
 xosd *xosd_clone(xosd * osd2);
 
@@ -69,9 +101,138 @@ xosd *xosd_clone(xosd * osd2);
  */
  xosd *xosd_create(int number_lines);
 
+/* xosd_create_headless -- Create a new xosd "object" drawing into memory
+ *
+ * Nothing is shown and no X server is needed. The display is drawn with a
+ * built-in 8x16 font into an RGBA image of a screen of the given size, see
+ * xosd_get_image(). Of X font names only the pixel size is used: 24 or
+ * more draws the built-in font that many pixels high, rounded to a
+ * multiple of 16. If libxosd was built with FreeType, a font name starting
+ * with a slash is a font file, optionally followed by a colon and the size
+ * in pixels, as in "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf:24".
+ * Colours are named as by X11, or given as #rrggbb.
+ *
+ * ARGUMENTS
+ *    number_lines   Number of lines of the display.
+ *    width          Width of the screen in pixels.
+ *    height         Height of the screen in pixels.
+ *
+ * RETURNS
+ *    A new xosd structure, or NULL on failure.
+ */
+ xosd *xosd_create_headless(int number_lines, int width, int height);
+
+/* xosd_create_threadless -- Create a new xosd "object" without a thread
+ *
+ * For single-threaded applications with a main loop. No event thread is
+ * started, so the object and its clones must only be used from one thread.
+ * Calls draw before they return, and take no locks. Exposures and timeouts
+ * are handled by xosd_dispatch(), which the application calls when
+ * xosd_get_fd() is readable or the timeout it returned expires.
+ *
+ * ARGUMENTS
+ *    number_lines   Number of lines of the display.
+ *    width          0 for the X display, else as for xosd_create_headless().
+ *    height         0 for the X display, else as for xosd_create_headless().
+ *
+ * RETURNS
+ *    A new xosd structure, or NULL on failure.
+ */
+ xosd *xosd_create_threadless(int number_lines, int width, int height);
+
+/* xosd_get_fd -- Get the file descriptor a threadless object waits on
+ *
+ * ARGUMENTS
+ *    osd       The xosd object, created by xosd_create_threadless().
+ *
+ * RETURNS
+ *    The X11 connection to watch for reading, -1 if there is nothing to
+ *    watch, as for a headless object, or on failure.
+ */
+  int xosd_get_fd(xosd * osd);
+
+/* xosd_dispatch -- Handle events and timeouts of a threadless object
+ *
+ * Never blocks. Call it when xosd_get_fd() is readable, when the timeout
+ * it returned expires, and after other calls, which may change the
+ * timeout. It serves all clones of the object.
+ *
+ * ARGUMENTS
+ *    osd       The xosd object, created by xosd_create_threadless().
+ *    timeout   Set to the milliseconds until it is needed again, -1 for
+ *              not before the file descriptor is readable, as for poll().
+ *              May be NULL.
+ *
+ * RETURNS
+ *     0 on success
+ *    -1 on failure, also for an object with an event thread
+ */
+  int xosd_dispatch(xosd * osd, int *timeout);
+
+/* xosd_set_allocator -- Set where objects get their line storage from
+ *
+ * Texts of up to 31 bytes are kept inside the line. Longer ones are cut
+ * from chunks of 4 KB each object takes from the allocator when it needs
+ * more, and reused once replaced, so redrawing texts of similar lengths
+ * allocates nothing after the first few updates. xosd_get_stats() counts
+ * the calls of alloc. Objects and clones keep the allocator that was set
+ * when they were created.
+ *
+ * ARGUMENTS
+ *    alloc     Returns size bytes, aligned for any type, or NULL.
+ *    release   Frees what alloc returned.
+ *    data      Passed to both.
+ *    Both NULL restore malloc() and free().
+ *
+ * RETURNS
+ *     0 on success
+ *    -1 if only one of alloc and release is NULL
+ */
+  int xosd_set_allocator(void *(*alloc) (size_t size, void *data),
+                         void (*release) (void *ptr, void *data),
+                         void *data);
+
+/* xosd_get_image -- Copy the screen of a headless xosd "object"
+ *
+ * Changes made before the call are drawn first. Pixels outside of the
+ * display, or all of them while it is hidden, are transparent black.
+ *
+ * ARGUMENTS
+ *    osd       The xosd object, created by xosd_create_headless().
+ *    rgba      Receives width * height * 4 bytes to be free()d by the
+ *              caller, rows from the top, R, G, B, A per pixel.
+ *    width     Receives the width of the screen. Can be NULL.
+ *    height    Receives the height of the screen. Can be NULL.
+ *
+ * RETURNS
+ *    0 on success.
+ *   -1 on failure.
+ */
+ int xosd_get_image(xosd * osd, unsigned char **rgba, int *width,
+                    int *height);
+
+/* xosd_write_image -- Write the screen of a headless xosd "object" to a file
+ *
+ * A name ending in ".png" writes a PNG with transparency, if libxosd was
+ * built with libpng. Anything else writes a binary PPM, with the display
+ * over black.
+ *
+ * ARGUMENTS
+ *    osd       The xosd object, created by xosd_create_headless().
+ *    filename  The file to write.
+ *
+ * RETURNS
+ *    0 on success.
+ *   -1 on failure.
+ */
+ int xosd_write_image(xosd * osd, const char *filename);
+
 
 
 /* xosd_monitor -- Switch an xosd objects default position to a chosen monitor
+ *
+ * The object follows its monitor when RandR reports that outputs changed,
+ * and uses the first monitor while its own is disconnected.
  *
  * ARGUMENTS
  *    osd             xosd object to modify.
@@ -82,6 +243,22 @@ xosd *xosd_clone(xosd * osd2);
  *   -1 on failure.
  */
  int xosd_monitor(xosd * osd, int monitor);
+
+/* xosd_set_mirror -- Show an xosd object on every monitor at once
+ *
+ * The content is drawn once and copied to a window on every other monitor,
+ * placed there as the object is on its own monitor. This costs much less
+ * than an object per monitor.
+ *
+ * ARGUMENTS
+ *    osd             xosd object to modify.
+ *    mirror          1 to show on all monitors, 0 for only its own.
+ *
+ * RETURNS
+ *    0 on success.
+ *   -1 on failure.
+ */
+ int xosd_set_mirror(xosd * osd, int mirror);
  
  
 /* display_info -- Displays monitor information using xosd objects, monitor index in the center of
@@ -166,6 +343,61 @@ xosd *xosd_clone(xosd * osd2);
 */
   int xosd_set_bar_length(xosd * osd, int length);
 
+/* xosd_set_layout -- Fit long text lines to the screen
+ *
+ * With XOSD_layout_wrap, xosd_display() and xosd_post() break a text at
+ * spaces into as many lines as it needs, from its line on, replacing what
+ * these lines showed. Where the lines run out, the last one is cut with
+ * an ellipsis. Text already shown is not wrapped again when the font or
+ * the screen changes, but cut if it no longer fits. The ellipsis layouts
+ * keep every text on its line and cut it at its end or in its middle;
+ * the whole text is kept and fitted again when the font, the offsets or
+ * the monitor change.
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *     layout   XOSD_layout_none (the default), XOSD_layout_wrap,
+ *              XOSD_layout_ellipsis_end or XOSD_layout_ellipsis_middle.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int xosd_set_layout(xosd * osd, xosd_layout layout);
+
+/* xosd_text_lines -- Count the lines a text would take
+ *
+ * With XOSD_layout_wrap, the number of lines xosd_display() would break
+ * text into at line 0 with the current font, to know how far to scroll
+ * before it is displayed. Always 1 with the other layouts.
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *     text     The text.
+ *
+ * RETURNS
+ *   the number of lines, at most xosd_get_number_lines(), on success
+ *  -1 on failure
+ */
+  int xosd_text_lines(xosd * osd, const char *text);
+
+/* xosd_set_ticker_speed -- Set how fast ticker lines move
+ *
+ * A line displayed with XOSD_ticker moves its text from right to left and
+ * starts over once it left the screen. The text is drawn once, and every
+ * move only copies it, at most 60 times a second. The same text displayed
+ * again goes on moving where it is. Texts are cut at 32767 pixels.
+ *
+ * ARGUMENTS
+ *     osd                The xosd "object".
+ *     pixels_per_second  Speed of the text, 100 by default.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int xosd_set_ticker_speed(xosd * osd, int pixels_per_second);
+
 /* xosd_display -- Display information
  *
  * ARGUMENTS
@@ -175,16 +407,57 @@ xosd *xosd_clone(xosd * osd2);
  *     ...      The argument to "command":
  *                  int     (between 0 and 100) if "command" is
  *                          "XOSD_percentage",
- *                  char *  if "command" is "XOSD_string",
+ *                  char *  if "command" is "XOSD_string" or
+ *                          "XOSD_ticker",
  *                  int     (between 0 and 100) if "command" is
  *                          "XOSD_slider".
  * RETURNS
  *     The percentage (between 0 and 100) for "XOSD_percentage" or
  *     "XOSD_slider", or the number of characters displayed for
- *     "XOSD_string". -1 is returned on failure.
+ *     "XOSD_string" or "XOSD_ticker". -1 is returned on failure.
  */
   int xosd_display(xosd * osd, int line, xosd_command command, ...);
 
+/* xosd_post -- Queue a message for display
+ *
+ * Unlike xosd_display(), it neither waits for the display nor replaces
+ * what is shown right away. The message goes into a queue, and the event
+ * thread shows one message after another, each for at least the time set
+ * with xosd_set_min_time(), the highest priority first. A message of a
+ * higher priority than the shown one replaces it at once. A message with
+ * the same key as a queued or shown one replaces that one, so repeated
+ * "Volume" messages show only the latest value. Without a key, a message
+ * only replaces one with the same content. Messages are lost to newer ones
+ * of the same key and when the queue of 32 messages is full, the newest of
+ * the lowest priority then; xosd_get_dropped_updates() counts them.
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *     priority XOSD_low, XOSD_normal or XOSD_urgent.
+ *     key      Identifies messages superseding each other, or NULL.
+ *     ...      The content of line 0, 1 and so on as a command followed
+ *              by its argument as for xosd_display(), ended by XOSD_end.
+ *              XOSD_printf is not supported. Lines not given are blank.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int xosd_post(xosd * osd, xosd_priority priority, const char *key, ...);
+
+/* xosd_set_min_time -- Set how long a posted message is shown at least
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *     ms       Milliseconds before the next message of the same or a lower
+ *              priority replaces it, 1000 by default.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int xosd_set_min_time(xosd * osd, int ms);
+
 /* xosd_is_onscreen -- Returns weather the display is show
  *
  * ARGUMENTS
@@ -211,6 +484,54 @@ xosd *xosd_clone(xosd * osd2);
  */
   int xosd_wait_until_no_display(xosd * osd);
 
+/* xosd_get_event_fd -- Get a file descriptor readable on state changes
+ *
+ * For applications with a poll(), select() or main loop of their own,
+ * instead of a thread blocked in xosd_wait_until_no_display(). The
+ * descriptor is readable while xosd_read_event() has events to return.
+ * xosd_display() and xosd_show() still wait for the window to be mapped,
+ * see xosd_set_show_wait() to learn about it from XOSD_event_shown
+ * instead. It stays open until xosd_destroy(); do not close it.
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *
+ * RETURNS
+ *   the file descriptor on success
+ *  -1 on failure
+ */
+  int xosd_get_event_fd(xosd * osd);
+
+/* xosd_read_event -- Get the next state change without blocking
+ *
+ * Events are kept from the first xosd_get_event_fd() on. Of more than 16
+ * unread events, the oldest are lost.
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *
+ * RETURNS
+ *   the oldest unread xosd_event, XOSD_event_none if there is none
+ *  -1 on failure, also without xosd_get_event_fd()
+ */
+  int xosd_read_event(xosd * osd);
+
+/* xosd_set_show_wait -- Choose whether showing waits for the map
+ *
+ * By default xosd_display() and xosd_show() return once the window is
+ * mapped. A main loop watching xosd_get_event_fd() can turn this off and
+ * wait for XOSD_event_shown instead.
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *     wait     1 to wait for the map (the default), 0 to return at once.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+ */
+  int xosd_set_show_wait(xosd * osd, int wait);
+
 /* xosd_hide -- hide the display
  *
  * ARGUMENTS
@@ -432,6 +753,98 @@ xosd *xosd_clone(xosd * osd2);
 */
   int xosd_get_number_lines(xosd * osd);
 
+/* xosd_set_frame_rate -- Limit how often the display is redrawn
+ *
+ * Updates arriving less than 1/fps seconds after the last redraw are
+ * coalesced: only the latest value of each line is kept and drawn at the
+ * next frame, and xosd_display() returns without waiting for the display.
+ * Occasional updates are drawn immediately as before.
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *     fps      Maximum number of redraws per second, 0 for no limit.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+*/
+  int xosd_set_frame_rate(xosd * osd, int fps);
+
+/* xosd_get_dropped_updates -- Count updates replaced before being drawn
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *
+ * RETURNS
+ *   the number of coalesced updates and posted messages which were never
+ *   drawn on success
+ *  -1 on failure
+*/
+  long xosd_get_dropped_updates(xosd * osd);
+
+/* Statistics of an xosd object, see xosd_get_stats() */
+#define XOSD_HISTOGRAM_BUCKETS 24
+
+/* Latencies in microseconds. buckets[0] counts values below 1us,
+ * buckets[i] values from 2^(i-1) to 2^i-1 us, the last bucket everything
+ * above. */
+  typedef struct
+  {
+    unsigned long count;
+    unsigned long max_us;
+    unsigned long long total_us;
+    unsigned long buckets[XOSD_HISTOGRAM_BUCKETS];
+  } xosd_histogram;
+
+/* Phases of a display update in the event thread */
+  typedef enum
+  {
+    XOSD_phase_hide = 0,        /* unmap the window */
+    XOSD_phase_size,            /* resize window and pixmaps */
+    XOSD_phase_pos,             /* move the window */
+    XOSD_phase_lines,           /* redraw all lines off-screen */
+    XOSD_phase_bars,            /* repaint changed bar segments, tickers */
+    XOSD_phase_mask,            /* update the XShape mask */
+    XOSD_phase_show,            /* map the window */
+    XOSD_phase_copy,            /* copy the off-screen pixmap */
+    XOSD_phase_flush,           /* XFlush() */
+    XOSD_phases
+  } xosd_phase;
+
+  typedef struct
+  {
+    int timing;                 /* histograms are being filled */
+    xosd_histogram lock_wait;   /* API calls waiting for the event thread */
+    xosd_histogram phase[XOSD_phases];
+    xosd_histogram display_to_flush;    /* xosd_display() until flushed */
+    unsigned long draw_strings; /* XmbDrawString() requests */
+    unsigned long fill_rectangles;      /* XFillRectangle(s)() requests */
+    unsigned long requests;     /* all X requests of this object */
+    unsigned long long bytes_flushed;   /* bytes sent by XFlush() */
+    unsigned long flushes;
+    unsigned long expose_repaints;
+    unsigned long shows;
+    unsigned long hides;
+    unsigned long dropped_updates;      /* see xosd_set_frame_rate(), xosd_post() */
+    unsigned long allocations;  /* line storage, see xosd_set_allocator() */
+  } xosd_stats;
+
+/* xosd_get_stats -- Get counters and latency histograms
+ *
+ * Counters are always kept. Taking the time costs system calls, so the
+ * histograms are only filled after the first call of xosd_get_stats();
+ * call it once with stats=NULL at start up to switch them on.
+ *
+ * ARGUMENTS
+ *     osd      The xosd "object".
+ *     stats    Filled with a snapshot, or NULL.
+ *
+ * RETURNS
+ *   0 on success
+ *  -1 on failure
+*/
+  int xosd_get_stats(xosd * osd, xosd_stats * stats);
+
 #ifdef __cplusplus
 };
 #endif
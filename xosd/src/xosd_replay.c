@@ -0,0 +1,359 @@
+/* xosd_replay -- play back calls recorded with XOSD_RECORD
+ *
+ * Run a program with XOSD_RECORD=FILE in its environment and libxosd writes
+ * every call changing an xosd object to FILE. This program makes the same
+ * calls on fresh objects, either as fast as possible or, with -r, with the
+ * recorded pauses, and writes how long they took as JSON. Meant to be run
+ * on a private X server:
+ *
+ *   xvfb-run -s "-screen 0 1280x1024x24" ./xosd_replay -o replay.json FILE
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "xosd.h"
+#include "libxosd/record.h"
+
+struct call
+{
+  struct xosd_record r;
+  char *string;                 /* NUL terminated, or NULL */
+};
+
+static const char *op_names[REC_nops] = {
+  "create", "clone", "destroy", "string", "percentage", "slider",
+  "set_int", "set_string", "scroll", "show", "hide", "ticker"
+};
+
+static xosd *instances[UINT16_MAX + 1];
+static FILE *out;
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Reading the recording {{{ */
+static struct call *
+load(const char *file, int *ncalls)
+{
+  char magic[sizeof(XOSD_RECORD_MAGIC) - 1];
+  struct call *calls = NULL;
+  int n = 0, size = 0;
+  FILE *f;
+
+  if ((f = fopen(file, "rb")) == NULL) {
+    perror(file);
+    return NULL;
+  }
+  if (fread(magic, 1, sizeof(magic), f) != sizeof(magic)
+      || memcmp(magic, XOSD_RECORD_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "xosd_replay: %s: not an xosd recording\n", file);
+    fclose(f);
+    return NULL;
+  }
+
+  for (;;) {
+    struct call *c;
+
+    if (n == size) {
+      size = size ? 2 * size : 1024;
+      if ((calls = realloc(calls, size * sizeof(struct call))) == NULL) {
+        perror("xosd_replay");
+        exit(EXIT_FAILURE);
+      }
+    }
+    c = &calls[n];
+    if (fread(&c->r, sizeof(c->r), 1, f) != 1)
+      break;
+    c->string = NULL;
+    if (c->r.op >= REC_nops)
+      break;
+    if (c->r.op == REC_string || c->r.op == REC_set_string ||
+        c->r.op == REC_ticker) {
+      if (c->r.value < 0 || c->r.value > XOSD_RECORD_MAX_STRING)
+        break;
+      if ((c->string = malloc(c->r.value + 1)) == NULL) {
+        perror("xosd_replay");
+        exit(EXIT_FAILURE);
+      }
+      if (fread(c->string, 1, c->r.value, f) != (size_t) c->r.value) {
+        free(c->string);
+        break;
+      }
+      c->string[c->r.value] = '\0';
+    }
+    n++;
+  }
+  /* A recording ends wherever the program stopped, keep whole calls. */
+  if (!feof(f))
+    fprintf(stderr, "xosd_replay: %s: garbage after call %d\n", file, n);
+  fclose(f);
+  *ncalls = n;
+  return calls;
+}
+
+/* }}} */
+
+/* Replaying {{{ */
+static int
+set_int(xosd * osd, int property, int v)
+{
+  switch (property) {
+  case REC_timeout:
+    return xosd_set_timeout(osd, v);
+  case REC_pos:
+    return xosd_set_pos(osd, v);
+  case REC_align:
+    return xosd_set_align(osd, v);
+  case REC_vertical_offset:
+    return xosd_set_vertical_offset(osd, v);
+  case REC_horizontal_offset:
+    return xosd_set_horizontal_offset(osd, v);
+  case REC_shadow_offset:
+    return xosd_set_shadow_offset(osd, v);
+  case REC_shadow_direction:
+    return xosd_set_shadow_direction(osd, v);
+  case REC_outline_offset:
+    return xosd_set_outline_offset(osd, v);
+  case REC_bar_length:
+    return xosd_set_bar_length(osd, v);
+  case REC_monitor:
+    return xosd_monitor(osd, v);
+  case REC_frame_rate:
+    return xosd_set_frame_rate(osd, v);
+  case REC_mirror:
+    return xosd_set_mirror(osd, v);
+  case REC_min_time:
+    return xosd_set_min_time(osd, v);
+  case REC_layout:
+    return xosd_set_layout(osd, v);
+  case REC_ticker_speed:
+    return xosd_set_ticker_speed(osd, v);
+  case REC_show_wait:
+    return xosd_set_show_wait(osd, v);
+  default:
+    return -1;
+  }
+}
+
+static int
+set_string(xosd * osd, int property, const char *s)
+{
+  switch (property) {
+  case REC_font:
+    return xosd_set_font(osd, s);
+  case REC_colour:
+    return xosd_set_colour(osd, s);
+  case REC_shadow_colour:
+    return xosd_set_shadow_colour(osd, s);
+  case REC_outline_colour:
+    return xosd_set_outline_colour(osd, s);
+  default:
+    return -1;
+  }
+}
+
+/* Make one call. Returns -1 if its object does not exist. */
+static int
+replay(const struct call *c)
+{
+  xosd **osd = &instances[c->r.instance];
+
+  if (c->r.op == REC_create || c->r.op == REC_clone) {
+    if (*osd != NULL)
+      xosd_destroy(*osd);
+    if (c->r.op == REC_create)
+      *osd = xosd_create(c->r.value);
+    else if (instances[(uint16_t) c->r.value] != NULL)
+      *osd = xosd_clone(instances[(uint16_t) c->r.value]);
+    else
+      *osd = NULL;
+    if (*osd == NULL)
+      fprintf(stderr, "xosd_replay: cannot create instance %d: %s\n",
+              c->r.instance, xosd_error ? xosd_error : "no source");
+    return *osd ? 0 : -1;
+  }
+  if (*osd == NULL)
+    return -1;
+
+  switch (c->r.op) {
+  case REC_destroy:
+    xosd_destroy(*osd);
+    *osd = NULL;
+    break;
+  case REC_string:
+    xosd_display(*osd, c->r.arg, XOSD_string, c->string);
+    break;
+  case REC_percentage:
+    xosd_display(*osd, c->r.arg, XOSD_percentage, c->r.value);
+    break;
+  case REC_slider:
+    xosd_display(*osd, c->r.arg, XOSD_slider, c->r.value);
+    break;
+  case REC_set_int:
+    set_int(*osd, c->r.arg, c->r.value);
+    break;
+  case REC_set_string:
+    set_string(*osd, c->r.arg, c->string);
+    break;
+  case REC_scroll:
+    xosd_scroll(*osd, c->r.value);
+    break;
+  case REC_show:
+    xosd_show(*osd);
+    break;
+  case REC_hide:
+    xosd_hide(*osd);
+    break;
+  case REC_ticker:
+    xosd_display(*osd, c->r.arg, XOSD_ticker, c->string);
+    break;
+  }
+  return 0;
+}
+
+/* Sleep until "when", a time from now(). */
+static void
+sleep_until(double when)
+{
+  double left = when - now();
+  struct timespec ts;
+
+  if (left <= 0)
+    return;
+  ts.tv_sec = (time_t) left;
+  ts.tv_nsec = (long) ((left - ts.tv_sec) * 1e9);
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+/* }}} */
+
+/* Report {{{ */
+static void
+print_ops(const struct call *calls, const double *us, int n)
+{
+  double *v = malloc(n * sizeof(double));
+  int op, i, first = 1;
+
+  fprintf(out, "  \"calls_us\": {\n");
+  for (op = 0; op < REC_nops; op++) {
+    double sum = 0;
+    int count = 0;
+
+    for (i = 0; i < n; i++)
+      if (calls[i].r.op == op && us[i] >= 0)
+        sum += v[count++] = us[i];
+    if (count == 0)
+      continue;
+    qsort(v, count, sizeof(double), compare_double);
+    fprintf(out,
+            "%s    \"%s\": {\"count\": %d, \"mean\": %.1f, \"p50\": %.1f, "
+            "\"p99\": %.1f, \"max\": %.1f}", first ? "" : ",\n",
+            op_names[op], count, sum / count, v[count / 2],
+            v[count * 99 / 100], v[count - 1]);
+    first = 0;
+  }
+  fprintf(out, "\n  },\n");
+  free(v);
+}
+
+/* }}} */
+
+int
+main(int argc, char *argv[])
+{
+  struct call *calls;
+  double *us, start, end, recorded = 0, lag = 0, max_lag = 0;
+  int c, i, ncalls, realtime = 0, skipped = 0;
+
+  out = stdout;
+  while ((c = getopt(argc, argv, "ro:h")) != -1) {
+    switch (c) {
+    case 'r':
+      realtime = 1;
+      break;
+    case 'o':
+      if ((out = fopen(optarg, "w")) == NULL) {
+        perror(optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-r] [-o FILE] RECORDING\n"
+              "Replay calls recorded with XOSD_RECORD=RECORDING.\n"
+              "\n"
+              "  -r  Keep the recorded pauses between calls\n"
+              "  -o  Write the JSON results to FILE instead of stdout\n",
+              argv[0]);
+      return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-r] [-o FILE] RECORDING\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if ((calls = load(argv[optind], &ncalls)) == NULL)
+    return EXIT_FAILURE;
+  us = malloc((ncalls + 1) * sizeof(double));
+
+  start = now();
+  for (i = 0; i < ncalls; i++) {
+    double t;
+
+    recorded += calls[i].r.delta / 1e6;
+    if (realtime) {
+      sleep_until(start + recorded);
+      lag = now() - (start + recorded);
+      if (lag > max_lag)
+        max_lag = lag;
+    }
+    t = now();
+    if (replay(&calls[i]) == -1) {
+      us[i] = -1;
+      skipped++;
+    } else
+      us[i] = (now() - t) * 1e6;
+  }
+  /* Objects the program never destroyed. Destroying waits for their last
+   * redraw, so the total includes it. */
+  for (i = 0; i <= UINT16_MAX; i++)
+    if (instances[i] != NULL)
+      xosd_destroy(instances[i]);
+  end = now();
+
+  fprintf(out, "{\n  \"recording\": \"%s\",\n  \"mode\": \"%s\",\n",
+          argv[optind], realtime ? "realtime" : "fast");
+  fprintf(out, "  \"calls\": %d,\n  \"skipped\": %d,\n", ncalls, skipped);
+  print_ops(calls, us, ncalls);
+  fprintf(out, "  \"recorded_s\": %.6f,\n  \"replay_s\": %.6f", recorded,
+          end - start);
+  if (realtime)
+    fprintf(out, ",\n  \"max_lag_us\": %.1f", max_lag * 1e6);
+  fprintf(out, "\n}\n");
+
+  for (i = 0; i < ncalls; i++)
+    free(calls[i].string);
+  free(calls);
+  free(us);
+  return out == stdout || fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: foldmethod=marker tabstop=2 shiftwidth=2 expandtab
+ */
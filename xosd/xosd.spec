@@ -59,7 +59,11 @@ ldconfig
 %{_libdir}/libxosd.so.4
 %{_libdir}/libxosd.so
 %{_bindir}/osd_cat
+%{_bindir}/osdd
+%{_libdir}/libosdd.so.0*
+%{_libdir}/libosdd.so
 %doc %{_mandir}/man1/osd_cat.1*
+%doc %{_mandir}/man1/osdd.1*
 %doc %{_mandir}/man3/xosd.3*
 %doc AUTHORS ChangeLog COPYING NEWS README
 
@@ -67,7 +71,10 @@ ldconfig
 %defattr(-, root, root)
 %{_libdir}/libxosd.a
 %{_libdir}/libxosd.la
+%{_libdir}/libosdd.a
+%{_libdir}/libosdd.la
 %{_includedir}/xosd.h
+%{_includedir}/osdd.h
 %{_bindir}/xosd-config
 %{aclocaldir}/libxosd.m4
 %doc %{_mandir}/man1/xosd-config.1*